@@ -0,0 +1,401 @@
+//
+//  bench_jzmq.cpp
+//
+//  Throughput and latency benchmarks for jzmq:
+//
+//  - reqrep: Client / Server round trips.  Reports round trips per second,
+//    MB/sec (request bytes) and p50 / p99 / p99.9 round trip latency.
+//  - pubsub: One Publisher streaming to 1, 2 and 4 Subscribers (each on its
+//    own thread).  Reports messages per second and MB/sec per subscriber.
+//
+//  Each benchmark runs over thread:// (jzmq's own in-process queues),
+//  inproc://, ipc:// and tcp://localhost for message sizes from 16 B to
+//  16 MB.  A human readable table goes to stderr and the results go to
+//  stdout (or the --json file) as a JSON array, one object per run, so they
+//  can be collected and compared between builds.
+//
+//  usage: bench_jzmq [--quick] [--json results.json]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/metrics.h"
+#include "jzmq/publisher.h"
+#include "jzmq/server.h"
+#include "jzmq/subscriber.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jzmq;
+using jtil::string_util::ToNarrowString;
+
+namespace bench {
+  const int timeout_ms = 5000;
+  const uint64_t message_sizes[] = {16, 256, 4096, 65536, 1 << 20, 16 << 20};
+  const uint32_t n_message_sizes = 6;
+  const uint32_t subscriber_counts[] = {1, 2, 4};
+  const uint32_t n_subscriber_counts = 3;
+
+  struct TransportSpec {
+    const char* name;
+    std::string bind_str;
+    std::string connect_str;
+  };
+
+  struct Result {
+    std::string benchmark;
+    std::string transport;
+    uint64_t msg_size;
+    uint32_t n_subscribers;
+    uint64_t n_msgs;
+    double seconds;
+    double msgs_per_sec;
+    double mb_per_sec;
+    HistogramSnapshot latency_ns;  // Round trip (reqrep only)
+  };
+
+  // Bytes pushed through each run, so small messages get many iterations and
+  // large ones a few
+  uint64_t bytes_per_run = 256 << 20;
+  uint64_t max_msgs_per_run = 200000;
+  std::atomic<uint32_t> port(5600);
+
+  uint64_t numMessages(const uint64_t msg_size) {
+    uint64_t n = bytes_per_run / msg_size;
+    n = n < max_msgs_per_run ? n : max_msgs_per_run;
+    return n < 10 ? 10 : n;
+  }
+
+  std::vector<TransportSpec> makeTransports() {
+    std::vector<TransportSpec> transports;
+    TransportSpec t;
+    t.name = "thread";
+    t.bind_str = t.connect_str = "thread://jzmq_bench";
+    transports.push_back(t);
+    t.name = "inproc";
+    t.bind_str = t.connect_str = "inproc://jzmq_bench";
+    transports.push_back(t);
+#ifndef _WIN32
+    t.name = "ipc";
+    t.bind_str = t.connect_str = "ipc:///tmp/jzmq_bench.ipc";
+    transports.push_back(t);
+#endif
+    t.name = "tcp";
+    transports.push_back(t);  // Ports are allocated per run
+    return transports;
+  }
+
+  // A fresh endpoint per run so lingering tcp sockets never collide
+  void endpoint(const TransportSpec& transport, std::string& bind_str,
+    std::string& connect_str) {
+    if (strcmp(transport.name, "tcp") != 0) {
+      bind_str = transport.bind_str;
+      connect_str = transport.connect_str;
+      return;
+    }
+    std::stringstream bind_ss, connect_ss;
+    const uint32_t p = port++;
+    bind_ss << "tcp://*:" << p;
+    connect_ss << "tcp://localhost:" << p;
+    bind_str = bind_ss.str();
+    connect_str = connect_ss.str();
+  }
+
+  double seconds(const uint64_t ns) {
+    return (double)ns * 1e-9;
+  }
+
+  // Echoes every request until an empty one arrives
+  void EchoServer(const std::string& bind_str, std::atomic<bool>* bound) {
+    try {
+      Server server(bind_str);
+      server.initConn();
+      *bound = true;
+      Message msg;
+      while (server.receiveMessage(msg, timeout_ms) > 0) {
+        const bool stop = msg.size() == 0;
+        server.sendMessage(msg, timeout_ms);
+        if (stop) {
+          break;
+        }
+      }
+      server.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cerr << "EchoServer - ERROR: " << ToNarrowString(e.errorMsg()) <<
+        std::endl;
+      *bound = true;
+    }
+  }
+
+  bool RunReqRep(const TransportSpec& transport, const uint64_t msg_size,
+    Result& result) {
+    std::string bind_str, connect_str;
+    endpoint(transport, bind_str, connect_str);
+    std::atomic<bool> bound(false);
+    std::thread server(EchoServer, bind_str, &bound);
+    while (!bound) {
+      std::this_thread::yield();  // inproc needs the bind first
+    }
+
+    bool ok = true;
+    const uint64_t n_msgs = numMessages(msg_size);
+    LatencyHistogram latency;
+    uint64_t elapsed_ns = 0;
+    try {
+      Client client(connect_str);
+      client.initConn();
+      std::vector<char> request((size_t)msg_size, 'x');
+      Message reply;
+      const uint64_t t0 = MetricsRecorder::nowNs();
+      for (uint64_t i = 0; i < n_msgs && ok; i++) {
+        const uint64_t t_send = MetricsRecorder::nowNs();
+        ok = client.sendData(&request[0], msg_size, timeout_ms) > 0;
+        ok = ok && client.receiveMessage(reply, timeout_ms) == 1;
+        latency.record(MetricsRecorder::nowNs() - t_send);
+      }
+      elapsed_ns = MetricsRecorder::nowNs() - t0;
+      client.sendData(NULL, 0, timeout_ms);  // Stop the server
+      client.receiveMessage(reply, timeout_ms);
+      client.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cerr << "RunReqRep - ERROR: " << ToNarrowString(e.errorMsg()) <<
+        std::endl;
+      ok = false;
+    }
+    server.join();
+
+    result.benchmark = "reqrep";
+    result.transport = transport.name;
+    result.msg_size = msg_size;
+    result.n_subscribers = 0;
+    result.n_msgs = n_msgs;
+    result.seconds = seconds(elapsed_ns);
+    result.msgs_per_sec = (double)n_msgs / result.seconds;
+    result.mb_per_sec = result.msgs_per_sec * (double)msg_size / 1e6;
+    latency.snapshot(result.latency_ns);
+    return ok;
+  }
+
+  struct SubscriberResult {
+    uint64_t n_received;
+    uint64_t elapsed_ns;  // First to last data message
+    bool ok;
+  };
+
+  // Receives until the end marker (an empty message).  Warm up messages
+  // (1 byte) just signal that the subscription is live.
+  void SubscriberThread(const std::string& connect_str,
+    const ConnectionOptions& options, std::atomic<uint32_t>* n_ready,
+    SubscriberResult* result) {
+    result->n_received = 0;
+    result->elapsed_ns = 0;
+    result->ok = true;
+    bool ready = false;
+    try {
+      Subscriber subscriber(connect_str, options);
+      subscriber.initConn();
+      Message msg;
+      uint64_t t0 = 0;
+      while (true) {
+        int rc = subscriber.receiveMessage(msg, timeout_ms);
+        if (rc <= 0) {
+          result->ok = false;
+          break;
+        }
+        if (msg.size() == 0) {
+          break;
+        } else if (msg.size() == 1) {
+          if (!ready) {
+            ready = true;
+            (*n_ready)++;
+          }
+          continue;
+        }
+        if (result->n_received == 0) {
+          t0 = MetricsRecorder::nowNs();
+        }
+        result->n_received++;
+        result->elapsed_ns = MetricsRecorder::nowNs() - t0;
+      }
+      subscriber.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cerr << "SubscriberThread - ERROR: " <<
+        ToNarrowString(e.errorMsg()) << std::endl;
+      result->ok = false;
+    }
+    if (!ready) {
+      (*n_ready)++;  // Don't leave the publisher waiting
+    }
+  }
+
+  bool RunPubSub(const TransportSpec& transport, const uint64_t msg_size,
+    const uint32_t n_subscribers, Result& result) {
+    std::string bind_str, connect_str;
+    endpoint(transport, bind_str, connect_str);
+    // No drops: the publisher queues as much as it needs
+    ConnectionOptions options;
+    options.send_hwm = 0;
+    options.receive_hwm = 0;
+    options.linger_ms = 0;
+
+    bool ok = true;
+    const uint64_t n_msgs = numMessages(msg_size) / n_subscribers;
+    std::vector<SubscriberResult> sub_results(n_subscribers);
+    std::vector<std::thread> subscribers;
+    try {
+      Publisher publisher(bind_str, options);
+      publisher.initConn();
+      std::atomic<uint32_t> n_ready(0);
+      for (uint32_t i = 0; i < n_subscribers; i++) {
+        subscribers.push_back(std::thread(SubscriberThread, connect_str,
+          options, &n_ready, &sub_results[i]));
+      }
+
+      // Late joiners miss messages, so warm up until every subscriber is in
+      char warmup = 'w';
+      const uint64_t t_warmup = MetricsRecorder::nowNs();
+      while (n_ready < n_subscribers &&
+        seconds(MetricsRecorder::nowNs() - t_warmup) < 5.0) {
+        publisher.sendData(&warmup, 1, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      std::vector<char> data((size_t)msg_size, 'x');
+      for (uint64_t i = 0; i < n_msgs && ok; i++) {
+        ok = publisher.sendData(&data[0], msg_size, timeout_ms) > 0;
+      }
+      publisher.sendData(NULL, 0, timeout_ms);
+      for (uint32_t i = 0; i < n_subscribers; i++) {
+        subscribers[i].join();
+      }
+      publisher.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cerr << "RunPubSub - ERROR: " << ToNarrowString(e.errorMsg()) <<
+        std::endl;
+      ok = false;
+      for (uint32_t i = 0; i < subscribers.size(); i++) {
+        subscribers[i].join();
+      }
+    }
+
+    // Report the slowest subscriber
+    uint64_t elapsed_ns = 0;
+    for (uint32_t i = 0; i < n_subscribers; i++) {
+      ok = ok && sub_results[i].ok && sub_results[i].n_received == n_msgs;
+      if (sub_results[i].elapsed_ns > elapsed_ns) {
+        elapsed_ns = sub_results[i].elapsed_ns;
+      }
+    }
+    result.benchmark = "pubsub";
+    result.transport = transport.name;
+    result.msg_size = msg_size;
+    result.n_subscribers = n_subscribers;
+    result.n_msgs = n_msgs;
+    result.seconds = seconds(elapsed_ns > 0 ? elapsed_ns : 1);
+    result.msgs_per_sec = (double)n_msgs / result.seconds;
+    result.mb_per_sec = result.msgs_per_sec * (double)msg_size / 1e6;
+    return ok;
+  }
+
+  void printResult(const Result& r, const bool ok) {
+    fprintf(stderr, "%-7s %-7s %9llu B %2u subs %9.0f msg/s %9.1f MB/s",
+      r.benchmark.c_str(), r.transport.c_str(),
+      (unsigned long long)r.msg_size, r.n_subscribers, r.msgs_per_sec,
+      r.mb_per_sec);
+    if (r.latency_ns.count > 0) {
+      fprintf(stderr, "  rtt p50 %7.1f us p99 %7.1f us p99.9 %7.1f us",
+        r.latency_ns.percentile(0.5) * 1e-3,
+        r.latency_ns.percentile(0.99) * 1e-3,
+        r.latency_ns.percentile(0.999) * 1e-3);
+    }
+    fprintf(stderr, "%s\n", ok ? "" : "  FAILED");
+  }
+
+  void writeJson(FILE* out, const Result& r, const bool ok,
+    const bool last) {
+    fprintf(out, "  {\"benchmark\": \"%s\", \"transport\": \"%s\", "
+      "\"msg_size\": %llu, \"subscribers\": %u, \"msgs\": %llu, "
+      "\"seconds\": %.6f, \"msgs_per_sec\": %.1f, \"mb_per_sec\": %.3f",
+      r.benchmark.c_str(), r.transport.c_str(),
+      (unsigned long long)r.msg_size, r.n_subscribers,
+      (unsigned long long)r.n_msgs, r.seconds, r.msgs_per_sec, r.mb_per_sec);
+    if (r.latency_ns.count > 0) {
+      fprintf(out, ", \"rtt_ns\": {\"p50\": %llu, \"p99\": %llu, "
+        "\"p999\": %llu, \"max\": %llu, \"mean\": %.1f}",
+        (unsigned long long)r.latency_ns.percentile(0.5),
+        (unsigned long long)r.latency_ns.percentile(0.99),
+        (unsigned long long)r.latency_ns.percentile(0.999),
+        (unsigned long long)r.latency_ns.max, r.latency_ns.mean());
+    }
+    fprintf(out, ", \"ok\": %s}%s\n", ok ? "true" : "false", last ? "" : ",");
+  }
+
+};  // namespace bench
+
+int main(int argc, char* argv[]) {
+  using namespace bench;
+  const char* json_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      bytes_per_run = 16 << 20;
+      max_msgs_per_run = 10000;
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--json results.json]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<TransportSpec> transports = makeTransports();
+  std::vector<Result> results;
+  std::vector<bool> oks;
+  for (uint32_t t = 0; t < transports.size(); t++) {
+    for (uint32_t s = 0; s < n_message_sizes; s++) {
+      Result result;
+      bool ok = RunReqRep(transports[t], message_sizes[s], result);
+      printResult(result, ok);
+      results.push_back(result);
+      oks.push_back(ok);
+    }
+    for (uint32_t n = 0; n < n_subscriber_counts; n++) {
+      for (uint32_t s = 0; s < n_message_sizes; s++) {
+        Result result;
+        bool ok = RunPubSub(transports[t], message_sizes[s],
+          subscriber_counts[n], result);
+        printResult(result, ok);
+        results.push_back(result);
+        oks.push_back(ok);
+      }
+    }
+  }
+
+  FILE* out = stdout;
+  if (json_path != NULL) {
+    out = fopen(json_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Could not open %s\n", json_path);
+      return 1;
+    }
+  }
+  fprintf(out, "[\n");
+  bool all_ok = true;
+  for (uint32_t i = 0; i < results.size(); i++) {
+    writeJson(out, results[i], oks[i], i + 1 == results.size());
+    all_ok = all_ok && oks[i];
+  }
+  fprintf(out, "]\n");
+  if (out != stdout) {
+    fclose(out);
+  }
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+//
+//  async_client.h
+//
+//  AsyncClient is a pipelined alternative to Client.  Client uses a ZMQ_REQ
+//  socket, which enforces strict send/receive lockstep and so caps throughput
+//  at one request per round trip.  AsyncClient uses a ZMQ_DEALER socket, tags
+//  every request with an id and allows up to max_outstanding requests in
+//  flight.  Replies are matched to their request and handed to a callback.
+//
+//  Wire format: [request id (8 bytes)][empty delimiter][request frames...].
+//  The id travels in the envelope, so the existing (ZMQ_REP) Server handles
+//  these requests unchanged and echoes the id back with its reply, as does
+//  the ROUTER based AsyncServer.
+//
+//  Callbacks are called from processReplies() on the thread that owns the
+//  AsyncClient (like all Connections it is not thread safe).  Use the
+//  request methods below rather than sendData/receiveData, which bypass the
+//  request framing.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection.h"
+
+namespace jzmq {
+
+  class AsyncClient : public Connection {
+  public:
+    // Called with the id returned by sendRequest and the reply frames (the
+    // envelope has been stripped).  The frames may be moved from.
+    typedef std::function<void(const uint64_t request_id,
+      std::vector<Message>& reply)> Callback;
+
+    AsyncClient(const std::string& conn_str,
+      const uint32_t max_outstanding = 16,
+      const ConnectionOptions& options = ConnectionOptions());
+    virtual void initConn();
+    virtual void killConn();
+    virtual ~AsyncClient();  // Closes the connection if still open
+
+    // sendRequest queues a request and returns its id (never 0).  If
+    // max_outstanding requests are already in flight it first processes
+    // replies (waiting up to timout_ms) to free a slot.  Returns 0 if the
+    // request could not be queued before the timeout.
+    uint64_t sendRequest(const char* data, const uint64_t size,
+      const Callback& callback, const int timout_ms = -1);
+    uint64_t sendRequest(const DataBuffer* parts, const uint32_t n_parts,
+      const Callback& callback, const int timout_ms = -1);
+
+    // processReplies waits at most once (up to timout_ms) for a reply, then
+    // handles every reply that is already queued, calling the matching
+    // callbacks.  Replies to unknown or cancelled requests are dropped.
+    // Returns the number of callbacks called (0 on timeout) or kInterrupted.
+    int processReplies(const int timout_ms = -1);
+
+    // cancelRequest forgets an outstanding request (its callback will not be
+    // called and a late reply is dropped).  Returns false if the request is
+    // not outstanding.
+    bool cancelRequest(const uint64_t request_id);
+
+    uint32_t numOutstanding() const;
+    uint32_t maxOutstanding() const;
+
+  private:
+    uint32_t max_outstanding_;
+    uint64_t next_request_id_;
+    std::unordered_map<uint64_t, Callback> outstanding_;
+    std::vector<Message> reply_;  // Reused receive buffer
+    std::vector<DataBuffer> request_;  // Reused send buffer
+
+    // Handles one received reply.  Returns true if a callback was called.
+    bool dispatchReply();
+
+    // Non-copyable, non-assignable.
+    AsyncClient(AsyncClient&);
+    AsyncClient& operator=(const AsyncClient&);
+  };
+
+};  // namespace jzmq
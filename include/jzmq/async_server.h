@@ -0,0 +1,92 @@
+//
+//  async_server.h
+//
+//  AsyncServer is an asynchronous alternative to Server.  Server uses a
+//  ZMQ_REP socket, so every receiveData() must be followed by its sendData()
+//  and one slow request blocks all other clients.  AsyncServer uses a
+//  ZMQ_ROUTER socket: each request comes with the envelope needed to route
+//  its reply, and replies can be sent later and in any order.
+//
+//  Replies may also be posted from other threads with postReply().  They are
+//  handed to the server thread over an internal inproc socket and sent from
+//  there (the ROUTER socket itself is only touched by the owning thread).
+//  Posted replies are forwarded inside receiveRequest() and flushReplies().
+//
+//  AsyncServer is wire compatible with Client (ZMQ_REQ) and with AsyncClient
+//  (ZMQ_DEALER): the envelope is every frame before the empty delimiter.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection.h"
+
+namespace jzmq {
+
+  class AsyncServer : public Connection {
+  public:
+    // A request and what it takes to reply to it.
+    struct Request {
+      // Routing frames (peer identity and, for an AsyncClient, the request
+      // id).  The empty delimiter is not included.
+      std::vector<Message> envelope;
+      // The request itself.
+      std::vector<Message> parts;
+    };
+
+    AsyncServer(const std::string& conn_str,
+      const ConnectionOptions& options = ConnectionOptions());
+    virtual void initConn();
+    virtual void killConn();
+    virtual ~AsyncServer();  // Closes the connection if still open
+
+    // receiveRequest waits up to timout_ms for the next request (forwarding
+    // any posted replies while it waits).  Returns 1 if a request was
+    // received, 0 on timeout or kInterrupted.  Requests without an envelope
+    // delimiter are dropped.  The poll based wait is used regardless of the
+    // TimeoutMode.
+    int receiveRequest(Request& request, const int timout_ms = -1);
+
+    // sendReply sends a reply to the peer in envelope (usually the envelope
+    // of a Request; it is consumed).  Must be called from the owning thread.
+    // ROUTER sockets never block: the reply is dropped if the peer has gone
+    // away.  Returns the number of body bytes queued.
+    int sendReply(std::vector<Message>& envelope, const DataBuffer* parts,
+      const uint32_t n_parts);
+    int sendReply(std::vector<Message>& envelope, std::vector<Message>& parts);
+
+    // postReply can be called from any thread.  The envelope and parts are
+    // consumed and the reply is sent from the server thread during the next
+    // receiveRequest() or flushReplies().
+    void postReply(std::vector<Message>& envelope, std::vector<Message>& parts);
+
+    // flushReplies sends all posted replies now.  Returns how many were sent.
+    int flushReplies();
+
+  private:
+    void* reply_pull_;  // Bound by the server thread
+    void* reply_push_;  // Shared by posting threads (guarded by reply_lck_)
+    std::mutex reply_lck_;
+    std::string reply_conn_str_;
+    std::vector<Message> frames_;  // Reused receive buffer
+    static std::atomic<uint64_t> num_instances_;
+
+    void sendFrames(void* socket, std::vector<Message>& envelope,
+      std::vector<Message>& parts, const std::string& err_msg);
+    bool splitRequest(Request& request);
+    void closeReplySockets();
+    // closeAndThrow for initConn() failures once the reply sockets exist
+    void closeAllAndThrow(const std::string& err_msg);
+
+    // Non-copyable, non-assignable.
+    AsyncServer(AsyncServer&);
+    AsyncServer& operator=(const AsyncServer&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,134 @@
+//
+//  bounded_queue.h
+//
+//  A bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's
+//  design).  Each cell's sequence number says whether it is ready to be
+//  written (== pos) or read (== pos + 1) by the producer or consumer that
+//  claimed position pos, so push and pop are a single CAS on the uncontended
+//  path.  Used for the BufferPool freelists and the thread:// transport.
+//
+//  T should be cheap to copy (eg. a pointer).
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include "jtil/math/math_types.h"
+
+namespace jzmq {
+
+  template <typename T>
+  class BoundedQueue {
+  public:
+    // capacity is rounded up to a power of two (at least 2: with a single
+    // cell a full queue looks empty to the next producer).
+    explicit BoundedQueue(const uint32_t capacity);
+    ~BoundedQueue();
+
+    // push returns false if the queue is full, pop if it is empty.  Both are
+    // thread safe.
+    bool push(const T& value);
+    bool pop(T& value);
+
+    uint64_t capacity() const;
+
+  private:
+    static const uint32_t kCacheLine = 64;
+
+    struct Cell {
+      std::atomic<uint64_t> sequence;
+      T value;
+    };
+
+    Cell* cells_;
+    uint64_t capacity_;
+    uint64_t mask_;
+    // Producers and consumers each get their own cache line
+    char pad0_[kCacheLine];
+    std::atomic<uint64_t> enqueue_pos_;
+    char pad1_[kCacheLine - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> dequeue_pos_;
+    char pad2_[kCacheLine - sizeof(std::atomic<uint64_t>)];
+
+    // Non-copyable, non-assignable.
+    BoundedQueue(BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+  };
+
+  template <typename T>
+  BoundedQueue<T>::BoundedQueue(const uint32_t capacity) {
+    capacity_ = 2;
+    while (capacity_ < capacity) {
+      capacity_ <<= 1;
+    }
+    mask_ = capacity_ - 1;
+    cells_ = new Cell[capacity_];
+    for (uint64_t i = 0; i < capacity_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+      cells_[i].value = T();
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  template <typename T>
+  BoundedQueue<T>::~BoundedQueue() {
+    delete[] cells_;
+  }
+
+  template <typename T>
+  bool BoundedQueue<T>::push(const T& value) {
+    Cell* cell;
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+      int64_t dif = (int64_t)seq - (int64_t)pos;
+      if (dif == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+          std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;  // Full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename T>
+  bool BoundedQueue<T>::pop(T& value) {
+    Cell* cell;
+    uint64_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+      int64_t dif = (int64_t)seq - (int64_t)(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+          std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;  // Empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    value = cell->value;
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename T>
+  uint64_t BoundedQueue<T>::capacity() const {
+    return capacity_;
+  }
+
+};  // namespace jzmq
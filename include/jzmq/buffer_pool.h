@@ -0,0 +1,99 @@
+//
+//  buffer_pool.h
+//
+//  BufferPool recycles message buffers so that sending large messages at a
+//  high rate doesn't go through malloc and free for every message.  Buffers
+//  come in power of two size classes, are cache line aligned and can
+//  optionally be backed by huge pages (Linux, transparent huge pages).  Each
+//  size class keeps released buffers on a bounded lock-free freelist.
+//
+//  Pooled buffers are meant for the zero-copy send: ZeroMQ returns the
+//  buffer to the pool (possibly from one of its I/O threads) once the
+//  message has been written out, eg:
+//
+//    char* buff = pool.acquire(size);
+//    ... fill buff ...
+//    conn.sendData(buff, size, BufferPool::recycle, &pool);
+//
+//  The pool must outlive every buffer it hands out (including buffers still
+//  queued in ZeroMQ).  acquire, release and recycle are thread safe.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/bounded_queue.h"
+
+namespace jzmq {
+
+  struct BufferPoolStats {
+    uint64_t hits;  // acquire() served from a freelist
+    uint64_t misses;  // acquire() that had to allocate
+    uint64_t buffers_outstanding;  // Acquired and not yet released
+    uint64_t bytes_outstanding;  // Capacity of the outstanding buffers
+    uint64_t buffers_cached;  // On the freelists
+    uint64_t bytes_cached;
+  };
+
+  class BufferPool {
+  public:
+    // Buffers are cache line aligned.
+    static const uint32_t kAlignment = 64;
+
+    // Size classes are the powers of two from min_buffer_size up to
+    // max_buffer_size; larger requests are allocated (and freed) directly.
+    // Each class caches at most max_cached_per_class free buffers.
+    // huge_pages asks the OS to back buffers of 2MB and over with huge pages.
+    BufferPool(const uint64_t min_buffer_size = 4096,
+      const uint64_t max_buffer_size = 16 * 1024 * 1024,
+      const uint32_t max_cached_per_class = 64,
+      const bool huge_pages = false);
+    ~BufferPool();
+
+    // acquire returns a buffer of at least size bytes.  Thread safe.
+    char* acquire(const uint64_t size);
+
+    // release returns a buffer from acquire to the pool.  Thread safe.
+    // Throws if buffer wasn't acquired from this pool (or is released twice).
+    void release(char* buffer);
+
+    // A FreeFunc that releases data to the pool passed as hint.  It runs on
+    // a ZeroMQ I/O thread, so a buffer release() would reject is reported and
+    // leaked instead of throwing.
+    static void recycle(void* data, void* hint);
+
+    // The usable size of a buffer from acquire.
+    static uint64_t capacity(const char* buffer);
+
+    BufferPoolStats stats() const;
+
+  private:
+    uint64_t min_buffer_size_;
+    uint32_t n_classes_;
+    bool huge_pages_;
+    std::vector<BoundedQueue<char*>*> free_lists_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> buffers_outstanding_;
+    std::atomic<uint64_t> bytes_outstanding_;
+    std::atomic<uint64_t> buffers_cached_;
+    std::atomic<uint64_t> bytes_cached_;
+
+    // Size class for size bytes, or n_classes_ if it's too large
+    uint32_t sizeClass(const uint64_t size) const;
+    // Returns false (and leaves buffer alone) if it isn't from this pool
+    bool tryRelease(char* buffer);
+    char* allocate(const uint64_t capacity, const uint32_t size_class);
+    static void deallocate(char* buffer);
+
+    // Non-copyable, non-assignable.
+    BufferPool(BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+  };
+
+};  // namespace jzmq
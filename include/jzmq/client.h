@@ -19,13 +19,18 @@ namespace jzmq {
   // The Client class (to be paired with Server)
   class Client : public Connection {
   public:
-    Client(const std::string& conn_str);
+    Client(const std::string& conn_str, 
+      const ConnectionOptions& options = ConnectionOptions());
     virtual void initConn();
     virtual void killConn();
-    virtual ~Client();
+    virtual ~Client();  // Closes the connection if still open
+
+    // Move-only (see Connection::Connection(Connection&&)).
+    Client(Client&& other);
+    Client& operator=(Client&& other);
 
   private:
-    // Non-copyable, non-assignable.
+    // Non-copyable.
     Client(Client&);
     Client& operator=(const Client&);
   };
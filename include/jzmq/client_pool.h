@@ -0,0 +1,103 @@
+//
+//  client_pool.h
+//
+//  ClientPool keeps connected Clients per endpoint (conn_str) so that code
+//  talking to a fleet of servers pays for the connect (and the TCP
+//  handshake) once per socket instead of once per request.  acquire() hands
+//  out an idle Client for the endpoint, or connects a new one if there is
+//  none, as a Lease that gives the Client back to the pool when it goes out
+//  of scope.
+//
+//  A Client that failed mid-request (eg. a receive timed out) is still
+//  waiting for its reply, so it must not be reused: call Lease::discard()
+//  and it is closed instead.  request() does this for you.
+//
+//  acquire() and request() are thread safe.  A leased Client belongs to the
+//  thread that holds the Lease; the pool's lock is the memory barrier ZeroMQ
+//  needs to move a socket from one thread to another.  The pool must
+//  outlive its Leases.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/connection_options.h"
+#include "jzmq/message.h"
+
+namespace jzmq {
+
+  class ClientPool {
+  public:
+    // A Client on loan from the pool.  Move-only.
+    class Lease {
+    public:
+      Lease(Lease&& other);
+      Lease& operator=(Lease&& other);
+      ~Lease();  // Gives the Client back to the pool (unless discarded)
+
+      Client& client();
+      Client* operator->();
+
+      // discard closes the Client instead of giving it back.
+      void discard();
+
+    private:
+      ClientPool* pool_;  // NULL once given back or discarded
+      Client client_;
+
+      friend class ClientPool;
+      Lease(ClientPool* pool, Client&& client);
+      void giveBack();
+
+      // Non-copyable.
+      Lease(Lease&);
+      Lease& operator=(const Lease&);
+    };
+
+    // options are used for every Client.  At most max_idle idle Clients are
+    // kept per endpoint; the rest are closed when they are given back.
+    ClientPool(const ConnectionOptions& options = ConnectionOptions(),
+      const uint32_t max_idle = 16);
+    ~ClientPool();  // Closes the idle Clients
+
+    // acquire returns a connected Client for conn_str.  Throws if a new
+    // Client can't be connected.
+    Lease acquire(const std::string& conn_str);
+
+    // request sends data to conn_str on a pooled Client and waits up to
+    // timout_ms for the reply.  Returns 1, or 0 on timeout (the Client is
+    // then discarded so that a late reply can't be taken for the answer to
+    // the next request).
+    int request(const std::string& conn_str, const char* data,
+      const uint64_t size, Message& reply, const int timout_ms = -1);
+
+    // clear closes every idle Client.  Leased Clients are not affected.
+    void clear();
+
+    uint64_t numIdle() const;
+    uint64_t numConnected() const;  // Clients connected by acquire so far
+
+  private:
+    ConnectionOptions options_;
+    uint32_t max_idle_;
+    mutable std::mutex lck_;
+    std::unordered_map<std::string, std::vector<Client> > idle_;
+    uint64_t num_idle_;
+    std::atomic<uint64_t> num_connected_;
+
+    void release(Client&& client);
+
+    // Non-copyable, non-assignable.
+    ClientPool(ClientPool&);
+    ClientPool& operator=(const ClientPool&);
+  };
+
+};  // namespace jzmq
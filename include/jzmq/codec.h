@@ -0,0 +1,83 @@
+//
+//  codec.h
+//
+//  Codecs trade CPU for bandwidth on large messages.  A Codec is attached to
+//  a Connection with Connection::setCodec(), which then encodes the frames
+//  it sends and decodes the frames it receives.  Every frame on such a
+//  connection starts with a small header whose flag says whether the body is
+//  encoded, so frames below the size threshold (or that don't compress) go
+//  out as they are and both kinds can be mixed freely.
+//
+//  ShuffleLZCodec is the built-in codec: a byte shuffle (with optional
+//  delta), which groups the n-th bytes of every element of an array
+//  together, followed by a fast LZ77 compressor.  The shuffle is what makes
+//  float arrays (depth images, vertex data, ...) compressible: exponent bytes
+//  are highly repetitive once they are next to each other.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <vector>
+#include "jtil/math/math_types.h"
+
+namespace jzmq {
+
+  // The interface for custom codecs.  A codec instance is used by one
+  // connection (and so one thread) and may keep scratch state between calls.
+  class Codec {
+  public:
+    virtual ~Codec() { }
+
+    // encode writes the encoded form of src to dst (which holds size bytes)
+    // and returns the encoded size.  Returns 0 if the data doesn't get
+    // smaller, in which case the frame is sent unencoded.
+    virtual uint64_t encode(const char* src, const uint64_t size,
+      char* dst) = 0;
+
+    // decode restores the raw_size bytes encoded in src into dst.  Throws a
+    // std::wruntime_error if src is corrupt.
+    virtual void decode(const char* src, const uint64_t size, char* dst,
+      const uint64_t raw_size) = 0;
+  };
+
+  class ShuffleLZCodec : public Codec {
+  public:
+    // element_size is the size in bytes of the array elements to shuffle (4
+    // for float arrays, 1 disables the shuffle).  delta stores each shuffled
+    // byte as the difference to the previous one, which helps slowly varying
+    // data such as depth images.  The settings travel with each encoded
+    // frame, so the receiving side's settings don't need to match.
+    ShuffleLZCodec(const uint32_t element_size = 4, const bool delta = false);
+    virtual ~ShuffleLZCodec();
+
+    virtual uint64_t encode(const char* src, const uint64_t size, char* dst);
+    virtual void decode(const char* src, const uint64_t size, char* dst,
+      const uint64_t raw_size);
+
+    // The individual stages (exposed for testing).  shuffle and unshuffle
+    // transpose size bytes of element_size byte elements (any tail that
+    // isn't a whole element is copied as is).  lzCompress returns 0 if the
+    // output would not fit in dst_size bytes; lzDecompress returns false if
+    // src is corrupt or doesn't decode to exactly dst_size bytes.
+    static void shuffle(const uint8_t* src, const uint64_t size,
+      const uint32_t element_size, uint8_t* dst);
+    static void unshuffle(const uint8_t* src, const uint64_t size,
+      const uint32_t element_size, uint8_t* dst);
+    static uint64_t lzCompress(const uint8_t* src, const uint64_t size,
+      uint8_t* dst, const uint64_t dst_size);
+    static bool lzDecompress(const uint8_t* src, const uint64_t size,
+      uint8_t* dst, const uint64_t dst_size);
+
+  private:
+    uint32_t element_size_;
+    bool delta_;
+    std::vector<uint8_t> scratch_;  // Shuffled bytes
+
+    // Non-copyable, non-assignable.
+    ShuffleLZCodec(ShuffleLZCodec&);
+    ShuffleLZCodec& operator=(const ShuffleLZCodec&);
+  };
+
+};  // namespace jzmq
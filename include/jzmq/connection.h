@@ -22,21 +22,45 @@
 //  it properly with a null.
 //  
 //  One zeromq context is automaticlly created and shared amongst threads in a 
-//  process.  Connections instances (ie sockets) should be used by a single 
+//  process and destroyed with the last connection.  ContextOptions::keep_alive
+//  keeps it after the last connection is killed, so reconnecting only costs
+//  a new socket; call Connection::shutdownContext() to release it.
+//  Connections instances (ie sockets) should be used by a single 
 //  thread.  Methods are not thread safe unless explicitly specified!
+//  SharedPublisher and SharedClient (shared_connection.h) give many threads
+//  one endpoint without a lock.  Connections are move-only and close 
+//  themselves when destroyed; ClientPool (client_pool.h) reuses connected
+//  Clients across requests and HedgedClient (hedged_client.h) hedges 
+//  requests across replicated servers.  SequencedPublisher and 
+//  SequencedSubscriber (sequenced_stream.h) add gap detection and snapshots
+//  to PUB/SUB so that late joiners get the current state.
+//
+//  The context defaults to a single I/O thread.  For high bandwidth call
+//  setContextOptions before the first initConn to add I/O threads (and pin
+//  them to CPUs), then use setAffinity to give heavy connections I/O threads
+//  of their own.
 //
 //  For fast message passing protocols use inproc (for threads within a 
 //  process) or ipc (between multiple processes on the same machine).  ipc is
 //  currently only supported on machines that supply UNIX domain sockets.
+//  For large messages between a Publisher and Subscribers on the same (POSIX)
+//  machine, shm:// avoids the kernel copies altogether (see shm_ring.h).
+//  Between threads of one process, thread:// skips ZeroMQ entirely and hands
+//  messages over through lock-free queues (see thread_transport.h).
 //
 //  the server does not have to start first for a connection to be made,
 //  however the client side messages will queue until we run out of space.
 //
-//  ZeroMQ does have mechanisms for receiving arbitrarily long amounts of data 
-//  (zmq_msg_recv), however for this wrapper I assume all message lengths are 
-//  known a-priori and are truncated when they go over this bound. I also do 
-//  not include an API for using the multi-part messages.  All these features 
-//  would be trivial to add (but would complicate this very simple API).
+//  The simple receiveData API assumes message lengths are known a-priori and
+//  truncates messages that go over this bound.  Use receiveMessage (which
+//  wraps zmq_msg_recv) to receive arbitrarily long messages without a copy.
+//
+//  Multi-part messages are sent with sendMultipart (one ZeroMQ frame per 
+//  buffer, so a header and a body never need to be concatenated) and received
+//  with receiveMultipart.  The single-part receive calls only return the first
+//  frame of a multi-part message and discard the rest.  REQ/REP envelopes are
+//  handled by ZeroMQ, so multi-part messages work unchanged between a Client
+//  and Server.
 //
 
 #pragma once
@@ -44,10 +68,20 @@
 #include <atomic>
 #include <string>
 #include <mutex>
+#include <vector>
 #include "jtil/math/math_types.h"
+#include "jzmq/connection_options.h"
+#include "jzmq/context_options.h"
+#include "jzmq/message.h"
+#include "jzmq/typed_message.h"
 
 namespace jzmq {
 
+  class Codec;
+  class MetricsRecorder;
+  class Transport;
+  struct ConnectionMetrics;
+
   // Pure virtual base class for all our ZMQ classes.
   // Use the child classes to create instances of the JZMQ sockets and call
   // methods in this class to send and receive data.
@@ -60,6 +94,24 @@ namespace jzmq {
       SubscriberType,
     } SocketType;
 
+    // How the per-call timeouts of the send and receive methods are 
+    // implemented:
+    // PollTimeout - zmq_poll is called before every send/receive (default).
+    // SocketTimeout - No poll.  A timeout of 0 maps to ZMQ_DONTWAIT and any 
+    //   other timeout to ZMQ_SNDTIMEO / ZMQ_RCVTIMEO, which are cached and 
+    //   only updated when the timeout changes.  Steady state traffic is one
+    //   ZeroMQ call per message.  Note that sending or receiving out of turn
+    //   on a Client or Server then throws instead of returning 0.
+    typedef enum {
+      PollTimeout,
+      SocketTimeout,
+    } TimeoutMode;
+
+    // Returned by the send and receive methods when the call was interrupted
+    // by a signal before any data was transferred (0 means the timeout
+    // expired).
+    static const int kInterrupted = -1;
+
     // Initialize a Connection instance.  Some examples of conn_str usage:
     // 1. TCP socket at IP:port
     // Connection("tcp://192.168.0.1:5557", ClientType);
@@ -71,47 +123,195 @@ namespace jzmq {
     // Connection("inproc://somename", ServerType);
     // 5. An inter-process comm port
     // Connection("ipc:///tmp_dir/", ServerType);
-    Connection(const std::string& conn_str, const SocketType type);
+    // 6. A shared memory ring (Publisher and Subscriber only, see 
+    //    shm_ring.h)
+    // Connection("shm://somename", PublisherType);
+    // 7. A lock-free in-process queue (see thread_transport.h)
+    // Connection("thread://somename", ServerType);
+    // options are applied by initConn before the bind / connect; invalid 
+    // options throw here rather than from initConn.
+    Connection(const std::string& conn_str, const SocketType type,
+      const ConnectionOptions& options = ConnectionOptions());
 
     // initConn creates the actual connection after a Connection object is made
     virtual void initConn() = 0;
 
-    // All connections must be explicitly killed before calling the destructor
+    // killConn closes the connection (initConn may then be called again).
+    // The child class destructors close it too, so it is only needed to 
+    // close a connection early.
     virtual void killConn() = 0;
-    virtual ~Connection() { }
+    virtual ~Connection();
 
     // receiveData is by default blocking until data is received.  It returns 
     // the length of data received to buff in bytes.  Note that the length can 
     // be greater than the buffer size (in which case the message is truncated 
     // into buff).  For infinite blocking, set timeout=-1 (non-blocking is 0).
+    // Returns 0 on timeout and kInterrupted if a signal interrupted the call.
+    // This is a thin adapter over receiveMessage.
     int receiveData(char* buff, const uint64_t buff_size, 
       const int timout_ms = -1);
 
+    // receiveMessage is by default blocking until a message is received.  The
+    // message is moved into msg (replacing its previous contents) without a
+    // copy and without truncation.  Returns 1 if a message was received and 0
+    // if the timeout expired.  timeout semantics are as for receiveData.
+    int receiveMessage(Message& msg, const int timout_ms = -1);
+
+    // receiveMultipart receives every frame of the next message into parts 
+    // (one Message per frame, nothing is concatenated).  Returns the number of
+    // frames received or 0 if the timeout expired.
+    int receiveMultipart(std::vector<Message>& parts, 
+      const int timout_ms = -1);
+
+    // receiveBatch blocks at most once (up to timout_ms) for the first message
+    // and then drains whatever is already queued without blocking, up to 
+    // max_msgs messages.  Messages are moved into slots[0], slots[1], ... 
+    // (the caller owns the slots and can reuse them as a ring between calls).
+    // Only the first frame of multi-part messages is kept.  A Client or 
+    // Server must alternate receives and sends, so it receives at most one
+    // message per call.  Returns the number of messages received, 0 on 
+    // timeout or kInterrupted.
+    int receiveBatch(Message* slots, const uint32_t max_msgs, 
+      const int timout_ms = -1);
+
     // sendData will queue the contents of buffer in a blocking fashion by 
     // default.  Note: If sucessful, this does not indicate that the data was
     // sent to the network; just that it was sucessfully queued to be sent.
     // Returns number of bytes sent.  If non-blocking and the message cannot
-    // be queued, then sendData will return 0.  For infinite blocking, set 
-    // timeout=-1 (non-blocking is 0).
+    // be queued, then sendData will return 0 (kInterrupted if a signal
+    // interrupted the call).  For infinite blocking, set timeout=-1 
+    // (non-blocking is 0).
     int sendData(char* buff, const uint64_t buff_size, 
       const int timout_ms = -1);
 
+    // Zero-copy version of sendData.  Ownership of buff is handed to ZeroMQ
+    // and the bytes are never copied before they are written out.  When 
+    // ZeroMQ is done with the buffer it calls free_func(buff, hint); for tcp
+    // and ipc this happens on a ZeroMQ I/O thread (for inproc it happens on
+    // the thread that closes the received message), so free_func must be 
+    // thread safe.  If the message cannot be queued (timeout or error) the
+    // buffer is released immediately.  Either way do not touch buff after
+    // calling this function.  Return value is as for sendData above.  To
+    // avoid a malloc / free per message use buffers from a BufferPool with
+    // free_func = BufferPool::recycle and hint = the pool.
+    int sendData(char* buff, const uint64_t buff_size, FreeFunc* free_func, 
+      void* hint, const int timout_ms = -1);
+
+    // sendDataOwned is the zero-copy sendData for buffers allocated with 
+    // new char[].  The buffer is delete[]'d once ZeroMQ is done with it.
+    int sendDataOwned(char* buff, const uint64_t buff_size, 
+      const int timout_ms = -1);
+
+    // sendMessage queues msg (without copying it) and leaves msg empty when
+    // sucessful.  Return value and timeout are as for sendData.
+    int sendMessage(Message& msg, const int timout_ms = -1);
+
+    // sendMultipart queues n_parts buffers as a single multi-part message, one
+    // frame per buffer (ZMQ_SNDMORE on all but the last).  The message is 
+    // atomic: either every frame is queued or none are.  Returns the total
+    // number of bytes queued, or 0 if the timeout expired.
+    int sendMultipart(const DataBuffer* parts, const uint32_t n_parts, 
+      const int timout_ms = -1);
+
+    // Zero-copy version of sendMultipart.  Each Message becomes one frame and
+    // is left empty once the whole message has been queued.
+    int sendMultipart(std::vector<Message>& parts, const int timout_ms = -1);
+
+    // sendBatch waits once (up to timout_ms) for the socket to become 
+    // writable and then queues msgs[0], msgs[1], ... without blocking until
+    // either all n_msgs are queued or the high water mark is reached.  Queued
+    // messages are left empty.  A Client or Server sends at most one message
+    // per call (see receiveBatch).  Returns the number of messages queued, 0
+    // on timeout or kInterrupted.
+    int sendBatch(Message* msgs, const uint32_t n_msgs, 
+      const int timout_ms = -1);
+
+    // send<T> and receive<T> transfer one trivially copyable object as a
+    // typed frame (see typed_message.h), copied directly between the object
+    // and the ZeroMQ message.  Return values and timeouts are as for 
+    // sendMessage and receiveMessage.  receive<T> throws if the frame holds
+    // another type (or another version of T).
+    template <typename T>
+    int send(const T& value, const int timout_ms = -1);
+    template <typename T>
+    int receive(T& value, const int timout_ms = -1);
+
     // The high water mark is a hard limit on the maximum number of outstanding
     // messages zeromq shall queue in memory for any single peer that the 
     // specified socket is communicating with.
-    // Default for both send and receive high water marks are 1000
+    // Default for both send and receive high water marks are 1000.  These
+    // only apply to connections made after the call; prefer 
+    // ConnectionOptions::send_hwm / receive_hwm, which are set before initConn
+    // binds or connects.
     void setSendHighWaterMark(const int n_messages);
     void setReceiveHighWaterMark(const int n_messages);
 
+    // Default is PollTimeout.  See TimeoutMode above.
+    void setTimeoutMode(const TimeoutMode mode);
+
+    // setCodec attaches a codec (see codec.h) to the single frame send and
+    // receive calls (sendData, sendDataOwned, sendMessage, receiveData, 
+    // receiveMessage and the typed calls).  Frames of at least min_size bytes
+    // are encoded when that makes them smaller; every frame gets a header 
+    // flagging whether it is, so both ends must have a codec set (but not
+    // necessarily the same settings).  Multipart and batch calls are not
+    // encoded.  Received frames that would decode to more than max_size 
+    // bytes are rejected (the size comes from the peer) and the receive call
+    // throws.  codec is not owned and must outlive the connection; NULL (the
+    // default) turns it off.
+    void setCodec(Codec* codec, const uint64_t min_size = 4096,
+      const uint64_t max_size = 256 * 1024 * 1024);
+
+    // setMetricsEnabled turns the per-connection counters and latency 
+    // histograms (see metrics.h) on or off.  Default is off, which costs one
+    // branch per call.  metrics() copies a snapshot and may be called from
+    // any thread; it returns false if metrics were never enabled (or are
+    // compiled out with JZMQ_NO_METRICS).
+    void setMetricsEnabled(const bool enabled);
+    bool metrics(ConnectionMetrics& snapshot) const;
+
+    // setAffinity restricts the connection to the I/O threads in 
+    // io_thread_mask (bit i is I/O thread i, see ContextOptions::io_threads).
+    // Must be called before initConn.  Same as ConnectionOptions::affinity.
+    void setAffinity(const uint64_t io_thread_mask);
+
+    const ConnectionOptions& options() const;
+    const std::string& connStr() const;
+
+    // setContextOptions configures the shared context.  It throws if a 
+    // connection is open; a context kept alive from earlier connections is
+    // destroyed so that the next initConn creates one with the new options.
+    // Thread safe.
+    static void setContextOptions(const ContextOptions& options);
+
+    // shutdownContext destroys the shared context (and stops its I/O 
+    // threads) now rather than at process exit.  It throws if a connection
+    // is open.  The next initConn creates a new context.  Thread safe.
+    static void shutdownContext();
+
+    // contextExists is true while the shared context is alive.  Thread safe.
+    static bool contextExists();
+
   protected:
     std::string conn_str_;
     SocketType type_;
     void* socket_;
-    static std::atomic<int64_t> num_open_connections_;
+    Transport* transport_;  // shm:// and thread:// data path (else NULL)
+
+    // Connections are move-only.  The moved-to instance takes over the open
+    // socket (with its context reference), options, codec and metrics and
+    // the moved-from one is left closed: it can only be destroyed or 
+    // assigned to.  Assigning to an open connection closes it first.  Child
+    // classes make these public.  A connection added to a Poller must not 
+    // be moved.
+    Connection(Connection&& other);
+    Connection& operator=(Connection&& other);
 
     // All child classes should create a context through this interface.
     // Threads on the same process can share a context which makes message
     // passing faster.  This provides a seamless mechanism to share contexts.
+    // initContext takes a reference to the context, which killContext 
+    // releases (closeSocket does this once socket_ is closed).
     static void* initContext();  // Thread Safe
     static void killContext();  // Thread safe
 
@@ -119,13 +319,125 @@ namespace jzmq {
     // throw a std::wruntime_error.
     static void throwErrorMessage(const std::string& err_msg);
 
+    // err_msg followed by the current zmq error.  Call it before anything
+    // (eg. zmq_close) can change the error.
+    static std::string errorMessage(const std::string& err_msg);
+
+    // Like throwErrorMessage, but closes socket_ first (releasing the 
+    // context).  For initConn() failures once socket_ has been created.
+    void closeAndThrow(const std::string& err_msg);
+
+    // Applies options_ (which must be set before bind or connect).  Child
+    // classes should call this from initConn() right after creating socket_.
+    void applySocketOptions();
+
+    // For shm:// connections: child classes call this from initConn() once
+    // socket_ is connected to ShmRing::controlAddress (reader), or before
+    // binding it there (writer, so that the control address of a live ring
+    // is never taken over).  Closes socket_ if it throws.
+    void initShm(const std::string& name, const bool writer);
+
+    // For thread:// connections: creates transport_ and returns true, in 
+    // which case initConn() should return straight away (there is no 
+    // socket).  Returns false for every other transport.
+    bool initThreadTransport();
+
+    // Closes socket_ and transport_ and releases the shared context.
+    // Child classes should call this from killConn().
+    void closeSocket();
+
+    // The zmq_msg_t behind a Message, for child classes that drive extra
+    // sockets of their own.
+    static void* zmqMsg(Message& msg);
+
   private:
-    static void* context_;
-    static std::mutex context_lck_;
+    static std::atomic<void*> context_;
+    static std::atomic<int64_t> context_refs_;  // Connections using context_
+    static std::mutex context_lck_;  // Held to create or destroy context_
+    static ContextOptions context_options_;
+    TimeoutMode timeout_mode_;
+    int rcv_timeout_ms_;  // Cached ZMQ_RCVTIMEO (SocketTimeout mode only)
+    int snd_timeout_ms_;  // Cached ZMQ_SNDTIMEO (SocketTimeout mode only)
+    ConnectionOptions options_;
+    Codec* codec_;
+    uint64_t codec_min_size_;
+    uint64_t codec_max_size_;  // Largest decoded frame accepted
+    std::vector<char> codec_buf_;  // Encoder output
+    std::atomic<MetricsRecorder*> metrics_;  // Allocated on first enable
+    bool metrics_enabled_;
+    uint64_t call_start_ns_;  // Start of the current send or receive call
+    std::vector<Message> transport_parts_;  // Reused by the transport_ path
+
+    static void* createContext();  // context_lck_ must be held
+    static void destroyContext();  // context_lck_ must be held
+    static void setContextOption(void* context, const int option, 
+      const int value);
+    static void checkOptions(const ConnectionOptions& options);
+    void setSocketOption(const int option, const int value, 
+      const char* name);
+
+    // Waits (according to timeout_mode_) until events (ZMQ_POLLIN or 
+    // ZMQ_POLLOUT) can be serviced.  Returns 1 if the operation should be 
+    // attempted with flags, 0 on timeout and kInterrupted on a signal.
+    int waitForSocket(const int events, const int timout_ms, int& flags);
+
+    // Maps the errno of a failed send or receive to 0 (EAGAIN, ie. timeout)
+    // or kInterrupted (EINTR).  Any other error throws a std::wruntime_error.
+    int handleSocketError(const std::string& err_msg);
+
+    // True for ZMQ_REQ and ZMQ_REP sockets, which must alternate sends and
+    // receives (so batches are a single message).
+    bool isLockstep() const;
+
+    // Receive and drop the remaining frames of a partially read message.
+    void discardRemainingFrames();
+
+    // Record a successful send or receive call that started in 
+    // waitForSocket.
+    void recordSend(const uint64_t n_msgs, const uint64_t n_bytes);
+    void recordReceive(const uint64_t n_msgs, const uint64_t n_bytes);
+
+    // sendMessage without the codec.
+    int sendFrame(Message& msg, const int timout_ms);
+
+    // The transport_ data path.  Return values are as for sendMultipart and
+    // receiveMultipart.
+    int sendTransport(const DataBuffer* parts, const uint32_t n_parts, 
+      const int timout_ms);
+    int sendTransport(std::vector<Message>& parts, const int timout_ms);
+    int recordTransportSend(const int rc);
+    int receiveTransport(std::vector<Message>& parts, const int timout_ms);
+
+    // Build a codec frame (header + encoded or raw data) and turn one back
+    // into the raw message.
+    void encodeFrame(const char* data, const uint64_t size, Message& frame);
+    void decodeFrame(Message& frame);
+
+    void moveFrom(Connection& other);  // Used by the move operations
+
+    friend class Poller;
 
     // Non-copyable, non-assignable.
     Connection(Connection&);
     Connection& operator=(const Connection&);
   };
 
+  template <typename T>
+  int Connection::send(const T& value, const int timout_ms) {
+    Message msg;
+    encodeTyped(value, msg);
+    return sendMessage(msg, timout_ms);
+  }
+
+  template <typename T>
+  int Connection::receive(T& value, const int timout_ms) {
+    Message msg;
+    int rc = receiveMessage(msg, timout_ms);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    decodeTyped(msg, value);
+    return rc;
+  }
+
 };  // namespace jzmq
@@ -0,0 +1,78 @@
+//
+//  connection_options.h
+//
+//  Per-connection socket options.  They are passed to the constructor of a
+//  Connection, checked there, and applied in initConn() before the socket is
+//  bound or connected (most of them have no effect on connections that
+//  already exist).  Every field defaults to -1, which leaves the ZeroMQ (or
+//  OS) default in place.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include "jtil/math/math_types.h"
+
+namespace jzmq {
+
+  struct ConnectionOptions {
+    // High water marks in messages (ZMQ_SNDHWM / ZMQ_RCVHWM, 0 means no
+    // limit).  ZeroMQ default is 1000.  thread:// connections size their
+    // receive queue from receive_hwm (0 gives the largest queue).
+    int send_hwm;
+    int receive_hwm;
+
+    // Kernel socket buffer sizes in bytes (ZMQ_SNDBUF / ZMQ_RCVBUF).  Raise
+    // them for high bandwidth-delay links.
+    int send_buffer;
+    int receive_buffer;
+
+    // 1 queues messages only to completed connections (ZMQ_IMMEDIATE), so a
+    // peer that is down doesn't absorb messages.  0 or 1.
+    int immediate;
+
+    // How long unsent messages are kept after killConn (ZMQ_LINGER, 0 drops
+    // them).  ZeroMQ default is to wait forever.
+    int linger_ms;
+
+    // TCP keepalive (ZMQ_TCP_KEEPALIVE: 0 off, 1 on) and its idle time,
+    // probe count and probe interval (ZMQ_TCP_KEEPALIVE_IDLE / _CNT / _INTVL,
+    // seconds).
+    int tcp_keepalive;
+    int tcp_keepalive_idle_s;
+    int tcp_keepalive_count;
+    int tcp_keepalive_interval_s;
+
+    // Initial and maximum reconnect interval (ZMQ_RECONNECT_IVL /
+    // ZMQ_RECONNECT_IVL_MAX).  The interval doubles on every failed attempt
+    // up to the maximum.
+    int reconnect_interval_ms;
+    int reconnect_interval_max_ms;
+
+    // Maximum queue of pending connections on a bound socket (ZMQ_BACKLOG).
+    int backlog;
+
+    // 1 keeps only the newest message in the queues (ZMQ_CONFLATE), for 
+    // Subscribers that only care about the latest value.  It applies to the
+    // whole socket (not per topic) and does not support multi-part messages;
+    // see Subscriber::receiveLatest for per topic conflation.  0 or 1.
+    int conflate;
+
+    // I/O threads the connection may use (ZMQ_AFFINITY, bit i is I/O thread
+    // i).  0 (the default) is any I/O thread.
+    uint64_t affinity;
+
+    // Size of the shared memory ring of a shm:// Publisher in MB (a message
+    // may take up to half of it), at most 4096.  Default is 64.
+    int shm_ring_mb;
+
+    ConnectionOptions() : send_hwm(-1), receive_hwm(-1), send_buffer(-1),
+      receive_buffer(-1), immediate(-1), linger_ms(-1), tcp_keepalive(-1),
+      tcp_keepalive_idle_s(-1), tcp_keepalive_count(-1),
+      tcp_keepalive_interval_s(-1), reconnect_interval_ms(-1),
+      reconnect_interval_max_ms(-1), backlog(-1), conflate(-1), 
+      affinity(0), shm_ring_mb(-1) { }
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,54 @@
+//
+//  context_options.h
+//
+//  Process-wide settings for the shared ZeroMQ context.  They only take
+//  effect if they are set (with Connection::setContextOptions) while no
+//  connection is open, since the context owns the I/O threads.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <vector>
+#include "jtil/math/math_types.h"
+
+namespace jzmq {
+
+  struct ContextOptions {
+    // Number of ZeroMQ I/O threads (ZMQ_IO_THREADS).  A rule of thumb is one
+    // I/O thread per gigabit per second of traffic.  -1 is the library
+    // default (1).
+    int io_threads;
+
+    // Maximum number of sockets in the context (ZMQ_MAX_SOCKETS).  -1 is the
+    // library default (1023).
+    int max_sockets;
+
+    // Scheduling policy (eg. SCHED_FIFO) and priority of the I/O threads
+    // (ZMQ_THREAD_SCHED_POLICY / ZMQ_THREAD_PRIORITY).  Only supported on
+    // POSIX and usually needs elevated privileges.  -1 leaves the threads
+    // with the OS defaults.
+    int thread_sched_policy;
+    int thread_priority;
+
+    // CPUs to pin the I/O threads to (ZMQ_THREAD_AFFINITY_CPU_ADD, Linux
+    // only).  That is a draft option: libzmq must be built with, and this
+    // library compiled with, ZMQ_BUILD_DRAFT_API defined, otherwise initConn
+    // throws.  Empty leaves the threads unpinned.
+    std::vector<int> io_thread_cpus;
+
+    // false (the default) destroys the context with the last connection,
+    // which blocks until pending sends are flushed (see linger_ms).  true
+    // keeps the context (and its I/O threads) alive after the last
+    // connection is killed, until Connection::shutdownContext() or process
+    // exit, so that short-lived connections don't pay for a new context
+    // every time.  Call shutdownContext() before exiting if pending sends
+    // must still be delivered.
+    bool keep_alive;
+
+    ContextOptions() : io_threads(-1), max_sockets(-1),
+      thread_sched_policy(-1), thread_priority(-1), keep_alive(false) { }
+  };
+
+};  // namespace jzmq
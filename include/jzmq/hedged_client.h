@@ -0,0 +1,114 @@
+//
+//  hedged_client.h
+//
+//  HedgedClient sends requests to a set of replicated servers and cuts the
+//  tail latency caused by one slow replica.  Each request goes to the
+//  primary replica first; if no reply has arrived after the hedge delay a
+//  duplicate goes to the next best replica, and whichever reply comes first
+//  is returned.  The other copy is cancelled and its late reply dropped.
+//
+//  The latency of every reply is recorded per replica (in a
+//  LatencyHistogram, see metrics.h).  The primary is the replica with the
+//  lowest smoothed latency, and the hedge delay is the hedge_percentile of
+//  the primary's recent latencies, so only the slowest few percent of
+//  requests are duplicated.  A replica that loses a hedge (or times out) is
+//  charged the time it was given, so a slow or dead replica stops being
+//  picked.
+//
+//  Requests must be idempotent since a server may see (and answer) both
+//  copies.  Each replica is an AsyncClient, so HedgedClient is wire
+//  compatible with Server, AsyncServer and ServerPool.  Like the Connections
+//  it is not thread safe.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection_options.h"
+#include "jzmq/message.h"
+#include "jzmq/metrics.h"
+
+namespace jzmq {
+
+  class Poller;
+  struct HedgedReplica;
+
+  struct HedgeOptions {
+    // Hedge once the primary has taken longer than this fraction (0 to 1]
+    // of its recent requests.
+    double hedge_percentile;
+    // The hedge delay until a replica has min_samples replies.
+    int initial_hedge_delay_ms;
+    // Bounds for the percentile-derived hedge delay.
+    int min_hedge_delay_ms;
+    int max_hedge_delay_ms;
+    uint32_t min_samples;
+    // Replies per histogram; the latencies older than two windows are
+    // forgotten so that the delay follows changes in load.
+    uint32_t latency_window;
+    ConnectionOptions connection_options;  // For every replica
+
+    HedgeOptions() : hedge_percentile(0.95), initial_hedge_delay_ms(10),
+      min_hedge_delay_ms(1), max_hedge_delay_ms(1000), min_samples(20),
+      latency_window(1000) { }
+  };
+
+  class HedgedClient {
+  public:
+    // replicas are the conn_strs of the servers (at least one).
+    HedgedClient(const std::vector<std::string>& replicas,
+      const HedgeOptions& options = HedgeOptions());
+    ~HedgedClient();  // Closes the connections if still open
+
+    // initConn connects to every replica (throwing on failure).
+    void initConn();
+    void killConn();
+
+    // request sends the request frames and waits up to timout_ms for the
+    // first reply.  Returns the number of reply frames, 0 on timeout or
+    // Connection::kInterrupted.
+    int request(const DataBuffer* parts, const uint32_t n_parts,
+      std::vector<Message>& reply, const int timout_ms = -1);
+    int request(const char* data, const uint64_t size, Message& reply,
+      const int timout_ms = -1);
+
+    uint32_t numReplicas() const;
+    // The replica the next request goes to first.
+    uint32_t primary() const;
+    // The current hedge delay of a replica.
+    int hedgeDelayMs(const uint32_t replica) const;
+    // The recent reply latencies (in nanoseconds) of a replica.
+    void replicaLatency(const uint32_t replica, HistogramSnapshot& snap) const;
+
+    uint64_t numRequests() const;
+    uint64_t numHedged() const;  // Requests that were sent twice
+    uint64_t numHedgeWins() const;  // Requests answered by the duplicate
+
+  private:
+    HedgeOptions options_;
+    std::vector<HedgedReplica*> replicas_;
+    Poller* poller_;
+    std::vector<Message>* reply_;  // Of the request in progress
+    std::vector<Message> frames_;  // Reused by the single frame request
+    int winner_;  // Replica that answered the request in progress (or -1)
+    uint64_t num_requests_;
+    uint64_t num_hedged_;
+    uint64_t num_hedge_wins_;
+
+    uint32_t pickReplica(const int exclude) const;
+    bool sendTo(const uint32_t replica, const DataBuffer* parts,
+      const uint32_t n_parts);
+    void onReply(const uint32_t replica, std::vector<Message>& frames);
+    void chargeLoser(const uint32_t replica, const uint64_t now_ns);
+    void updateHedgeDelay(HedgedReplica& replica);
+
+    // Non-copyable, non-assignable.
+    HedgedClient(HedgedClient&);
+    HedgedClient& operator=(const HedgedClient&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,66 @@
+//
+//  last_value_publisher.h
+//
+//  LastValuePublisher is a Publisher that keeps the last value published on
+//  every topic.  It uses a ZMQ_XPUB socket (with ZMQ_XPUB_VERBOSE), so it
+//  sees every subscription as it arrives, and immediately re-sends the
+//  cached values of the topics the new subscription matches.  A late joining
+//  Subscriber therefore gets the current state straight away instead of
+//  waiting for the next update of each topic.
+//
+//  The replayed values go out like any other message, so existing
+//  subscribers to the same topics see them again (harmless for last value
+//  consumers).  Subscriptions are handled inside publish() and
+//  processSubscriptions(); call the latter (or add the publisher to a Poller
+//  with ReadEvent) when there is nothing new to publish.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection.h"
+
+namespace jzmq {
+
+  class LastValuePublisher : public Connection {
+  public:
+    LastValuePublisher(const std::string& conn_str,
+      const ConnectionOptions& options = ConnectionOptions());
+    virtual void initConn();
+    virtual void killConn();
+    virtual ~LastValuePublisher();  // Closes the connection if still open
+
+    // publish caches data as the last value of topic and sends [topic][data]
+    // (see Publisher::publish).  Pending subscriptions are processed first.
+    // Return value and timeout are as for sendData.
+    int publish(const std::string& topic, const char* data,
+      const uint64_t size, const int timout_ms = -1);
+
+    // processSubscriptions waits (up to timout_ms, non-blocking by default)
+    // for subscriptions and replays the cached values of every new one.
+    // Returns the number of subscriptions processed.
+    int processSubscriptions(const int timout_ms = 0);
+
+    // Drops the cached value of topic (or all of them), eg. when the state
+    // behind it no longer exists.
+    void clearTopic(const std::string& topic);
+    void clearCache();
+    uint64_t cacheSize() const;
+
+  private:
+    std::map<std::string, std::string> cache_;  // topic -> last value
+    std::string prefix_;  // Reused by processSubscriptions
+
+    // Sends the cached values of the topics starting with prefix_
+    void replayPrefix();
+
+    // Non-copyable, non-assignable.
+    LastValuePublisher(LastValuePublisher&);
+    LastValuePublisher& operator=(const LastValuePublisher&);
+  };
+
+};  // namespace jzmq
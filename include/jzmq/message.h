@@ -0,0 +1,86 @@
+//
+//  message.h
+//
+//  An owned, move-only ZeroMQ message.  Message wraps a zmq_msg_t so that
+//  received data can be handed around without copying it into a caller sized
+//  buffer (and without truncation).  The bytes stay in the buffer ZeroMQ
+//  received them into until the Message is destroyed.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include "jtil/math/math_types.h"
+
+namespace jzmq {
+
+  class Connection;
+
+  // FreeFunc is called by ZeroMQ once it has finished with a zero-copy buffer
+  // (the signature matches zmq_free_fn).
+  typedef void (FreeFunc)(void* data, void* hint);
+
+  // DataBuffer describes one frame of a multipart (scatter-gather) send; it is
+  // the iovec of Connection::sendMultipart().  The data is not owned.
+  struct DataBuffer {
+    const char* data;
+    uint64_t size;
+  };
+
+  class Message {
+  public:
+    // An empty (zero length) message.  Pass it to
+    // Connection::receiveMessage() to fill it.
+    Message();
+
+    // A message with an uninitialized buffer of size bytes allocated by
+    // ZeroMQ.  Fill data() before sending.
+    explicit Message(const uint64_t size);
+
+    // A message holding a copy of data.
+    Message(const char* data, const uint64_t size);
+
+    // A zero-copy message.  Ownership of data passes to the message and
+    // free_func(data, hint) is called once ZeroMQ is done with it (possibly on
+    // a ZeroMQ I/O thread).  If construction fails the buffer is released
+    // before the exception is thrown.
+    Message(char* data, const uint64_t size, FreeFunc* free_func, void* hint);
+
+    // Move only.  The moved-from message is left empty.
+    Message(Message&& other);
+    Message& operator=(Message&& other);
+
+    ~Message();
+
+    // data() is valid until the message is destroyed, moved from or reused.
+    char* data();
+    const char* data() const;
+    uint64_t size() const;
+
+    // more() is true if this frame was received as part of a multipart 
+    // message and more frames follow it.
+    bool more() const;
+
+    // share returns a second message on the same data (zmq_msg_copy):
+    // ZeroMQ reference counts the buffer, so no bytes are copied unless the
+    // message is small enough to be stored inline.  Neither message may be
+    // modified afterwards.
+    Message share();
+
+  private:
+    // Opaque storage for the zmq_msg_t so that zmq.h is not pulled into the
+    // public headers (message.cpp checks that it is large enough).
+    uint64_t msg_[8];
+
+    void* zmqMsg();
+    const void* zmqMsg() const;
+
+    friend class Connection;
+
+    // Non-copyable, non-assignable.
+    Message(Message&);
+    Message& operator=(const Message&);
+  };
+
+};  // namespace jzmq
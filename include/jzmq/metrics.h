@@ -0,0 +1,130 @@
+//
+//  metrics.h
+//
+//  Counters and latency histograms for a Connection.  Metrics are off by
+//  default; Connection::setMetricsEnabled(true) starts recording and
+//  Connection::metrics() takes a snapshot (from any thread, so a monitoring
+//  thread can scrape them periodically).  Define JZMQ_NO_METRICS to compile
+//  the recording out completely.
+//
+//  Recording is done by the thread that owns the connection, so counters are
+//  plain loads and stores on relaxed atomics (no locked instructions); the
+//  atomics only make concurrent snapshots well defined.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "jtil/math/math_types.h"
+
+namespace jzmq {
+
+  // A snapshot of a LatencyHistogram.
+  struct HistogramSnapshot {
+    std::vector<uint64_t> counts;  // Per bucket, see LatencyHistogram
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    HistogramSnapshot() : count(0), sum(0), max(0) { }
+
+    // The value below which fraction p (0 to 1) of the samples fall, to
+    // within the bucket resolution (12.5%).
+    uint64_t percentile(const double p) const;
+    double mean() const;
+
+    // Adds the samples of other (eg. to combine connections).
+    void merge(const HistogramSnapshot& other);
+  };
+
+  // A log-linear (HDR style) histogram: values below 8 get exact buckets,
+  // and every power of two above that is split into 8 linear sub-buckets,
+  // so any uint64_t value is recorded with at most 12.5% error in a fixed
+  // 496 buckets.  record() must only be called from one thread at a time;
+  // snapshot() can be called from any thread.
+  class LatencyHistogram {
+  public:
+    static const uint32_t kSubBucketBits = 3;
+    static const uint32_t kNumBuckets = (64 - kSubBucketBits + 1) <<
+      kSubBucketBits;
+
+    LatencyHistogram();
+
+    void record(const uint64_t value);
+    void snapshot(HistogramSnapshot& snap) const;
+    void reset();
+
+    static uint32_t bucketIndex(const uint64_t value);
+    // The smallest and largest value recorded in bucket index
+    static uint64_t bucketLow(const uint32_t index);
+    static uint64_t bucketHigh(const uint32_t index);
+
+  private:
+    std::atomic<uint64_t> counts_[kNumBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+
+    // Non-copyable, non-assignable.
+    LatencyHistogram(LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+  };
+
+  // A snapshot of the metrics of one Connection.  Latencies are the time
+  // spent in send / receive calls that transferred data, in nanoseconds.
+  struct ConnectionMetrics {
+    uint64_t msgs_sent;
+    uint64_t bytes_sent;
+    uint64_t msgs_received;
+    uint64_t bytes_received;
+    uint64_t poll_timeouts;  // Calls that timed out waiting for the socket
+    uint64_t would_block;  // EAGAIN: HWM reached or nothing to receive
+    uint64_t interrupts;  // EINTR
+    uint64_t truncated_receives;  // receiveData into a too small buffer
+    uint64_t blocked_ns;  // Time spent waiting for the socket
+    HistogramSnapshot send_latency_ns;
+    HistogramSnapshot receive_latency_ns;
+  };
+
+  // The live metrics of a Connection (see Connection::setMetricsEnabled).
+  class MetricsRecorder {
+  public:
+    MetricsRecorder();
+
+    void recordSend(const uint64_t n_msgs, const uint64_t n_bytes,
+      const uint64_t latency_ns);
+    void recordReceive(const uint64_t n_msgs, const uint64_t n_bytes,
+      const uint64_t latency_ns);
+    void recordBlocked(const uint64_t ns, const bool timed_out);
+    void recordWouldBlock();
+    void recordInterrupt();
+    void recordTruncated();
+
+    void snapshot(ConnectionMetrics& metrics) const;
+    void reset();
+
+    // Monotonic clock in nanoseconds.
+    static uint64_t nowNs();
+
+  private:
+    std::atomic<uint64_t> msgs_sent_;
+    std::atomic<uint64_t> bytes_sent_;
+    std::atomic<uint64_t> msgs_received_;
+    std::atomic<uint64_t> bytes_received_;
+    std::atomic<uint64_t> poll_timeouts_;
+    std::atomic<uint64_t> would_block_;
+    std::atomic<uint64_t> interrupts_;
+    std::atomic<uint64_t> truncated_receives_;
+    std::atomic<uint64_t> blocked_ns_;
+    LatencyHistogram send_latency_;
+    LatencyHistogram receive_latency_;
+
+    // Non-copyable, non-assignable.
+    MetricsRecorder(MetricsRecorder&);
+    MetricsRecorder& operator=(const MetricsRecorder&);
+  };
+
+};  // namespace jzmq
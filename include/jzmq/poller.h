@@ -0,0 +1,89 @@
+//
+//  poller.h
+//
+//  Poller is a simple reactor: Connections are registered with read and/or
+//  write interest and a callback, and a single zmq_poll call waits on all of
+//  them and dispatches whatever is ready.  This lets one thread service many
+//  sockets without a thread per socket or a busy loop with timeout 0.
+//
+//  Like the Connections it polls, a Poller should only be used by one thread
+//  (the thread that owns the registered Connections).  Callbacks may add and
+//  remove registrations (including their own) while they are running, but
+//  must not call poll() recursively.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection.h"
+
+namespace jzmq {
+
+  class Poller {
+  public:
+    // Interest / readiness flags (may be or'ed together).
+    typedef enum {
+      ReadEvent = 1,
+      WriteEvent = 2,
+    } Event;
+
+    // Called with the Connection that is ready and the Events it is ready
+    // for.  The callback should do the (non-blocking) send or receive.
+    typedef std::function<void(Connection& conn, const int events)> Callback;
+
+    Poller();
+    ~Poller();
+
+    // add registers an initialized Connection.  The Connection must outlive
+    // its registration.  Throws if conn is already registered.
+    void add(Connection& conn, const int events, const Callback& callback);
+
+    // modify changes the interest events of a registered Connection.
+    void modify(Connection& conn, const int events);
+
+    // remove unregisters conn (does nothing if it was not registered).
+    void remove(Connection& conn);
+
+    // poll waits up to timout_ms (-1 is infinite, 0 is non-blocking) for any
+    // registered Connection to become ready and dispatches the callbacks.
+    // Returns the number of callbacks called, 0 on timeout or
+    // Connection::kInterrupted if a signal interrupted the wait.
+    int poll(const int timout_ms = -1);
+
+    // run calls poll() until stop() is called (usually from a callback).
+    void run();
+    void stop();
+
+    uint32_t size() const;
+
+  private:
+    struct Entry {
+      Connection* conn;
+      int events;
+      Callback callback;
+      bool removed;
+    };
+    // Entries are heap allocated so they stay put while a callback adds new
+    // registrations.  Removed entries are reclaimed after dispatch.
+    std::vector<Entry*> entries_;
+    std::vector<Entry*> polled_;  // The entry behind each poll item
+    void* items_;  // zmq_pollitem_t array, rebuilt when entries_ changes
+    uint32_t items_capacity_;
+    bool items_dirty_;
+    bool dispatching_;
+    bool running_;
+
+    Entry* findEntry(const Connection& conn);
+    void rebuildItems();
+    void reclaimRemovedEntries();
+
+    // Non-copyable, non-assignable.
+    Poller(Poller&);
+    Poller& operator=(const Poller&);
+  };
+
+};  // namespace jzmq
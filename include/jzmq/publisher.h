@@ -19,13 +19,24 @@ namespace jzmq {
   // The Publisher class (to be paired with Subscriber)
   class Publisher : public Connection {
   public:
-    Publisher(const std::string& conn_str);
+    Publisher(const std::string& conn_str, 
+      const ConnectionOptions& options = ConnectionOptions());
     virtual void initConn();
     virtual void killConn();
-    virtual ~Publisher();
+    virtual ~Publisher();  // Closes the connection if still open
+
+    // Move-only (see Connection::Connection(Connection&&)).
+    Publisher(Publisher&& other);
+    Publisher& operator=(Publisher&& other);
+
+    // publish sends [topic][data] as a two frame message.  Subscribers filter
+    // on the topic frame (see Subscriber::subscribe).  Return value and
+    // timeout are as for sendData.
+    int publish(const std::string& topic, const char* data, 
+      const uint64_t size, const int timout_ms = -1);
 
   private:
-    // Non-copyable, non-assignable.
+    // Non-copyable.
     Publisher(Publisher&);
     Publisher& operator=(const Publisher&);
   };
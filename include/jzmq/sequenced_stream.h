@@ -0,0 +1,160 @@
+//
+//  sequenced_stream.h
+//
+//  SequencedPublisher and SequencedSubscriber replicate a topic -> value
+//  state (like LastValuePublisher) reliably on top of PUB/SUB.  A plain
+//  Subscriber that joins late only sees future messages, and can't tell
+//  when ZeroMQ drops messages at the high water mark.
+//
+//  Every update is stamped with a sequence number, and the publisher also
+//  serves snapshots of its state over a request / reply channel:
+//
+//    updates:   [topic][session][sequence][value]      Publisher -> Subscriber
+//    snapshots: ["SNAPSHOT"][prefix]...                Client -> Server
+//               [session][topic][sequence][value]...   Server -> Client
+//
+//  session and sequence are 8 bytes each.  The session is drawn at random
+//  when the publisher is constructed, so a restarted publisher (whose
+//  sequence numbers start again at 1) is told apart from the old one: an
+//  update from a different session makes the subscriber fetch a snapshot.
+//
+//  Sequence numbers count the updates of each topic (starting at 1), so
+//  subscribers that only subscribe to some topics can still see gaps.  On
+//  initConn the subscriber connects to the update stream first and then
+//  fetches a snapshot; updates that arrive meanwhile queue in the socket,
+//  and those already in the snapshot are dropped when they are received.
+//  If an update skips a sequence number the subscriber fetches a new
+//  snapshot and carries on from there.  A lost update is only noticed when
+//  the next update of its topic arrives, so republish rarely changing 
+//  topics now and then if staleness matters.
+//
+//  Snapshot requests are answered inside publish() and processSnapshots();
+//  call the latter when there is nothing new to publish.  Neither class is
+//  thread safe.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/publisher.h"
+#include "jzmq/server.h"
+#include "jzmq/subscriber.h"
+
+namespace jzmq {
+
+  struct SequencedValue {
+    uint64_t sequence;  // Updates of the topic so far
+    std::string value;
+
+    SequencedValue() : sequence(0) { }
+  };
+
+  typedef std::map<std::string, SequencedValue> SequencedState;
+
+  class SequencedPublisher {
+  public:
+    // Updates are published on conn_str and snapshots served on
+    // snapshot_conn_str (both are bound).
+    SequencedPublisher(const std::string& conn_str,
+      const std::string& snapshot_conn_str,
+      const ConnectionOptions& options = ConnectionOptions());
+
+    void initConn();
+    void killConn();
+
+    // publish stores data as the value of topic, then sends the update.
+    // Pending snapshot requests are answered first.  Return value and
+    // timeout are as for Publisher::publish (an update that isn't sent
+    // shows up as a gap at the subscribers).
+    int publish(const std::string& topic, const char* data,
+      const uint64_t size, const int timout_ms = -1);
+
+    // processSnapshots waits (up to timout_ms, non-blocking by default) for
+    // snapshot requests and answers them.  Returns the number answered.
+    int processSnapshots(const int timout_ms = 0);
+
+    const SequencedState& state() const;
+    uint64_t numSnapshotsServed() const;
+    uint64_t session() const;
+
+  private:
+    Publisher publisher_;
+    Server snapshots_;
+    uint64_t session_;
+    SequencedState state_;
+    uint64_t num_snapshots_served_;
+    std::vector<Message> request_;  // Reused by processSnapshots
+    std::vector<DataBuffer> reply_;  // Reused by processSnapshots
+
+    void sendSnapshot();
+
+    // Non-copyable, non-assignable.
+    SequencedPublisher(SequencedPublisher&);
+    SequencedPublisher& operator=(const SequencedPublisher&);
+  };
+
+  class SequencedSubscriber {
+  public:
+    // Returned by receive when state() has been replaced by a new snapshot.
+    static const int kSnapshot = 2;
+
+    // The snapshot is requested from snapshot_conn_str; if no reply arrives
+    // within snapshot_timeout_ms the subscriber is left out of sync and
+    // receive() tries again.
+    SequencedSubscriber(const std::string& conn_str,
+      const std::string& snapshot_conn_str,
+      const int snapshot_timeout_ms = 1000,
+      const ConnectionOptions& options = ConnectionOptions());
+
+    // Must be called before initConn().  Defaults to every topic.
+    void subscribe(const std::string& topic);
+
+    // initConn subscribes and fetches the first snapshot (see synced()).
+    void initConn();
+    void killConn();
+
+    // receive waits up to timout_ms for the next update, applies it to
+    // state() and returns it in topic and value.  Returns 1, kSnapshot after
+    // a gap or a publisher restart (topic and value are not set; read
+    // state() again), 0 on timeout (or while no snapshot can be fetched) or
+    // Connection::kInterrupted.
+    int receive(std::string& topic, std::string& value,
+      const int timout_ms = -1);
+
+    // The values of the subscribed topics (complete while synced()).
+    const SequencedState& state() const;
+    bool synced() const;
+
+    uint64_t numSnapshots() const;  // Snapshots fetched so far
+    uint64_t numGaps() const;  // Gaps detected (each causes a snapshot)
+    uint64_t numRestarts() const;  // Publisher restarts (ditto)
+
+  private:
+    Subscriber subscriber_;
+    Client snapshots_;
+    int snapshot_timeout_ms_;
+    std::vector<std::string> topics_;
+    uint64_t session_;  // Of the publisher that sent state_
+    SequencedState state_;
+    bool synced_;
+    uint64_t num_snapshots_;
+    uint64_t num_gaps_;
+    uint64_t num_restarts_;
+    std::vector<Message> frames_;  // Reused receive buffer
+    std::string topic_;  // Reused by receive
+
+    // Replaces state_ with a snapshot.  Returns false on timeout.
+    bool fetchSnapshot();
+
+    // Non-copyable, non-assignable.
+    SequencedSubscriber(SequencedSubscriber&);
+    SequencedSubscriber& operator=(const SequencedSubscriber&);
+  };
+
+};  // namespace jzmq
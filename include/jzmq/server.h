@@ -21,16 +21,22 @@ namespace jzmq {
   // of 1. recieveData() --> 2. sendData().  If you try and send data in any
   // other order an exception will be thrown.  ZeroMQ does have a mechanism
   // for arbitrary message patterns, however sticking to this one is very
-  // robust.
+  // robust.  A multi-part request counts as a single receive (read it with
+  // receiveMultipart) and the reply may be multi-part too.
   class Server : public Connection {
   public:
-    Server(const std::string& conn_str);
+    Server(const std::string& conn_str, 
+      const ConnectionOptions& options = ConnectionOptions());
     virtual void initConn();
     virtual void killConn();
-    virtual ~Server();
+    virtual ~Server();  // Closes the connection if still open
+
+    // Move-only (see Connection::Connection(Connection&&)).
+    Server(Server&& other);
+    Server& operator=(Server&& other);
 
   private:
-    // Non-copyable, non-assignable.
+    // Non-copyable.
     Server(Server&);
     Server& operator=(const Server&);
   };
@@ -0,0 +1,83 @@
+//
+//  server_pool.h
+//
+//  ServerPool serves one public endpoint with a pool of worker threads so
+//  that request handlers can use more than one core.  A broker thread binds
+//  the endpoint with a ZMQ_ROUTER socket (an AsyncServer) and load balances
+//  requests to the workers over inproc using least-recently-used dispatch:
+//  a request always goes to the worker that has been idle the longest, and
+//  workers only get a new request once they have replied to the last one.
+//
+//  Workers are ordinary Clients (ZMQ_REQ) on the shared context from
+//  Connection::initContext(), so the inproc handoff does not copy message
+//  bodies.  ServerPool is wire compatible with Client and AsyncClient.
+//
+//  The handler is called concurrently from the worker threads and must be
+//  thread safe.  stop() drains gracefully: no new requests are accepted, the
+//  requests already dispatched are answered, and then the threads exit.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/message.h"
+
+namespace jzmq {
+
+  class AsyncServer;
+
+  class ServerPool {
+  public:
+    // Fill reply with the response frames for request (the frames of both
+    // may be moved from or reused).
+    typedef std::function<void(std::vector<Message>& request,
+      std::vector<Message>& reply)> Handler;
+
+    ServerPool(const std::string& conn_str, const uint32_t num_workers,
+      const Handler& handler);
+    ~ServerPool();  // Calls stop() if the pool is still running
+
+    // start binds the public endpoint (throwing on failure) and spawns the
+    // broker and worker threads.
+    void start();
+
+    // stop stops accepting requests, waits for the requests in progress to be
+    // answered, then shuts down and joins all threads.  If a worker thread
+    // died on an error, the wait for its requests is bounded.
+    void stop();
+
+    bool running() const;
+    uint64_t numRequestsServed() const;
+
+  private:
+    std::string conn_str_;
+    std::string backend_conn_str_;
+    uint32_t num_workers_;
+    Handler handler_;
+    std::thread broker_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
+    std::atomic<bool> broker_running_;
+    std::atomic<uint32_t> num_failed_workers_;  // Exited on an error
+    std::atomic<uint64_t> num_requests_served_;
+    AsyncServer* frontend_;  // Public ROUTER, used by the broker thread
+    AsyncServer* backend_;  // inproc ROUTER the workers connect to
+    static std::atomic<uint64_t> num_instances_;
+
+    void brokerThread();
+    void workerThread();
+
+    // Non-copyable, non-assignable.
+    ServerPool(ServerPool&);
+    ServerPool& operator=(const ServerPool&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,166 @@
+//
+//  shared_connection.h
+//
+//  SharedPublisher and SharedClient are thread safe front ends to a single
+//  Publisher or Client endpoint.  Connections may only be used by one
+//  thread, so without them producer threads either share one Publisher
+//  behind a mutex or each open a connection of their own.
+//
+//  Each calling thread lazily gets a socket of its own (kept in a
+//  thread_local cache) that is connected over inproc to a proxy thread, and
+//  the proxy thread forwards everything through the one public socket:
+//
+//    SharedPublisher: thread ZMQ_PUSH -> ZMQ_PULL [proxy] -> Publisher
+//    SharedClient:    thread ZMQ_REQ -> ZMQ_ROUTER [proxy] ZMQ_DEALER ->
+//                     Server (or AsyncServer / ServerPool)
+//
+//  So the hot path takes no lock and inproc hands the message frames to the
+//  proxy without copying them.  A thread's socket is closed when the thread
+//  exits (or by stop(), whichever comes first).  Messages from one thread
+//  are published in order; messages from different threads interleave.
+//
+//  start() and stop() are not thread safe: call stop() only once the other
+//  threads have finished sending.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection_options.h"
+#include "jzmq/message.h"
+
+namespace jzmq {
+
+  class Connection;
+  class Publisher;
+  struct SharedSlot;
+
+  // The per-thread sockets of one front end.
+  class SharedSockets {
+  public:
+    SharedSockets();
+    ~SharedSockets();  // Calls closeAll()
+
+    // The calling thread's socket (NULL if it has none yet).
+    Connection* find() const;
+    // Registers conn (initialized) as the calling thread's socket.
+    void add(Connection* conn);
+    // Closes the calling thread's socket, eg. after a failed request.
+    void close();
+    // Closes every thread's socket.  No other thread may be using them.
+    void closeAll();
+
+  private:
+    uint64_t id_;  // Key of the thread_local caches
+    std::mutex lck_;
+    std::vector<std::shared_ptr<SharedSlot> > slots_;
+    static std::atomic<uint64_t> num_instances_;
+
+    // Non-copyable, non-assignable.
+    SharedSockets(SharedSockets&);
+    SharedSockets& operator=(const SharedSockets&);
+  };
+
+  class SharedPublisher {
+  public:
+    // conn_str and options are those of the public Publisher.
+    SharedPublisher(const std::string& conn_str,
+      const ConnectionOptions& options = ConnectionOptions());
+    ~SharedPublisher();  // Calls stop() if still running
+
+    // start binds the Publisher (throwing on failure) and starts the proxy.
+    void start();
+
+    // stop publishes whatever the threads have already sent, then closes
+    // all the sockets and joins the proxy thread.
+    void stop();
+
+    // Thread safe.  Return values and timeouts are as for the Publisher
+    // methods of the same name; a message counts as sent once the proxy
+    // has it.
+    int sendData(const char* buff, const uint64_t size,
+      const int timout_ms = -1);
+    int sendMultipart(const DataBuffer* parts, const uint32_t n_parts,
+      const int timout_ms = -1);
+    int sendMultipart(std::vector<Message>& parts, const int timout_ms = -1);
+    int publish(const std::string& topic, const char* data,
+      const uint64_t size, const int timout_ms = -1);
+
+    bool running() const;
+
+  private:
+    std::string conn_str_;
+    std::string backend_conn_str_;
+    ConnectionOptions options_;
+    Publisher* publisher_;  // Used by the proxy thread
+    Connection* backend_;  // inproc ZMQ_PULL the thread sockets connect to
+    SharedSockets sockets_;
+    std::thread proxy_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
+    static std::atomic<uint64_t> num_instances_;
+
+    Connection& threadSocket();
+    void proxyThread();
+
+    // Non-copyable, non-assignable.
+    SharedPublisher(SharedPublisher&);
+    SharedPublisher& operator=(const SharedPublisher&);
+  };
+
+  class SharedClient {
+  public:
+    // conn_str and options are those of the public ZMQ_DEALER socket (wire
+    // compatible with a Client).
+    SharedClient(const std::string& conn_str,
+      const ConnectionOptions& options = ConnectionOptions());
+    ~SharedClient();  // Calls stop() if still running
+
+    // start connects to the server (throwing on failure) and starts the
+    // proxy.
+    void start();
+
+    // stop closes all the sockets and joins the proxy thread.  Requests in
+    // progress are abandoned.
+    void stop();
+
+    // Thread safe.  request sends the request frames and waits up to
+    // timout_ms for the reply frames.  Returns the number of reply frames,
+    // or 0 on timeout (the calling thread's socket is then replaced so that
+    // a late reply can't be taken for the answer to the next request).
+    int request(const DataBuffer* parts, const uint32_t n_parts,
+      std::vector<Message>& reply, const int timout_ms = -1);
+    int request(const char* data, const uint64_t size, Message& reply,
+      const int timout_ms = -1);
+
+    bool running() const;
+
+  private:
+    std::string conn_str_;
+    std::string backend_conn_str_;
+    ConnectionOptions options_;
+    Connection* frontend_;  // Public ZMQ_DEALER, used by the proxy thread
+    Connection* backend_;  // inproc ZMQ_ROUTER the thread sockets connect to
+    SharedSockets sockets_;
+    std::thread proxy_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
+    static std::atomic<uint64_t> num_instances_;
+
+    Connection& threadSocket();
+    void proxyThread();
+
+    // Non-copyable, non-assignable.
+    SharedClient(SharedClient&);
+    SharedClient& operator=(const SharedClient&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,184 @@
+//
+//  shm_ring.h
+//
+//  The shm:// transport: a Publisher / Subscriber pair on the same host that
+//  moves message data through a memory-mapped ring instead of a socket.  The
+//  publisher copies each frame into the ring once and every subscriber reads
+//  it in place; a received Message points straight into the ring and its
+//  space is handed back to the publisher when the Message is destroyed.
+//  Compared to ipc:// that saves both kernel copies of every frame.
+//
+//  Select it with the connection string, eg:
+//
+//    Publisher pub("shm://frames");
+//    Subscriber sub("shm://frames");
+//
+//  The ring is a POSIX shared memory segment (/jzmq_<name>) with one writer
+//  (the Publisher) and up to kMaxReaders readers, each with its own read
+//  cursor.  Unlike ZeroMQ PUB sockets the publisher never drops messages:
+//  once the ring is full a send blocks (up to its timeout) until the slowest
+//  subscriber releases some space, so hold on to received messages only as
+//  long as necessary.  Waiting is done with futexes on Linux (other POSIX
+//  systems fall back to sleeping) and costs no system call while data is
+//  flowing.  Topic filtering is done by each subscriber.
+//
+//  ZeroMQ still carries the control traffic: the Publisher binds a PUB
+//  socket at ipc:///tmp/jzmq_shm_<name> and announces every new ring on it,
+//  so subscribers can be started first and follow a restarted publisher.
+//
+//  shm:// is not available on Windows.  Only the single message send and
+//  receive calls (including multi-part) are supported; the batch calls
+//  throw, and shm:// connections can't be added to a Poller.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/message.h"
+#include "jzmq/transport.h"
+
+namespace jzmq {
+
+  struct ShmRingHeader;
+  struct ShmRecord;
+
+  // One mapping of a ring segment, as the writer or as one of the readers.
+  // The object is reference counted: every received frame keeps it (and the
+  // mapping) alive until the frame is released, so messages stay valid after
+  // the connection is closed.
+  class ShmRing {
+  public:
+    typedef enum {
+      Writer,
+      Reader,
+    } Role;
+
+    static const uint64_t kDefaultSize = 64 * 1024 * 1024;
+    static const uint32_t kMaxReaders = 64;
+    // Received but not yet released messages per reader.
+    static const uint32_t kMaxPending = 4096;
+    // Returned by read when the writer closed the ring (or died).
+    static const int kClosed = -1;
+
+    // Creates the ring for shm://name as its writer, with room for size
+    // bytes of data.  A stale segment of the same name is replaced; throws if
+    // its writer is still alive and hasn't closed it.
+    ShmRing(const std::string& name, const uint64_t size = kDefaultSize);
+
+    // Attaches to the ring for shm://name as a reader.  Returns NULL if there
+    // is no live ring yet (not created, closed or its writer died).
+    static ShmRing* attach(const std::string& name);
+
+    // write copies the frames into the ring as one message, waiting up to
+    // timout_ms for space.  Returns the number of bytes written or 0 on
+    // timeout.  Throws if the message can never fit (more than half the
+    // ring, or more than INT_MAX bytes).
+    int write(const DataBuffer* parts, const uint32_t n_parts,
+      const int timout_ms);
+
+    // read waits up to timout_ms for the next message whose first frame
+    // starts with one of topics (all messages if topics holds "", none if
+    // it is empty), and moves its frames into parts.  Returns the number of
+    // frames, 0 on timeout or kClosed.
+    int read(std::vector<Message>& parts,
+      const std::vector<std::string>& topics, const int timout_ms);
+
+    // close marks the ring closed (writer) and drops the caller's reference.
+    // Do not use the pointer afterwards.
+    void close();
+
+    uint64_t generation() const;
+    uint64_t capacity() const;
+
+    // The shm:// name of a connection string ("" if it is not shm://) and
+    // the ipc:// address of its control socket.
+    static std::string shmName(const std::string& conn_str);
+    static std::string controlAddress(const std::string& name);
+
+  private:
+    class Pending;
+
+    std::string path_;  // Segment name for shm_open
+    Role role_;
+    ShmRingHeader* header_;
+    char* data_;
+    uint64_t map_size_;
+    uint64_t capacity_;
+    std::atomic<int64_t> refs_;
+
+    // Writer
+    uint64_t head_;  // Local copy of header_->head
+    uint64_t space_limit_;  // Writes below this position can't lap a reader
+    uint64_t msg_seq_;
+
+    // Reader
+    uint32_t slot_;
+    uint64_t pos_;  // Next record to read
+    bool started_;  // pending_ is indexed from the first message read
+    std::atomic<uint64_t> read_seq_;  // Sequence number of the next message
+    std::atomic<uint64_t> retire_seq_;  // Oldest message not yet released
+    Pending* pending_;
+    std::mutex retire_lck_;
+
+    ShmRing();
+    ~ShmRing();
+    void init(const std::string& name, const Role role);
+    void map(const int fd, const uint64_t size);
+    void unref();
+
+    uint64_t minReaderTail(const bool reap_dead_readers);
+    bool waitForSpace(const uint64_t end, const int timout_ms);
+    bool matches(const ShmRecord* record,
+      const std::vector<std::string>& topics) const;
+    void retire();
+    static void releaseFrame(void* data, void* hint);
+
+    // Non-copyable, non-assignable.
+    ShmRing(ShmRing&);
+    ShmRing& operator=(const ShmRing&);
+  };
+
+  // The shm:// side of a Publisher or Subscriber: the current ring plus the
+  // ZeroMQ control socket (owned by the Connection) used to announce and
+  // discover rings.
+  class ShmChannel : public Transport {
+  public:
+    // control is the connection's bound PUB (writer) or connected SUB
+    // (reader) socket.
+    ShmChannel(const std::string& name, const ShmRing::Role role,
+      void* control, const uint64_t size);
+    ~ShmChannel();  // Closes the ring
+
+    int send(const DataBuffer* parts, const uint32_t n_parts,
+      const int timout_ms);
+    int send(std::vector<Message>& parts, const int timout_ms);
+    int receive(std::vector<Message>& parts, const int timout_ms);
+
+    void setTopics(const std::vector<std::string>& topics);
+
+  private:
+    std::string name_;
+    ShmRing::Role role_;
+    void* control_;
+    ShmRing* ring_;
+    std::vector<std::string> topics_;
+    std::vector<DataBuffer> buffers_;  // Reused by the Message send
+
+    void announce(const uint64_t generation);
+    // Drains the control socket, waiting up to timout_ms for the first
+    // announcement.  Returns true if a ring other than ring_ was announced.
+    bool pollControl(const int timout_ms);
+    void reattach();
+
+    // Non-copyable, non-assignable.
+    ShmChannel(ShmChannel&);
+    ShmChannel& operator=(const ShmChannel&);
+  };
+
+};  // namespace jzmq
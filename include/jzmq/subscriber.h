@@ -9,6 +9,7 @@
 #pragma once
 
 #include <atomic>
+#include <map>
 #include <string>
 #include <mutex>
 #include "jtil/math/math_types.h"
@@ -17,15 +18,56 @@
 namespace jzmq {
 
   // The Subscriber class (to be paired with Publisher)
+  // Messages are filtered by topic: a message is delivered if its first frame
+  // starts with one of the subscribed topics.  The filtering is done by 
+  // ZeroMQ (on the publisher side for tcp and ipc), so unwanted messages are
+  // never copied to this process (shm:// subscribers filter the shared ring
+  // themselves).  If no topic has been subscribed by the time initConn() is
+  // called, the Subscriber subscribes to everything until the first topic is
+  // subscribed (this default subscription is not listed by topics()).
+  // Subscribers to state broadcasts that only need the newest value of each
+  // topic should use receiveLatest, which conflates the queue per topic
+  // (ConnectionOptions::conflate keeps only the newest message of the whole
+  // socket).
   class Subscriber : public Connection {
   public:
-    Subscriber(const std::string& conn_str);
+    Subscriber(const std::string& conn_str, 
+      const ConnectionOptions& options = ConnectionOptions());
     virtual void initConn();
     virtual void killConn();
-    virtual ~Subscriber();
+    virtual ~Subscriber();  // Closes the connection if still open
+
+    // Move-only (see Connection::Connection(Connection&&)).
+    Subscriber(Subscriber&& other);
+    Subscriber& operator=(Subscriber&& other);
+
+    // subscribe and unsubscribe add and remove a topic prefix.  They can be
+    // called before initConn() or at any time after it.  Subscriptions are
+    // counted: a topic subscribed twice needs two unsubscribes.
+    void subscribe(const std::string& topic);
+    void unsubscribe(const std::string& topic);
+
+    const std::vector<std::string>& topics() const;
+
+    // receiveLatest waits (up to timout_ms) for a message and then drains
+    // everything already queued without blocking, keeping only the newest
+    // message of each topic: latest[topic] is replaced by its frames (frames[0]
+    // is the topic, see Publisher::publish).  Topics that were not received
+    // are left as they are, so clear latest first to only see the updates.
+    // Returns the number of messages received (including the superseded 
+    // ones), 0 on timeout or kInterrupted.
+    int receiveLatest(std::map<std::string, std::vector<Message> >& latest,
+      const int timout_ms = -1);
 
   private:
-    // Non-copyable, non-assignable.
+    std::vector<std::string> topics_;
+    bool default_subscription_;  // Subscribed to "" because topics_ was empty
+    std::vector<Message> frames_;  // Reused by receiveLatest
+    std::string topic_;  // Reused by receiveLatest
+
+    void setSubscription(const int option, const std::string& topic);
+
+    // Non-copyable.
     Subscriber(Subscriber&);
     Subscriber& operator=(const Subscriber&);
   };
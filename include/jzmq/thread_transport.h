@@ -0,0 +1,100 @@
+//
+//  thread_transport.h
+//
+//  The thread:// transport: Publisher / Subscriber and Client / Server
+//  between threads of one process without going through ZeroMQ at all.
+//  inproc:// still costs a trip through ZeroMQ's pipes, mailboxes and
+//  signalers per message; thread:// hands each message over as a pointer
+//  through a bounded lock-free queue (bounded_queue.h), so the frames are
+//  never copied and an uncontended send or receive takes no lock.  Select it
+//  with the connection string, eg:
+//
+//    Server server("thread://rpc");
+//    Client client("thread://rpc");
+//
+//  Every receiving connection owns a queue (Subscribers, the Server, and
+//  each Client for its replies) sized by ConnectionOptions::receive_hwm.  A
+//  receive spins on an empty queue for a while (adapting the spin to how
+//  often it pays off), then yields and finally blocks on a condition
+//  variable, so idle connections don't burn a core.  The semantics follow
+//  the ZeroMQ sockets they replace:
+//
+//  - A Publisher never blocks: a message for a Subscriber whose queue is
+//    full is dropped for that Subscriber, as are messages published before
+//    a Subscriber is created.  Subscribers filter topics themselves.  With
+//    several Subscribers the frames are shared (Message::share), not copied.
+//  - A Client and a Server alternate strictly between send and receive; a
+//    call out of turn returns 0.  Clients can connect before the Server
+//    binds (their requests queue); binding a name twice throws.  The
+//    Server's queue is created by whichever comes first, so if a Client
+//    does it has the default size and the Server's receive_hwm is ignored.
+//    Bind the Server first when its queue size matters.
+//
+//  Only connections in the same process can talk over thread://.  Only the
+//  single message send and receive calls (including multi-part) are
+//  supported; the batch calls throw, and thread:// connections can't be
+//  added to a Poller.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/connection.h"
+#include "jzmq/message.h"
+#include "jzmq/transport.h"
+
+namespace jzmq {
+
+  class ThreadInbox;
+  struct ThreadHub;
+
+  class ThreadTransport : public Transport {
+  public:
+    // receive_hwm is the capacity of this end's receive queue in messages
+    // (-1 for the ZeroMQ default of 1000, 0 for the largest queue).  Throws
+    // if type is ServerType and name is already bound.
+    ThreadTransport(const std::string& name,
+      const Connection::SocketType type, const int receive_hwm);
+    ~ThreadTransport();
+
+    int send(const DataBuffer* parts, const uint32_t n_parts,
+      const int timout_ms);
+    int send(std::vector<Message>& parts, const int timout_ms);
+    int receive(std::vector<Message>& parts, const int timout_ms);
+
+    void setTopics(const std::vector<std::string>& topics);
+
+    // The thread:// name of a connection string ("" if it is not thread://).
+    static std::string threadName(const std::string& conn_str);
+
+  private:
+    Connection::SocketType type_;
+    std::shared_ptr<ThreadHub> hub_;
+    std::shared_ptr<ThreadInbox> inbox_;  // Our receive queue
+    std::vector<std::string> topics_;
+
+    // Client: the Server's queue.  Server: the queue of the Client whose
+    // request is being served (NULL when no reply is due).
+    std::shared_ptr<ThreadInbox> peer_;
+    bool awaiting_reply_;  // Client
+
+    // Publisher: cached copy of the hub's subscriber list
+    std::vector<std::shared_ptr<ThreadInbox> > subscribers_;
+    uint64_t subscribers_version_;
+    std::vector<Message> copy_parts_;  // Reused by the DataBuffer send
+
+    void refreshSubscribers();
+    int publish(std::vector<Message>& parts);
+    bool matches(const Message& topic) const;
+
+    // Non-copyable, non-assignable.
+    ThreadTransport(ThreadTransport&);
+    ThreadTransport& operator=(const ThreadTransport&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,79 @@
+//
+//  topic_dispatcher.h
+//
+//  TopicDispatcher routes the messages received by a Subscriber to per-topic
+//  handlers.  Registering a handler also subscribes the Subscriber to the
+//  topic, so ZeroMQ does the filtering and only wanted messages arrive.  The
+//  handlers are kept in a prefix trie keyed on the topic (the first frame of
+//  the message, see Publisher::publish), and a message is passed to the
+//  handler of every registered topic that is a prefix of its topic, shortest
+//  first, in a single walk of the topic bytes.
+//
+//  Handlers can be registered before or after Subscriber::initConn(): the
+//  first one replaces the Subscriber's default subscribe-to-everything
+//  filter either way (see Subscriber::subscribe).  Messages already queued
+//  under the old filter, or matching a topic subscribed to directly on the
+//  Subscriber, are dropped if nobody handles them.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/subscriber.h"
+
+namespace jzmq {
+
+  class TopicDispatcher {
+  public:
+    // frames[0] is the topic frame and frames[1...] the payload (for a
+    // single frame message frames[0] is the whole message).  If topics
+    // overlap, several handlers see the same frames, so only move payload
+    // frames out when no longer topic can match, and never move frames[0].
+    // Handlers must not add or remove handlers.
+    typedef std::function<void(std::vector<Message>& frames)> Handler;
+
+    TopicDispatcher(Subscriber& subscriber);
+    ~TopicDispatcher();
+
+    // addHandler subscribes to topic and routes its messages to handler
+    // (replacing any existing handler for exactly this topic).
+    void addHandler(const std::string& topic, const Handler& handler);
+
+    // removeHandler unsubscribes from topic and drops its handler.
+    void removeHandler(const std::string& topic);
+
+    // dispatch waits at most once (up to timout_ms) for a message, then
+    // dispatches it and every other message already queued.  Returns the
+    // number of messages received, 0 on timeout or Connection::kInterrupted.
+    int dispatch(const int timout_ms = -1);
+
+    // dispatchMessage routes an already received message (eg. from a Poller
+    // callback).  Returns the number of handlers called.
+    int dispatchMessage(std::vector<Message>& frames);
+
+  private:
+    struct TrieNode {
+      std::map<uint8_t, TrieNode*> children;
+      Handler handler;
+      bool has_handler;
+      TrieNode() : has_handler(false) { }
+    };
+
+    Subscriber& subscriber_;
+    TrieNode root_;
+    std::vector<Message> frames_;  // Reused receive buffer
+
+    static void deleteChildren(TrieNode* node);
+
+    // Non-copyable, non-assignable.
+    TopicDispatcher(TopicDispatcher&);
+    TopicDispatcher& operator=(const TopicDispatcher&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,42 @@
+//
+//  transport.h
+//
+//  Transport is the data path of connections that don't move their messages
+//  through a ZeroMQ socket: shm:// (shm_ring.h) and thread://
+//  (thread_transport.h).  A Connection with a transport forwards its single
+//  message and multi-part send and receive calls to it; the rest of the API
+//  (timeouts, codec, metrics) works unchanged.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/message.h"
+
+namespace jzmq {
+
+  class Transport {
+  public:
+    virtual ~Transport() { }
+
+    // send queues one message made of n_parts frames (copied) or of parts
+    // (moved, and left empty once queued).  Returns the number of bytes
+    // queued or 0 on timeout.
+    virtual int send(const DataBuffer* parts, const uint32_t n_parts,
+      const int timout_ms) = 0;
+    virtual int send(std::vector<Message>& parts, const int timout_ms) = 0;
+
+    // receive moves the frames of the next message into parts.  Returns the
+    // number of frames or 0 on timeout.
+    virtual int receive(std::vector<Message>& parts, const int timout_ms) = 0;
+
+    // Subscriber topic prefixes (see Subscriber::subscribe).  Transports
+    // that don't filter ignore them.
+    virtual void setTopics(const std::vector<std::string>&) { }
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,86 @@
+//
+//  typed_channel.h
+//
+//  TypedPublisher<T> and TypedSubscriber<T> are a Publisher and Subscriber
+//  that carry a single trivially copyable type T.  Messages are
+//  [topic][typed frame] (see Publisher::publish and typed_message.h), so
+//  topic filtering works as usual and a mismatched T on either side is
+//  caught by the schema hash.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/publisher.h"
+#include "jzmq/subscriber.h"
+#include "jzmq/typed_message.h"
+
+namespace jzmq {
+
+  template <typename T>
+  class TypedPublisher : public Publisher {
+  public:
+    TypedPublisher(const std::string& conn_str,
+      const ConnectionOptions& options = ConnectionOptions()) :
+      Publisher(conn_str, options) { }
+
+    // publish sends value on topic.  Return value and timeout are as for
+    // sendData.
+    int publish(const std::string& topic, const T& value,
+      const int timout_ms = -1) {
+      frames_.resize(2);
+      frames_[0] = Message(topic.data(), topic.size());
+      encodeTyped(value, frames_[1]);
+      return sendMultipart(frames_, timout_ms);
+    }
+
+  private:
+    std::vector<Message> frames_;  // Reused so steady state doesn't allocate
+
+    // Non-copyable, non-assignable.
+    TypedPublisher(TypedPublisher&);
+    TypedPublisher& operator=(const TypedPublisher&);
+  };
+
+  template <typename T>
+  class TypedSubscriber : public Subscriber {
+  public:
+    TypedSubscriber(const std::string& conn_str,
+      const ConnectionOptions& options = ConnectionOptions()) :
+      Subscriber(conn_str, options) { }
+
+    // receive copies the next value into value (and its topic into topic if
+    // it isn't NULL).  Returns 1 if a value was received, 0 on timeout or
+    // kInterrupted.  Throws if the message wasn't sent by a TypedPublisher<T>.
+    // The timeout comes second, as in Connection::receive, so that
+    // receive(value, timout_ms) means the same thing on both classes.
+    int receive(T& value, const int timout_ms = -1,
+      std::string* topic = NULL) {
+      int rc = receiveMultipart(frames_, timout_ms);
+      if (rc <= 0) {
+        return rc;  // Timeout or interrupt
+      }
+      if (frames_.size() != 2) {
+        throw std::wruntime_error("TypedSubscriber::receive() - ERROR: "
+          "expected a [topic][value] message.");
+      }
+      decodeTyped(frames_[1], value);
+      if (topic != NULL) {
+        topic->assign(frames_[0].data(), (size_t)frames_[0].size());
+      }
+      return 1;
+    }
+
+  private:
+    std::vector<Message> frames_;  // Reused so steady state doesn't allocate
+
+    // Non-copyable, non-assignable.
+    TypedSubscriber(TypedSubscriber&);
+    TypedSubscriber& operator=(const TypedSubscriber&);
+  };
+
+};  // namespace jzmq
@@ -0,0 +1,118 @@
+//
+//  typed_message.h
+//
+//  Encoding of fixed size, trivially copyable types as ZeroMQ frames (used by
+//  Connection::send<T> / receive<T> and the typed channels in
+//  typed_channel.h).  A typed frame is an 8 byte TypedHeader followed by the
+//  raw bytes of the object, which are copied straight from the object into
+//  the ZeroMQ message (and back) with no staging buffer.
+//
+//  The header carries a schema hash of the type name, version and size, so a
+//  peer built against a different layout is rejected instead of reading
+//  garbage.  Register a type (at global scope) to give it a name and version:
+//
+//    JZMQ_MESSAGE_SCHEMA(Pose, 2)
+//
+//  Unregistered types only hash their size.  The bytes are sent as they are
+//  in memory, so both ends must share the endianness and struct packing.
+//
+//  Please see jzmq_connection.h for API documentation.
+//
+
+#pragma once
+
+#include <string.h>
+#include <type_traits>
+#include "jtil/math/math_types.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jzmq/message.h"
+
+namespace jzmq {
+
+  // Specialized by JZMQ_MESSAGE_SCHEMA.
+  template <typename T>
+  struct MessageSchema {
+    static const char* name() { return ""; }
+    static uint32_t version() { return 0; }
+  };
+
+  struct TypedHeader {
+    uint32_t schema_hash;
+    uint32_t size;
+  };
+
+  // FNV-1a over the schema name, version and size of T.  Computed once per
+  // type at static initialization time (so don't send typed messages from
+  // the constructors of other statics).
+  template <typename T>
+  struct TypedSchema {
+    static const uint32_t hash;
+
+    static uint32_t computeHash() {
+      uint32_t h = 2166136261u;
+      const char* name = MessageSchema<T>::name();
+      for (const char* c = name; *c != '\0'; c++) {
+        h = (h ^ (uint8_t)*c) * 16777619u;
+      }
+      const uint32_t words[2] = {MessageSchema<T>::version(),
+        (uint32_t)sizeof(T)};
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(words);
+      for (uint32_t i = 0; i < sizeof(words); i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+      }
+      return h;
+    }
+  };
+
+  template <typename T>
+  const uint32_t TypedSchema<T>::hash = TypedSchema<T>::computeHash();
+
+  // Size of the typed frame holding a T.
+  template <typename T>
+  struct TypedFrameSize {
+    static const uint64_t value = sizeof(TypedHeader) + sizeof(T);
+  };
+
+  // encodeTyped makes msg a typed frame holding a copy of value.
+  template <typename T>
+  void encodeTyped(const T& value, Message& msg) {
+    static_assert(std::is_trivially_copyable<T>::value,
+      "typed messages must be trivially copyable");
+    static_assert(sizeof(TypedHeader) == 8, "unexpected TypedHeader padding");
+    msg = Message(TypedFrameSize<T>::value);
+    TypedHeader header = {TypedSchema<T>::hash, (uint32_t)sizeof(T)};
+    memcpy(msg.data(), &header, sizeof(header));
+    memcpy(msg.data() + sizeof(header), &value, sizeof(T));
+  }
+
+  // decodeTyped copies the object in a typed frame into value.  Throws if the
+  // frame was not made from the same schema.
+  template <typename T>
+  void decodeTyped(const Message& msg, T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+      "typed messages must be trivially copyable");
+    TypedHeader header;
+    if (msg.size() != TypedFrameSize<T>::value) {
+      throw std::wruntime_error("jzmq::decodeTyped() - ERROR: "
+        "frame size does not match the type.");
+    }
+    memcpy(&header, msg.data(), sizeof(header));
+    if (header.schema_hash != TypedSchema<T>::hash) {
+      throw std::wruntime_error("jzmq::decodeTyped() - ERROR: "
+        "schema hash mismatch (the sender uses another version of the type).");
+    }
+    memcpy(&value, msg.data() + sizeof(header), sizeof(T));
+  }
+
+};  // namespace jzmq
+
+// Gives type a schema name and version (bump the version whenever its layout
+// changes).  Use at global scope.
+#define JZMQ_MESSAGE_SCHEMA(type, schema_version) \
+  namespace jzmq { \
+    template <> \
+    struct MessageSchema<type> { \
+      static const char* name() { return #type; } \
+      static uint32_t version() { return schema_version; } \
+    }; \
+  }
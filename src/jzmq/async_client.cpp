@@ -0,0 +1,149 @@
+#include <mutex>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <assert.h>
+#include <zmq.h>
+#include "jzmq/async_client.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  AsyncClient::AsyncClient(const std::string& conn_str,
+    const uint32_t max_outstanding, const ConnectionOptions& options) :
+    Connection(conn_str, ClientType, options) {
+    if (max_outstanding == 0) {
+      throw std::wruntime_error("AsyncClient::AsyncClient() - ERROR: "
+        "max_outstanding must be at least 1.");
+    }
+    max_outstanding_ = max_outstanding;
+    next_request_id_ = 1;
+  }
+
+  AsyncClient::~AsyncClient() {
+    closeSocket();
+  }
+
+  void AsyncClient::initConn() {
+    if (socket_ != NULL) {
+      throw std::wruntime_error("AsyncClient::initConn() - ERROR: "
+        "connection already initialized.");
+    }
+    void* context = Connection::initContext();
+
+    socket_ = zmq_socket(context, ZMQ_DEALER);
+    if (socket_ == NULL) {
+      killContext();
+      throwErrorMessage("AsyncClient::initConn() - ERROR: "
+        "Could not create ZMQ_DEALER socket");
+    }
+    applySocketOptions();
+
+    int rc = zmq_connect(socket_, conn_str_.c_str());
+    if (rc != 0) {
+      closeAndThrow("AsyncClient::initConn() - ERROR: "
+        "Could not connect ZMQ_DEALER socket");
+    }
+  }
+
+  void AsyncClient::killConn() {
+    if (socket_ == NULL) {
+      throw std::wruntime_error("AsyncClient::killConn() - ERROR: "
+        "Socket has not been initialized!");
+    }
+    outstanding_.clear();
+    closeSocket();
+  }
+
+  uint64_t AsyncClient::sendRequest(const char* data, const uint64_t size,
+    const Callback& callback, const int timout_ms) {
+    DataBuffer part = {data, size};
+    return sendRequest(&part, 1, callback, timout_ms);
+  }
+
+  uint64_t AsyncClient::sendRequest(const DataBuffer* parts,
+    const uint32_t n_parts, const Callback& callback, const int timout_ms) {
+    if (outstanding_.size() >= max_outstanding_) {
+      // The window is full: wait for (at least) one reply to free a slot
+      int rc = processReplies(timout_ms);
+      if (rc <= 0 || outstanding_.size() >= max_outstanding_) {
+        return 0;
+      }
+    }
+
+    // Envelope: [request id][empty delimiter], then the request frames
+    const uint64_t request_id = next_request_id_;
+    request_.resize(n_parts + 2);
+    request_[0].data = reinterpret_cast<const char*>(&request_id);
+    request_[0].size = sizeof(request_id);
+    request_[1].data = NULL;
+    request_[1].size = 0;
+    for (uint32_t i = 0; i < n_parts; i++) {
+      request_[i + 2] = parts[i];
+    }
+    int rc = sendMultipart(&request_[0], (uint32_t)request_.size(),
+      timout_ms);
+    if (rc <= 0) {
+      return 0;
+    }
+    next_request_id_++;
+    outstanding_[request_id] = callback;
+    return request_id;
+  }
+
+  int AsyncClient::processReplies(const int timout_ms) {
+    if (outstanding_.size() == 0 && timout_ms < 0) {
+      throw std::wruntime_error("AsyncClient::processReplies() - ERROR: "
+        "No requests are outstanding (this would block forever).");
+    }
+    int rc = receiveMultipart(reply_, timout_ms);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    int n_dispatched = dispatchReply() ? 1 : 0;
+    // Drain any other replies that have already arrived
+    while (receiveMultipart(reply_, 0) > 0) {
+      if (dispatchReply()) {
+        n_dispatched++;
+      }
+    }
+    return n_dispatched;
+  }
+
+  bool AsyncClient::dispatchReply() {
+    // Expect [request id][empty delimiter][reply frames...]
+    if (reply_.size() < 2 || reply_[0].size() != sizeof(uint64_t) ||
+      reply_[1].size() != 0) {
+      return false;  // Not one of ours
+    }
+    uint64_t request_id;
+    memcpy(&request_id, reply_[0].data(), sizeof(request_id));
+    std::unordered_map<uint64_t, Callback>::iterator it =
+      outstanding_.find(request_id);
+    if (it == outstanding_.end()) {
+      return false;  // Cancelled or a duplicate
+    }
+    // Release the slot before calling back, the callback may send again
+    Callback callback = std::move(it->second);
+    outstanding_.erase(it);
+    reply_.erase(reply_.begin(), reply_.begin() + 2);
+    callback(request_id, reply_);
+    return true;
+  }
+
+  bool AsyncClient::cancelRequest(const uint64_t request_id) {
+    return outstanding_.erase(request_id) > 0;
+  }
+
+  uint32_t AsyncClient::numOutstanding() const {
+    return (uint32_t)outstanding_.size();
+  }
+
+  uint32_t AsyncClient::maxOutstanding() const {
+    return max_outstanding_;
+  }
+
+}  // namespace jzmq
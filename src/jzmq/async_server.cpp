@@ -0,0 +1,250 @@
+#include <mutex>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <assert.h>
+#include <zmq.h>
+#include "jzmq/async_server.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  std::atomic<uint64_t> AsyncServer::num_instances_(0);
+
+  AsyncServer::AsyncServer(const std::string& conn_str,
+    const ConnectionOptions& options) :
+    Connection(conn_str, ServerType, options) {
+    reply_pull_ = NULL;
+    reply_push_ = NULL;
+    std::stringstream ss;
+    ss << "inproc://jzmq_async_server_replies_" << num_instances_++;
+    reply_conn_str_ = ss.str();
+  }
+
+  AsyncServer::~AsyncServer() {
+    if (socket_ != NULL) {
+      killConn();  // Also closes the reply handoff sockets
+    }
+  }
+
+  void AsyncServer::initConn() {
+    if (socket_ != NULL) {
+      throw std::wruntime_error("AsyncServer::initConn() - ERROR: "
+        "connection already initialized.");
+    }
+    void* context = Connection::initContext();
+
+    socket_ = zmq_socket(context, ZMQ_ROUTER);
+    if (socket_ == NULL) {
+      killContext();
+      throwErrorMessage("AsyncServer::initConn() - ERROR: "
+        "Could not create ZMQ_ROUTER socket");
+    }
+    applySocketOptions();
+
+    int rc = zmq_bind(socket_, conn_str_.c_str());
+    if (rc != 0) {
+      closeAndThrow("AsyncServer::initConn() - ERROR: "
+        "Could not bind ZMQ_ROUTER socket");
+    }
+
+    // Internal handoff for replies posted from other threads.  inproc
+    // requires the bind before the connect.
+    const int linger = 0;
+    reply_pull_ = zmq_socket(context, ZMQ_PULL);
+    reply_push_ = zmq_socket(context, ZMQ_PUSH);
+    if (reply_pull_ == NULL || reply_push_ == NULL) {
+      closeAllAndThrow("AsyncServer::initConn() - ERROR: "
+        "Could not create reply handoff sockets");
+    }
+    zmq_setsockopt(reply_pull_, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_setsockopt(reply_push_, ZMQ_LINGER, &linger, sizeof(linger));
+    rc = zmq_bind(reply_pull_, reply_conn_str_.c_str());
+    if (rc == 0) {
+      rc = zmq_connect(reply_push_, reply_conn_str_.c_str());
+    }
+    if (rc != 0) {
+      closeAllAndThrow("AsyncServer::initConn() - ERROR: "
+        "Could not connect reply handoff sockets");
+    }
+  }
+
+  void AsyncServer::killConn() {
+    if (socket_ == NULL) {
+      throw std::wruntime_error("AsyncServer::killConn() - ERROR: "
+        "Socket has not been initialized!");
+    }
+    closeReplySockets();
+    frames_.clear();
+    closeSocket();
+  }
+
+  void AsyncServer::closeAllAndThrow(const std::string& err_msg) {
+    const std::string msg = errorMessage(err_msg);  // Before zmq_close
+    closeReplySockets();
+    closeSocket();
+    throw std::wruntime_error(msg);
+  }
+
+  void AsyncServer::closeReplySockets() {
+    std::unique_lock<std::mutex> lck(reply_lck_);
+    if (reply_push_ != NULL) {
+      zmq_close(reply_push_);
+      reply_push_ = NULL;
+    }
+    if (reply_pull_ != NULL) {
+      zmq_close(reply_pull_);
+      reply_pull_ = NULL;
+    }
+  }
+
+  int AsyncServer::receiveRequest(Request& request, const int timout_ms) {
+    flushReplies();
+
+    // Wait on both the ROUTER socket and the reply handoff, so that replies
+    // posted while we are blocked still go out promptly.
+    std::chrono::steady_clock::time_point t_end =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timout_ms);
+    int wait_ms = timout_ms;
+    while (true) {
+      zmq_pollitem_t items [] = {{socket_, 0, ZMQ_POLLIN, 0},
+        {reply_pull_, 0, ZMQ_POLLIN, 0}};
+      int rc = zmq_poll(items, 2, wait_ms);
+      if (rc == -1) {
+        if (zmq_errno() == EINTR) {
+          return kInterrupted;
+        }
+        throwErrorMessage("AsyncServer::receiveRequest() - ERROR: "
+          "Error polling Socket.");
+      }
+      if (items[1].revents & ZMQ_POLLIN) {
+        flushReplies();
+      }
+      if (items[0].revents & ZMQ_POLLIN) {
+        rc = receiveMultipart(frames_, 0);
+        if (rc <= 0) {
+          return rc;
+        }
+        if (splitRequest(request)) {
+          return 1;
+        }
+      }
+      if (timout_ms >= 0) {
+        // Only replies were forwarded (or the request was malformed), so
+        // keep waiting for whatever is left of the timeout.
+        std::chrono::steady_clock::time_point t_now =
+          std::chrono::steady_clock::now();
+        if (rc == 0 || t_now >= t_end) {
+          return 0;
+        }
+        wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+          t_end - t_now).count();
+      }
+    }
+  }
+
+  bool AsyncServer::splitRequest(Request& request) {
+    // Everything up to the empty delimiter is the envelope
+    request.envelope.clear();
+    request.parts.clear();
+    uint32_t i = 0;
+    while (i < frames_.size() && frames_[i].size() > 0) {
+      request.envelope.push_back(std::move(frames_[i]));
+      i++;
+    }
+    if (i == frames_.size() || request.envelope.size() == 0) {
+      request.envelope.clear();
+      return false;  // No delimiter: not a REQ or AsyncClient request
+    }
+    for (i++; i < frames_.size(); i++) {
+      request.parts.push_back(std::move(frames_[i]));
+    }
+    return true;
+  }
+
+  void AsyncServer::sendFrames(void* socket, std::vector<Message>& envelope,
+    std::vector<Message>& parts, const std::string& err_msg) {
+    // [envelope...][empty delimiter][parts...]
+    for (uint32_t i = 0; i < envelope.size(); i++) {
+      zmq_msg_t* msg = static_cast<zmq_msg_t*>(zmqMsg(envelope[i]));
+      if (zmq_msg_send(msg, socket, ZMQ_SNDMORE) < 0) {
+        throwErrorMessage(err_msg);
+      }
+    }
+    int flags = parts.size() > 0 ? ZMQ_SNDMORE : 0;
+    if (zmq_send(socket, NULL, 0, flags) < 0) {
+      throwErrorMessage(err_msg);
+    }
+    for (uint32_t i = 0; i < parts.size(); i++) {
+      flags = (i + 1 < parts.size()) ? ZMQ_SNDMORE : 0;
+      zmq_msg_t* msg = static_cast<zmq_msg_t*>(zmqMsg(parts[i]));
+      if (zmq_msg_send(msg, socket, flags) < 0) {
+        throwErrorMessage(err_msg);
+      }
+    }
+    envelope.clear();
+  }
+
+  int AsyncServer::sendReply(std::vector<Message>& envelope,
+    const DataBuffer* parts, const uint32_t n_parts) {
+    std::vector<Message> reply;
+    int bytes = 0;
+    for (uint32_t i = 0; i < n_parts; i++) {
+      reply.push_back(Message(parts[i].data, parts[i].size));
+      bytes += (int)parts[i].size;
+    }
+    sendFrames(socket_, envelope, reply, "AsyncServer::sendReply() - ERROR: "
+      "Could not send reply");
+    return bytes;
+  }
+
+  int AsyncServer::sendReply(std::vector<Message>& envelope,
+    std::vector<Message>& parts) {
+    int bytes = 0;
+    for (uint32_t i = 0; i < parts.size(); i++) {
+      bytes += (int)parts[i].size();
+    }
+    sendFrames(socket_, envelope, parts, "AsyncServer::sendReply() - ERROR: "
+      "Could not send reply");
+    return bytes;
+  }
+
+  void AsyncServer::postReply(std::vector<Message>& envelope,
+    std::vector<Message>& parts) {
+    std::unique_lock<std::mutex> lck(reply_lck_);
+    if (reply_push_ == NULL) {
+      throw std::wruntime_error("AsyncServer::postReply() - ERROR: "
+        "Socket has not been initialized!");
+    }
+    sendFrames(reply_push_, envelope, parts, "AsyncServer::postReply() - "
+      "ERROR: Could not post reply");
+  }
+
+  int AsyncServer::flushReplies() {
+    // Each posted reply is already framed for the ROUTER socket, so just
+    // forward the frames as they are.
+    int n_replies = 0;
+    Message frame;
+    zmq_msg_t* msg = static_cast<zmq_msg_t*>(zmqMsg(frame));
+    while (zmq_msg_recv(msg, reply_pull_, ZMQ_DONTWAIT) >= 0) {
+      bool more;
+      do {
+        more = frame.more();
+        if (zmq_msg_send(msg, socket_, more ? ZMQ_SNDMORE : 0) < 0) {
+          throwErrorMessage("AsyncServer::flushReplies() - ERROR: "
+            "Could not send reply");
+        }
+        if (more && zmq_msg_recv(msg, reply_pull_, 0) < 0) {
+          throwErrorMessage("AsyncServer::flushReplies() - ERROR: "
+            "Could not receive posted reply");
+        }
+      } while (more);
+      n_replies++;
+    }
+    return n_replies;
+  }
+
+}  // namespace jzmq
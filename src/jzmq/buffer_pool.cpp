@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include "jzmq/buffer_pool.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#if defined(_WIN32)
+  #include <malloc.h>
+#else
+  #include <sys/mman.h>
+#endif
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  // Every buffer is preceded by one cache line holding its header, so the
+  // data stays aligned and release() can find the size class.  owner is the
+  // pool the buffer is acquired from (NULL while it sits on a freelist), so
+  // buffers released to the wrong pool, or twice, are caught.
+  struct BufferHeader {
+    uint64_t capacity;
+    uint32_t size_class;
+    uint32_t magic;
+    BufferPool* owner;
+  };
+  static const uint32_t kBufferMagic = 0x4a5a4250;  // "JZBP"
+  static const uint64_t kHugePageSize = 2 * 1024 * 1024;
+
+  static BufferHeader* headerOf(const char* buffer) {
+    return reinterpret_cast<BufferHeader*>(const_cast<char*>(buffer) -
+      BufferPool::kAlignment);
+  }
+
+  BufferPool::BufferPool(const uint64_t min_buffer_size,
+    const uint64_t max_buffer_size, const uint32_t max_cached_per_class,
+    const bool huge_pages) : hits_(0), misses_(0), buffers_outstanding_(0),
+    bytes_outstanding_(0), buffers_cached_(0), bytes_cached_(0) {
+    if (min_buffer_size == 0 || max_buffer_size < min_buffer_size ||
+      max_cached_per_class == 0) {
+      throw std::wruntime_error("BufferPool::BufferPool() - ERROR: "
+        "need 0 < min_buffer_size <= max_buffer_size and "
+        "max_cached_per_class > 0.");
+    }
+    min_buffer_size_ = kAlignment;
+    while (min_buffer_size_ < min_buffer_size) {
+      min_buffer_size_ <<= 1;
+    }
+    n_classes_ = 1;
+    while ((min_buffer_size_ << (n_classes_ - 1)) < max_buffer_size) {
+      n_classes_++;
+    }
+    huge_pages_ = huge_pages;
+    for (uint32_t i = 0; i < n_classes_; i++) {
+      free_lists_.push_back(new BoundedQueue<char*>(max_cached_per_class));
+    }
+  }
+
+  BufferPool::~BufferPool() {
+    if (buffers_outstanding_ > 0) {
+      // Don't throw from the destructor, but let the user know.
+      std::cout << "BufferPool::~BufferPool() - Warning: " <<
+        buffers_outstanding_ << " buffers were not released!" << std::endl;
+    }
+    for (uint32_t i = 0; i < free_lists_.size(); i++) {
+      char* buffer;
+      while (free_lists_[i]->pop(buffer)) {
+        deallocate(buffer);
+      }
+      SAFE_DELETE(free_lists_[i]);
+    }
+  }
+
+  uint32_t BufferPool::sizeClass(const uint64_t size) const {
+    uint32_t size_class = 0;
+    while (size_class < n_classes_ &&
+      (min_buffer_size_ << size_class) < size) {
+      size_class++;
+    }
+    return size_class;
+  }
+
+  char* BufferPool::acquire(const uint64_t size) {
+    const uint32_t size_class = sizeClass(size);
+    char* buffer = NULL;
+    if (size_class < n_classes_ && free_lists_[size_class]->pop(buffer)) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      buffers_cached_.fetch_sub(1, std::memory_order_relaxed);
+      bytes_cached_.fetch_sub(headerOf(buffer)->capacity,
+        std::memory_order_relaxed);
+    } else {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      const uint64_t capacity = size_class < n_classes_ ?
+        (min_buffer_size_ << size_class) : size;
+      buffer = allocate(capacity, size_class);
+    }
+    headerOf(buffer)->owner = this;
+    buffers_outstanding_.fetch_add(1, std::memory_order_relaxed);
+    bytes_outstanding_.fetch_add(headerOf(buffer)->capacity,
+      std::memory_order_relaxed);
+    return buffer;
+  }
+
+  void BufferPool::release(char* buffer) {
+    if (!tryRelease(buffer)) {
+      throw std::wruntime_error("BufferPool::release() - ERROR: "
+        "buffer was not acquired from this BufferPool (or was already "
+        "released).");
+    }
+  }
+
+  bool BufferPool::tryRelease(char* buffer) {
+    if (buffer == NULL) {
+      return true;
+    }
+    BufferHeader* header = headerOf(buffer);
+    if (header->magic != kBufferMagic || header->owner != this) {
+      return false;  // Not ours: another pool's size classes may differ
+    }
+    if (header->size_class < n_classes_ &&
+      header->capacity != (min_buffer_size_ << header->size_class)) {
+      return false;
+    }
+    header->owner = NULL;
+    const uint64_t capacity = header->capacity;
+    buffers_outstanding_.fetch_sub(1, std::memory_order_relaxed);
+    bytes_outstanding_.fetch_sub(capacity, std::memory_order_relaxed);
+    if (header->size_class < n_classes_ &&
+      free_lists_[header->size_class]->push(buffer)) {
+      buffers_cached_.fetch_add(1, std::memory_order_relaxed);
+      bytes_cached_.fetch_add(capacity, std::memory_order_relaxed);
+    } else {
+      deallocate(buffer);  // Oversized, or the freelist is full
+    }
+    return true;
+  }
+
+  void BufferPool::recycle(void* data, void* hint) {
+    // Called by ZeroMQ, which can't handle an exception
+    if (!static_cast<BufferPool*>(hint)->tryRelease(static_cast<char*>(data))) {
+      std::cout << "BufferPool::recycle() - ERROR: buffer was not acquired "
+        "from this BufferPool (it is leaked)." << std::endl;
+    }
+  }
+
+  uint64_t BufferPool::capacity(const char* buffer) {
+    return headerOf(buffer)->capacity;
+  }
+
+  BufferPoolStats BufferPool::stats() const {
+    BufferPoolStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.buffers_outstanding =
+      buffers_outstanding_.load(std::memory_order_relaxed);
+    stats.bytes_outstanding =
+      bytes_outstanding_.load(std::memory_order_relaxed);
+    stats.buffers_cached = buffers_cached_.load(std::memory_order_relaxed);
+    stats.bytes_cached = bytes_cached_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  char* BufferPool::allocate(const uint64_t capacity,
+    const uint32_t size_class) {
+    const uint64_t total = kAlignment + capacity;
+    const bool huge = huge_pages_ && total >= kHugePageSize;
+    const uint64_t alignment = huge ? kHugePageSize : kAlignment;
+    void* mem = NULL;
+#if defined(_WIN32)
+    mem = _aligned_malloc((size_t)total, (size_t)alignment);
+#else
+    if (posix_memalign(&mem, (size_t)alignment, (size_t)total) != 0) {
+      mem = NULL;
+    }
+#endif
+    if (mem == NULL) {
+      std::stringstream ss;
+      ss << "BufferPool::allocate() - ERROR: could not allocate " << total;
+      ss << " bytes.";
+      throw std::wruntime_error(ss.str());
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (huge) {
+      madvise(mem, (size_t)total, MADV_HUGEPAGE);  // Only a hint
+    }
+#endif
+    BufferHeader* header = static_cast<BufferHeader*>(mem);
+    header->capacity = capacity;
+    header->size_class = size_class;
+    header->magic = kBufferMagic;
+    header->owner = NULL;
+    return static_cast<char*>(mem) + kAlignment;
+  }
+
+  void BufferPool::deallocate(char* buffer) {
+    BufferHeader* header = headerOf(buffer);
+    header->magic = 0;
+#if defined(_WIN32)
+    _aligned_free(header);
+#else
+    free(header);
+#endif
+  }
+
+}  // namespace jzmq
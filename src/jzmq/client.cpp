@@ -11,49 +11,54 @@
 
 namespace jzmq {
 
-  Client::Client(const std::string& conn_str) : 
-    Connection(conn_str, ClientType){
+  Client::Client(const std::string& conn_str, 
+    const ConnectionOptions& options) : 
+    Connection(conn_str, ClientType, options) {
   }
 
   Client::~Client() {
-    if (socket_ != NULL) {
-      // A socket might not close correctly on a fatal error condition
-      // Don't throw an exception or raise an assertion, but let the user know.
-      std::cout << "Client::~Client() - Warning: Socket was not "
-        "closed!" << std::endl;
-    }
+    closeSocket();
+  }
+
+  Client::Client(Client&& other) : Connection(std::move(other)) {
+  }
+
+  Client& Client::operator=(Client&& other) {
+    Connection::operator=(std::move(other));
+    return *this;
   }
   
   void Client::initConn() {
-    if (socket_ != NULL) {
+    if (socket_ != NULL || transport_ != NULL) {
       throw std::wruntime_error("Client::initConn() - ERROR: connection "
         "already initialized.");
     }
+    if (initThreadTransport()) {
+      return;
+    }
     void* context = Connection::initContext();
     
     socket_ = zmq_socket(context, ZMQ_REQ);
     if (socket_ == NULL) {
+      killContext();
       throwErrorMessage("Client::initConn() - ERROR: "
         "Could not create ZMQ_REQ socket");
     }
+    applySocketOptions();
 
     int rc = zmq_connect(socket_, conn_str_.c_str());
     if (rc != 0) {
-      throwErrorMessage("Client::initConn() - ERROR: "
+      closeAndThrow("Client::initConn() - ERROR: "
         "Could not connect ZMQ_REQ socket");
     }
-    num_open_connections_++;
   }
 
   void Client::killConn() {
-    if (socket_ == NULL) {
+    if (socket_ == NULL && transport_ == NULL) {
       throw std::wruntime_error("Client::killConn() - ERROR: "
         "Socket has not been initialized!");
     }
-    zmq_close(socket_);
-    socket_ = NULL;
-    num_open_connections_--;
-    killContext();
+    closeSocket();
   }
 
 }  // namespace jzmq
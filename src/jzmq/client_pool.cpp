@@ -0,0 +1,130 @@
+#include <iostream>
+#include "jzmq/client_pool.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  ClientPool::Lease::Lease(ClientPool* pool, Client&& client) :
+    pool_(pool), client_(std::move(client)) {
+  }
+
+  ClientPool::Lease::Lease(Lease&& other) : pool_(other.pool_),
+    client_(std::move(other.client_)) {
+    other.pool_ = NULL;
+  }
+
+  ClientPool::Lease& ClientPool::Lease::operator=(Lease&& other) {
+    if (this != &other) {
+      giveBack();
+      pool_ = other.pool_;
+      client_ = std::move(other.client_);
+      other.pool_ = NULL;
+    }
+    return *this;
+  }
+
+  ClientPool::Lease::~Lease() {
+    giveBack();
+  }
+
+  Client& ClientPool::Lease::client() {
+    return client_;
+  }
+
+  Client* ClientPool::Lease::operator->() {
+    return &client_;
+  }
+
+  void ClientPool::Lease::discard() {
+    if (pool_ != NULL) {
+      pool_ = NULL;
+      client_.killConn();
+    }
+  }
+
+  void ClientPool::Lease::giveBack() {
+    if (pool_ != NULL) {
+      pool_->release(std::move(client_));
+      pool_ = NULL;
+    }
+  }
+
+  ClientPool::ClientPool(const ConnectionOptions& options,
+    const uint32_t max_idle) : num_connected_(0) {
+    options_ = options;
+    max_idle_ = max_idle;
+    num_idle_ = 0;
+  }
+
+  ClientPool::~ClientPool() {
+    clear();
+  }
+
+  ClientPool::Lease ClientPool::acquire(const std::string& conn_str) {
+    {
+      std::lock_guard<std::mutex> lck(lck_);
+      std::unordered_map<std::string, std::vector<Client> >::iterator it =
+        idle_.find(conn_str);
+      if (it != idle_.end() && it->second.size() > 0) {
+        Lease lease(this, std::move(it->second.back()));
+        it->second.pop_back();
+        num_idle_--;
+        return lease;
+      }
+    }
+    // Connect outside the lock so other endpoints aren't held up
+    Client client(conn_str, options_);
+    client.initConn();
+    num_connected_++;
+    return Lease(this, std::move(client));
+  }
+
+  void ClientPool::release(Client&& client) {
+    std::lock_guard<std::mutex> lck(lck_);
+    std::vector<Client>& idle = idle_[client.connStr()];
+    if (idle.size() < max_idle_) {
+      idle.push_back(std::move(client));
+      num_idle_++;
+    } else {
+      client.killConn();
+    }
+  }
+
+  int ClientPool::request(const std::string& conn_str, const char* data,
+    const uint64_t size, Message& reply, const int timout_ms) {
+    Lease lease = acquire(conn_str);
+    try {
+      DataBuffer part = {data, size};
+      int rc = lease->sendMultipart(&part, 1, timout_ms);
+      if (rc > 0) {
+        rc = lease->receiveMessage(reply, timout_ms);
+        if (rc <= 0) {
+          lease.discard();
+        }
+      }
+      return rc;
+    } catch (...) {
+      lease.discard();
+      throw;
+    }
+  }
+
+  void ClientPool::clear() {
+    std::lock_guard<std::mutex> lck(lck_);
+    idle_.clear();  // The Client destructors close the sockets
+    num_idle_ = 0;
+  }
+
+  uint64_t ClientPool::numIdle() const {
+    std::lock_guard<std::mutex> lck(lck_);
+    return num_idle_;
+  }
+
+  uint64_t ClientPool::numConnected() const {
+    return num_connected_;
+  }
+
+}  // namespace jzmq
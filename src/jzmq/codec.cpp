@@ -0,0 +1,328 @@
+#include <string.h>
+#include "jzmq/codec.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define JZMQ_SSE2
+#endif
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  // LZ77 block format (as LZ4): each sequence is a token byte (literal count
+  // in the high nibble, match length - kMinMatch in the low nibble, 15 means
+  // more length bytes follow, each adding up to 255), the literals, and a 2
+  // byte little endian match offset.  The last sequence has literals only.
+  static const uint32_t kMinMatch = 4;
+  static const uint32_t kMaxOffset = 65535;
+  static const uint32_t kHashBits = 13;
+  // Matches stop this far from the end so the tail is always literals
+  static const uint64_t kLastLiterals = 5;
+  // Encoded frames start with the element size and delta flag, so the 
+  // decoder doesn't depend on its own settings
+  static const uint64_t kParamsSize = 2;
+  static const uint64_t kMinEncodeSize = 32;
+
+  ShuffleLZCodec::ShuffleLZCodec(const uint32_t element_size,
+    const bool delta) {
+    if (element_size == 0 || element_size > 255) {
+      throw std::wruntime_error("ShuffleLZCodec::ShuffleLZCodec() - ERROR: "
+        "element_size must be in [1, 255].");
+    }
+    element_size_ = element_size;
+    delta_ = delta;
+  }
+
+  ShuffleLZCodec::~ShuffleLZCodec() {
+  }
+
+  uint64_t ShuffleLZCodec::encode(const char* src, const uint64_t size,
+    char* dst) {
+    if (size < kMinEncodeSize) {
+      return 0;
+    }
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+    if (element_size_ > 1 || delta_) {
+      if (scratch_.size() < size) {
+        scratch_.resize((size_t)size);
+      }
+      shuffle(in, size, element_size_, &scratch_[0]);
+      if (delta_) {
+        for (uint64_t i = size - 1; i > 0; i--) {
+          scratch_[(size_t)i] -= scratch_[(size_t)i - 1];
+        }
+      }
+      in = &scratch_[0];
+    }
+    // Only worth it if it saves something
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    out[0] = (uint8_t)element_size_;
+    out[1] = delta_ ? 1 : 0;
+    uint64_t n = lzCompress(in, size, out + kParamsSize, 
+      size - kParamsSize - 1);
+    return n > 0 ? n + kParamsSize : 0;
+  }
+
+  void ShuffleLZCodec::decode(const char* src, const uint64_t size, char* dst,
+    const uint64_t raw_size) {
+    if (size < kParamsSize || src[0] == 0) {
+      throw std::wruntime_error("ShuffleLZCodec::decode() - ERROR: "
+        "corrupt frame.");
+    }
+    const uint32_t element_size = (uint8_t)src[0];
+    const bool delta = src[1] != 0;
+    const bool shuffled = element_size > 1 || delta;
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    if (shuffled) {
+      if (scratch_.size() < raw_size) {
+        scratch_.resize((size_t)raw_size);
+      }
+      out = &scratch_[0];
+    }
+    if (!lzDecompress(reinterpret_cast<const uint8_t*>(src) + kParamsSize,
+      size - kParamsSize, out, raw_size)) {
+      throw std::wruntime_error("ShuffleLZCodec::decode() - ERROR: "
+        "corrupt frame.");
+    }
+    if (shuffled) {
+      if (delta) {
+        for (uint64_t i = 1; i < raw_size; i++) {
+          scratch_[(size_t)i] += scratch_[(size_t)i - 1];
+        }
+      }
+      unshuffle(out, raw_size, element_size, reinterpret_cast<uint8_t*>(dst));
+    }
+  }
+
+  void ShuffleLZCodec::shuffle(const uint8_t* src, const uint64_t size,
+    const uint32_t element_size, uint8_t* dst) {
+    const uint64_t n_elements = size / element_size;
+    uint64_t i = 0;
+#ifdef JZMQ_SSE2
+    if (element_size == 4) {
+      // 16 elements at a time: four rounds of byte interleaving transpose
+      // the 16x4 byte block into 4 planes of 16 bytes
+      for (; i + 16 <= n_elements; i += 16) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(src + i * 4);
+        __m128i r0 = _mm_loadu_si128(in);
+        __m128i r1 = _mm_loadu_si128(in + 1);
+        __m128i r2 = _mm_loadu_si128(in + 2);
+        __m128i r3 = _mm_loadu_si128(in + 3);
+        for (uint32_t round = 0; round < 4; round++) {
+          __m128i t0 = _mm_unpacklo_epi8(r0, r2);
+          __m128i t1 = _mm_unpackhi_epi8(r0, r2);
+          __m128i t2 = _mm_unpacklo_epi8(r1, r3);
+          __m128i t3 = _mm_unpackhi_epi8(r1, r3);
+          r0 = t0;
+          r1 = t1;
+          r2 = t2;
+          r3 = t3;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n_elements + i), r1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * n_elements + i),
+          r2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * n_elements + i),
+          r3);
+      }
+    }
+#endif
+    for (; i < n_elements; i++) {
+      for (uint32_t b = 0; b < element_size; b++) {
+        dst[b * n_elements + i] = src[i * element_size + b];
+      }
+    }
+    const uint64_t n_shuffled = n_elements * element_size;
+    memcpy(dst + n_shuffled, src + n_shuffled, (size_t)(size - n_shuffled));
+  }
+
+  void ShuffleLZCodec::unshuffle(const uint8_t* src, const uint64_t size,
+    const uint32_t element_size, uint8_t* dst) {
+    const uint64_t n_elements = size / element_size;
+    uint64_t i = 0;
+#ifdef JZMQ_SSE2
+    if (element_size == 4) {
+      // Interleave bytes of planes 0/1 and 2/3, then 16 bit pairs of those
+      for (; i + 16 <= n_elements; i += 16) {
+        __m128i p0 = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(src + i));
+        __m128i p1 = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(src + n_elements + i));
+        __m128i p2 = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(src + 2 * n_elements + i));
+        __m128i p3 = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(src + 3 * n_elements + i));
+        __m128i a0 = _mm_unpacklo_epi8(p0, p1);
+        __m128i a1 = _mm_unpackhi_epi8(p0, p1);
+        __m128i a2 = _mm_unpacklo_epi8(p2, p3);
+        __m128i a3 = _mm_unpackhi_epi8(p2, p3);
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(a0, a2));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(a0, a2));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(a1, a3));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(a1, a3));
+      }
+    }
+#endif
+    for (; i < n_elements; i++) {
+      for (uint32_t b = 0; b < element_size; b++) {
+        dst[i * element_size + b] = src[b * n_elements + i];
+      }
+    }
+    const uint64_t n_shuffled = n_elements * element_size;
+    memcpy(dst + n_shuffled, src + n_shuffled, (size_t)(size - n_shuffled));
+  }
+
+  static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  // Writes a length continuation (the part above 15) as 255 runs
+  static inline uint8_t* writeLength(uint8_t* op, uint64_t len) {
+    while (len >= 255) {
+      *op++ = 255;
+      len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+  }
+
+  // Appends one sequence, or returns NULL if it doesn't fit before op_end
+  static uint8_t* writeSequence(uint8_t* op, uint8_t* op_end,
+    const uint8_t* literals, const uint64_t n_literals,
+    const uint64_t offset, const uint64_t match_len) {
+    // Worst case size of the sequence
+    const uint64_t needed = 1 + n_literals + n_literals / 255 + 1 + 2 +
+      match_len / 255 + 1;
+    if ((uint64_t)(op_end - op) < needed) {
+      return NULL;
+    }
+    uint8_t* token = op++;
+    const uint64_t match_code = match_len > 0 ? match_len - kMinMatch : 0;
+    *token = (uint8_t)(((n_literals < 15 ? n_literals : 15) << 4) |
+      (match_code < 15 ? match_code : 15));
+    if (n_literals >= 15) {
+      op = writeLength(op, n_literals - 15);
+    }
+    memcpy(op, literals, (size_t)n_literals);
+    op += n_literals;
+    if (match_len == 0) {
+      return op;  // Last sequence
+    }
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+    if (match_code >= 15) {
+      op = writeLength(op, match_code - 15);
+    }
+    return op;
+  }
+
+  uint64_t ShuffleLZCodec::lzCompress(const uint8_t* src, const uint64_t size,
+    uint8_t* dst, const uint64_t dst_size) {
+    uint32_t table[1 << kHashBits];
+    memset(table, 0, sizeof(table));
+    uint8_t* op = dst;
+    uint8_t* const op_end = dst + dst_size;
+    uint64_t anchor = 0;
+    uint64_t ip = 1;  // table[] == 0 means empty, so never match position 0
+    const uint64_t match_limit = size > kLastLiterals ?
+      size - kLastLiterals : 0;
+
+    while (ip + kMinMatch <= match_limit) {
+      const uint32_t seq = read32(src + ip);
+      const uint32_t h = (seq * 2654435761u) >> (32 - kHashBits);
+      const uint64_t candidate = table[h];
+      table[h] = (uint32_t)ip;
+      if (candidate == 0 || ip - candidate > kMaxOffset ||
+        read32(src + candidate) != seq) {
+        ip++;
+        continue;
+      }
+      uint64_t len = kMinMatch;
+      while (ip + len < match_limit && src[candidate + len] == src[ip + len]) {
+        len++;
+      }
+      op = writeSequence(op, op_end, src + anchor, ip - anchor,
+        ip - candidate, len);
+      if (op == NULL) {
+        return 0;
+      }
+      ip += len;
+      anchor = ip;
+    }
+    op = writeSequence(op, op_end, src + anchor, size - anchor, 0, 0);
+    if (op == NULL) {
+      return 0;
+    }
+    return (uint64_t)(op - dst);
+  }
+
+  // Reads a length continuation, returns false on overrun
+  static inline bool readLength(const uint8_t* src, const uint64_t size,
+    uint64_t& ip, uint64_t& len) {
+    uint8_t b;
+    do {
+      if (ip >= size) {
+        return false;
+      }
+      b = src[ip++];
+      len += b;
+    } while (b == 255);
+    return true;
+  }
+
+  bool ShuffleLZCodec::lzDecompress(const uint8_t* src, const uint64_t size,
+    uint8_t* dst, const uint64_t dst_size) {
+    uint64_t ip = 0;
+    uint64_t op = 0;
+    while (ip < size) {
+      const uint8_t token = src[ip++];
+      uint64_t n_literals = token >> 4;
+      if (n_literals == 15 && !readLength(src, size, ip, n_literals)) {
+        return false;
+      }
+      if (n_literals > size - ip || n_literals > dst_size - op) {
+        return false;
+      }
+      memcpy(dst + op, src + ip, (size_t)n_literals);
+      ip += n_literals;
+      op += n_literals;
+      if (ip == size) {
+        break;  // Last sequence
+      }
+
+      if (size - ip < 2) {
+        return false;
+      }
+      const uint64_t offset = src[ip] | ((uint64_t)src[ip + 1] << 8);
+      ip += 2;
+      uint64_t match_len = token & 0x0f;
+      if (match_len == 15 && !readLength(src, size, ip, match_len)) {
+        return false;
+      }
+      match_len += kMinMatch;
+      if (offset == 0 || offset > op || match_len > dst_size - op) {
+        return false;
+      }
+      uint8_t* out = dst + op;
+      const uint8_t* match = out - offset;
+      if (offset >= match_len) {
+        memcpy(out, match, (size_t)match_len);
+      } else {
+        // Overlapping match (a repeating pattern): copy forwards bytewise
+        for (uint64_t i = 0; i < match_len; i++) {
+          out[i] = match[i];
+        }
+      }
+      op += match_len;
+    }
+    return op == dst_size;
+  }
+
+}  // namespace jzmq
@@ -1,100 +1,515 @@
 #include <mutex>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <limits>
+#include <string.h>
 #include <assert.h>
 #include <zmq.h>
 #include "jzmq/connection.h"
+#include "jzmq/codec.h"
+#include "jzmq/metrics.h"
+#include "jzmq/shm_ring.h"
+#include "jzmq/thread_transport.h"
 #include "jtil/exceptions/wruntime_error.h"
 
 #define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
 #define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
 
+// Metrics hooks are guarded by JZMQ_METRICS_ON; compiled out it is a 
+// constant and the hooks disappear.
+#ifdef JZMQ_NO_METRICS
+  #define JZMQ_METRICS_ON false
+#else
+  #define JZMQ_METRICS_ON metrics_enabled_
+#endif
+
 namespace jzmq {
 
-  void* Connection::context_ = NULL;
+  std::atomic<void*> Connection::context_(NULL);
+  std::atomic<int64_t> Connection::context_refs_(0);
   std::mutex Connection::context_lck_;
-  std::atomic<int64_t> Connection::num_open_connections_ = 0;
+  ContextOptions Connection::context_options_;
+  const int Connection::kInterrupted;
 
   Connection::Connection(const std::string& conn_str, 
-    const SocketType type) {
+    const SocketType type, const ConnectionOptions& options) {
+    checkOptions(options);
     conn_str_ = conn_str;
     type_ = type;
     socket_ = NULL;
+    transport_ = NULL;
+    timeout_mode_ = PollTimeout;
+    rcv_timeout_ms_ = -1;
+    snd_timeout_ms_ = -1;
+    options_ = options;
+    codec_ = NULL;
+    codec_min_size_ = 0;
+    codec_max_size_ = 0;
+    metrics_.store(NULL);
+    metrics_enabled_ = false;
+    call_start_ns_ = 0;
+  }
+
+  Connection::Connection(Connection&& other) {
+    metrics_.store(NULL);
+    moveFrom(other);
+  }
+
+  Connection& Connection::operator=(Connection&& other) {
+    if (this != &other) {
+      closeSocket();
+      MetricsRecorder* metrics = metrics_.exchange(NULL);
+      SAFE_DELETE(metrics);
+      moveFrom(other);
+    }
+    return *this;
+  }
+
+  void Connection::moveFrom(Connection& other) {
+    conn_str_ = std::move(other.conn_str_);
+    type_ = other.type_;
+    socket_ = other.socket_;
+    other.socket_ = NULL;
+    transport_ = other.transport_;
+    other.transport_ = NULL;
+    timeout_mode_ = other.timeout_mode_;
+    rcv_timeout_ms_ = other.rcv_timeout_ms_;
+    snd_timeout_ms_ = other.snd_timeout_ms_;
+    other.rcv_timeout_ms_ = -1;
+    other.snd_timeout_ms_ = -1;
+    options_ = other.options_;
+    codec_ = other.codec_;
+    codec_min_size_ = other.codec_min_size_;
+    codec_max_size_ = other.codec_max_size_;
+    codec_buf_ = std::move(other.codec_buf_);
+    metrics_.store(other.metrics_.exchange(NULL));
+    metrics_enabled_ = other.metrics_enabled_;
+    other.metrics_enabled_ = false;
+    call_start_ns_ = other.call_start_ns_;
+    transport_parts_ = std::move(other.transport_parts_);
+  }
+
+  Connection::~Connection() {
+    MetricsRecorder* metrics = metrics_.load();
+    SAFE_DELETE(metrics);
+  }
+
+  // Throws unless min <= value <= max
+  static void checkRange(const int value, const int min, const int max,
+    const char* name) {
+    if (value < min || value > max) {
+      std::stringstream ss;
+      ss << "Connection::Connection() - ERROR: ConnectionOptions::" << name;
+      ss << " must be in [" << min << ", " << max << "] (got " << value;
+      ss << ")";
+      throw std::wruntime_error(ss.str());
+    }
+  }
+
+  void Connection::checkOptions(const ConnectionOptions& opts) {
+    const int max = std::numeric_limits<int>::max();
+    checkRange(opts.send_hwm, -1, max, "send_hwm");
+    checkRange(opts.receive_hwm, -1, max, "receive_hwm");
+    checkRange(opts.send_buffer, -1, max, "send_buffer");
+    checkRange(opts.receive_buffer, -1, max, "receive_buffer");
+    checkRange(opts.immediate, -1, 1, "immediate");
+    checkRange(opts.linger_ms, -1, max, "linger_ms");
+    checkRange(opts.tcp_keepalive, -1, 1, "tcp_keepalive");
+    checkRange(opts.tcp_keepalive_idle_s, -1, max, "tcp_keepalive_idle_s");
+    checkRange(opts.tcp_keepalive_count, -1, max, "tcp_keepalive_count");
+    checkRange(opts.tcp_keepalive_interval_s, -1, max, 
+      "tcp_keepalive_interval_s");
+    checkRange(opts.reconnect_interval_ms, -1, max, "reconnect_interval_ms");
+    checkRange(opts.reconnect_interval_max_ms, -1, max, 
+      "reconnect_interval_max_ms");
+    checkRange(opts.backlog, -1, max, "backlog");
+    checkRange(opts.conflate, -1, 1, "conflate");
+    if (opts.shm_ring_mb != -1) {
+      // Half the ring (the largest message) must fit the int return value
+      checkRange(opts.shm_ring_mb, 1, 4096, "shm_ring_mb");
+    }
+    // A maximum of 0 means "no backoff"; otherwise it must not be below the 
+    // initial interval (ZeroMQ silently ignores it if it is)
+    if (opts.reconnect_interval_ms >= 0 && opts.reconnect_interval_max_ms > 0
+      && opts.reconnect_interval_max_ms < opts.reconnect_interval_ms) {
+      throw std::wruntime_error("Connection::Connection() - ERROR: "
+        "ConnectionOptions::reconnect_interval_max_ms is smaller than "
+        "reconnect_interval_ms.");
+    }
   }
 
   void* Connection::initContext() {
-    if (context_ != NULL) {
-      // Context has already been initialized
-      return context_;
+    // Fast path: while another connection holds a reference the context 
+    // can't be destroyed, so just take one more.  The count only goes up 
+    // from 0 under context_lck_.
+    int64_t refs = context_refs_.load();
+    while (refs > 0) {
+      if (context_refs_.compare_exchange_weak(refs, refs + 1)) {
+        return context_.load();
+      }
     }
-    // Otherwise initilize the context 
     std::unique_lock<std::mutex> lck(context_lck_);
-    // Someone may have grabbed the lock and initialized the context while we
-    // were waiting for the lock.  Check again.
-    if (context_ != NULL) {
-      return context_;
-    }
-    // Context has not been initialized so create one.
-    context_ = zmq_ctx_new();
-    if (context_ == NULL) {
+    void* context = context_.load();
+    if (context == NULL) {
+      context = createContext();
+      context_.store(context);
+    }
+    context_refs_++;
+    return context;
+  }
+
+  void* Connection::createContext() {
+    // The options have to be set before the first socket is created (which
+    // starts the I/O threads), so don't publish the context until they are.
+    void* context = zmq_ctx_new();
+    if (context == NULL) {
       throwErrorMessage("Could not initialize zmq context");
     }
-    return context_;
+    try {
+      const ContextOptions& opts = context_options_;
+      if (opts.io_threads >= 0) {
+        setContextOption(context, ZMQ_IO_THREADS, opts.io_threads);
+      }
+      if (opts.max_sockets >= 0) {
+        setContextOption(context, ZMQ_MAX_SOCKETS, opts.max_sockets);
+      }
+#if defined(ZMQ_THREAD_SCHED_POLICY) && defined(ZMQ_THREAD_PRIORITY)
+      if (opts.thread_sched_policy >= 0) {
+        setContextOption(context, ZMQ_THREAD_SCHED_POLICY, 
+          opts.thread_sched_policy);
+      }
+      if (opts.thread_priority >= 0) {
+        setContextOption(context, ZMQ_THREAD_PRIORITY, opts.thread_priority);
+      }
+#else
+      if (opts.thread_sched_policy >= 0 || opts.thread_priority >= 0) {
+        throw std::wruntime_error("Connection::initContext() - ERROR: "
+          "I/O thread scheduling needs ZeroMQ 4.1 or later.");
+      }
+#endif
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+      for (uint32_t i = 0; i < opts.io_thread_cpus.size(); i++) {
+        setContextOption(context, ZMQ_THREAD_AFFINITY_CPU_ADD, 
+          opts.io_thread_cpus[i]);
+      }
+#else
+      if (opts.io_thread_cpus.size() > 0) {
+        throw std::wruntime_error("Connection::initContext() - ERROR: "
+          "I/O thread CPU affinity needs libzmq built with the draft API "
+          "(ZMQ_BUILD_DRAFT_API).");
+      }
+#endif
+    } catch (...) {
+      zmq_ctx_destroy(context);
+      throw;
+    }
+    return context;
+  }
+
+  void Connection::destroyContext() {
+    void* context = context_.exchange(NULL);
+    if (context != NULL) {
+      zmq_ctx_destroy(context);
+    }
+  }
+
+  void Connection::setContextOption(void* context, const int option, 
+    const int value) {
+    int rc = zmq_ctx_set(context, option, value);
+    if (rc != 0) {
+      std::stringstream ss;
+      ss << "Connection::initContext() - ERROR: Could not set context option ";
+      ss << option << " to " << value;
+      throwErrorMessage(ss.str());
+    }
+  }
+
+  void Connection::setContextOptions(const ContextOptions& options) {
+    std::unique_lock<std::mutex> lck(context_lck_);
+    if (context_refs_ > 0) {
+      throw std::wruntime_error("Connection::setContextOptions() - ERROR: "
+        "The context is in use.  Set the options before the first "
+        "initConn() (or after every connection has been killed).");
+    }
+    destroyContext();  // Kept alive with the old options
+    context_options_ = options;
+  }
+
+  void Connection::shutdownContext() {
+    std::unique_lock<std::mutex> lck(context_lck_);
+    if (context_refs_ > 0) {
+      throw std::wruntime_error("Connection::shutdownContext() - ERROR: "
+        "Kill every connection before shutting the context down.");
+    }
+    destroyContext();
+  }
+
+  bool Connection::contextExists() {
+    return context_.load() != NULL;
+  }
+
+  void Connection::setAffinity(const uint64_t io_thread_mask) {
+    if (socket_ != NULL) {
+      throw std::wruntime_error("Connection::setAffinity() - ERROR: "
+        "The affinity must be set before initConn().");
+    }
+    options_.affinity = io_thread_mask;
+  }
+
+  const ConnectionOptions& Connection::options() const {
+    return options_;
+  }
+
+  const std::string& Connection::connStr() const {
+    return conn_str_;
+  }
+
+  void Connection::setSocketOption(const int option, const int value,
+    const char* name) {
+    if (value < 0) {
+      return;  // Keep the default
+    }
+    int rc = zmq_setsockopt(socket_, option, &value, sizeof(value));
+    if (rc != 0) {
+      std::stringstream ss;
+      ss << "Connection::applySocketOptions() - ERROR: Could not set " << name;
+      ss << " to " << value;
+      throwErrorMessage(ss.str());
+    }
+  }
+
+  void Connection::applySocketOptions() {
+    const ConnectionOptions& opts = options_;
+    if (opts.affinity != 0) {
+      int rc = zmq_setsockopt(socket_, ZMQ_AFFINITY, &opts.affinity, 
+        sizeof(opts.affinity));
+      if (rc != 0) {
+        throwErrorMessage("Could not set socket affinity");
+      }
+    }
+    setSocketOption(ZMQ_SNDHWM, opts.send_hwm, "ZMQ_SNDHWM");
+    setSocketOption(ZMQ_RCVHWM, opts.receive_hwm, "ZMQ_RCVHWM");
+    setSocketOption(ZMQ_SNDBUF, opts.send_buffer, "ZMQ_SNDBUF");
+    setSocketOption(ZMQ_RCVBUF, opts.receive_buffer, "ZMQ_RCVBUF");
+    setSocketOption(ZMQ_IMMEDIATE, opts.immediate, "ZMQ_IMMEDIATE");
+    setSocketOption(ZMQ_LINGER, opts.linger_ms, "ZMQ_LINGER");
+    setSocketOption(ZMQ_TCP_KEEPALIVE, opts.tcp_keepalive, 
+      "ZMQ_TCP_KEEPALIVE");
+    setSocketOption(ZMQ_TCP_KEEPALIVE_IDLE, opts.tcp_keepalive_idle_s,
+      "ZMQ_TCP_KEEPALIVE_IDLE");
+    setSocketOption(ZMQ_TCP_KEEPALIVE_CNT, opts.tcp_keepalive_count,
+      "ZMQ_TCP_KEEPALIVE_CNT");
+    setSocketOption(ZMQ_TCP_KEEPALIVE_INTVL, opts.tcp_keepalive_interval_s,
+      "ZMQ_TCP_KEEPALIVE_INTVL");
+    setSocketOption(ZMQ_RECONNECT_IVL, opts.reconnect_interval_ms,
+      "ZMQ_RECONNECT_IVL");
+    setSocketOption(ZMQ_RECONNECT_IVL_MAX, opts.reconnect_interval_max_ms,
+      "ZMQ_RECONNECT_IVL_MAX");
+    setSocketOption(ZMQ_BACKLOG, opts.backlog, "ZMQ_BACKLOG");
+#ifdef ZMQ_CONFLATE
+    setSocketOption(ZMQ_CONFLATE, opts.conflate, "ZMQ_CONFLATE");
+#else
+    if (opts.conflate >= 0) {
+      throw std::wruntime_error("Connection::applySocketOptions() - ERROR: "
+        "ZMQ_CONFLATE needs ZeroMQ 4.0 or later.");
+    }
+#endif
   }
 
   void Connection::throwErrorMessage(const std::string& err_msg) {
+    throw std::wruntime_error(errorMessage(err_msg));
+  }
+
+  std::string Connection::errorMessage(const std::string& err_msg) {
     int rc = zmq_errno();
     std::stringstream ss;
     ss << err_msg << " (zmqerr[" << rc << "]=" << zmq_strerror(rc) << ")";
-    throw std::wruntime_error(ss.str());
+    return ss.str();
+  }
+
+  void Connection::closeAndThrow(const std::string& err_msg) {
+    const std::string msg = errorMessage(err_msg);  // Before zmq_close
+    closeSocket();
+    throw std::wruntime_error(msg);
   }
 
   void Connection::killContext() {
-    if (context_ == NULL || num_open_connections_ > 0) {
-      // Context has already been destroyed OR there are still open connections
-      return;
+    if (context_refs_.fetch_sub(1) > 1) {
+      return;  // There are still open connections
     }
-    // Otherwise destroy the context 
     std::unique_lock<std::mutex> lck(context_lck_);
-    // Someone may have grabbed the lock and destroyed the context while we
-    // were waiting for the lock.  Check again.
-    if (context_ == NULL) {
-      return;
+    // Someone may have opened a connection while we were waiting for the 
+    // lock.  Check again.
+    if (context_refs_ == 0 && !context_options_.keep_alive) {
+      destroyContext();
     }
-    // Otherwise Kill the context
-    zmq_ctx_destroy(context_);
-    context_ = NULL;
   }
 
   int Connection::receiveData(char* buff, const uint64_t buff_size, 
     const int timout_ms) {
+    Message msg;
+    int rc = receiveMessage(msg, timout_ms);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    // Truncate the message into the user's buffer if it doesn't fit
+    uint64_t size = msg.size();
+    if (JZMQ_METRICS_ON && size > buff_size) {
+      metrics_.load(std::memory_order_relaxed)->recordTruncated();
+    }
+    memcpy(buff, msg.data(), (size_t)std::min<uint64_t>(size, buff_size));
+    return (int)size;
+  }
+
+  int Connection::receiveMessage(Message& msg, const int timout_ms) {
     if (type_ == PublisherType) {
       throw std::wruntime_error("Connection::receive() - ERROR: "
         "A Publisher is trying to receive data (they can only send data).");
     }
 
-    // Poll the socket for a reply, with timeout.  If ZMQ_POLLIN is in the
-    // revent, then we're gaurenteed at least one message may be receive
-    // without blocking.
-    zmq_pollitem_t items [] = {{socket_, 0, ZMQ_POLLIN, 0}};
-    int rc = zmq_poll(items, 1, timout_ms);
-    if (rc == -1) {
-      // Interrupt received
+    if (transport_ != NULL) {
+      int rc = receiveTransport(transport_parts_, timout_ms);
+      if (rc <= 0) {
+        return rc;  // Timeout
+      }
+      msg = std::move(transport_parts_[0]);
+      transport_parts_.clear();  // Releases the trailing frames
+      if (codec_ != NULL) {
+        decodeFrame(msg);
+      }
+      return 1;
+    }
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLIN, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    rc = zmq_msg_recv(static_cast<zmq_msg_t*>(msg.zmqMsg()), socket_, flags);
+    if (rc < 0) {
+      return handleSocketError("Error receiving data on Socket.");
+    }
+    // Drop the trailing frames of a multi-part message so the next receive
+    // starts on a message boundary (a REP socket also needs the whole 
+    // request read before it will accept the reply).
+    if (msg.more()) {
+      discardRemainingFrames();
+    }
+    if (JZMQ_METRICS_ON) {
+      recordReceive(1, rc);
+    }
+    if (codec_ != NULL) {
+      decodeFrame(msg);
+    }
+    return 1;
+  }
+
+  int Connection::receiveMultipart(std::vector<Message>& parts, 
+    const int timout_ms) {
+    if (type_ == PublisherType) {
+      throw std::wruntime_error("Connection::receiveMultipart() - ERROR: "
+        "A Publisher is trying to receive data (they can only send data).");
+    }
+    parts.clear();
+    if (transport_ != NULL) {
+      return receiveTransport(parts, timout_ms);
+    }
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLIN, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    // ZeroMQ delivers multi-part messages atomically, so once the first frame
+    // is available the rest can be read without blocking.
+    do {
+      parts.push_back(Message());
+      rc = zmq_msg_recv(static_cast<zmq_msg_t*>(parts.back().zmqMsg()), 
+        socket_, flags);
+      if (rc < 0) {
+        parts.clear();
+        return handleSocketError("Error receiving data on Socket.");
+      }
+      flags = 0;
+    } while (parts.back().more());
+    if (JZMQ_METRICS_ON) {
+      uint64_t n_bytes = 0;
+      for (size_t i = 0; i < parts.size(); i++) {
+        n_bytes += parts[i].size();
+      }
+      recordReceive(1, n_bytes);
+    }
+    return (int)parts.size();
+  }
+
+  int Connection::receiveBatch(Message* slots, const uint32_t max_msgs, 
+    const int timout_ms) {
+    if (type_ == PublisherType) {
+      throw std::wruntime_error("Connection::receiveBatch() - ERROR: "
+        "A Publisher is trying to receive data (they can only send data).");
+    }
+    if (transport_ != NULL) {
+      throw std::wruntime_error("Connection::receiveBatch() - ERROR: "
+        "Not supported on shm:// and thread:// connections.");
+    }
+    if (max_msgs == 0) {
       return 0;
     }
+    const uint32_t batch_size = isLockstep() ? 1 : max_msgs;
 
-    if (items[0].revents & ZMQ_POLLIN) {
-      int rc = zmq_recv(socket_, buff, buff_size, 0);
-      if (rc >= 0) {
-        return rc;
-      } else {
-        rc = zmq_errno();
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLIN, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    uint32_t n_msgs = 0;
+    while (n_msgs < batch_size) {
+      rc = zmq_msg_recv(static_cast<zmq_msg_t*>(slots[n_msgs].zmqMsg()), 
+        socket_, flags);
+      if (rc < 0) {
+        if (n_msgs > 0 && (zmq_errno() == EAGAIN || zmq_errno() == EFSM)) {
+          break;  // The queue has been drained (or it is our turn to send)
+        }
+        rc = handleSocketError("Error receiving data on Socket.");
+        return n_msgs > 0 ? (int)n_msgs : rc;
       }
-      std::stringstream ss;
-      ss << "Error receiving data on Socket.  " << zmq_strerror(rc);
-      throw std::wruntime_error(ss.str());
+      if (slots[n_msgs].more()) {
+        discardRemainingFrames();
+      }
+      n_msgs++;
+      // Only the first receive may block
+      flags = ZMQ_DONTWAIT;
+    }
+    if (JZMQ_METRICS_ON) {
+      uint64_t n_bytes = 0;
+      for (uint32_t i = 0; i < n_msgs; i++) {
+        n_bytes += slots[i].size();
+      }
+      recordReceive(n_msgs, n_bytes);
     }
-    return 0;
+    return (int)n_msgs;
+  }
+
+  bool Connection::isLockstep() const {
+    int type = 0;
+    size_t size = sizeof(type);
+    if (zmq_getsockopt(socket_, ZMQ_TYPE, &type, &size) != 0) {
+      return false;
+    }
+    return type == ZMQ_REQ || type == ZMQ_REP;
+  }
+
+  void Connection::discardRemainingFrames() {
+    Message frame;
+    do {
+      int rc = zmq_msg_recv(static_cast<zmq_msg_t*>(frame.zmqMsg()), socket_,
+        0);
+      if (rc < 0) {
+        throwErrorMessage("Connection::receive() - ERROR: "
+          "Could not discard multi-part frame");
+      }
+    } while (frame.more());
   }
 
   int Connection::sendData(char* buff, const uint64_t buff_size, 
@@ -103,28 +518,474 @@ namespace jzmq {
       throw std::wruntime_error("Connection::sendData() - ERROR: "
         "A Subscriber is trying to send data (they can only receive data).");
     }
-    // Poll the socket for an empty queue, with timeout.  If ZMQ_POLLOUT is in 
-    // the revent, then we're gaurenteed at least one message may be sent
-    // without blocking.
-    zmq_pollitem_t items [] = {{socket_, 0, ZMQ_POLLOUT, 0}};
-    int rc = zmq_poll(items, 1, timout_ms);
-    if (rc == -1) {
-      // Interrupt received
-      return 0;
+    if (codec_ != NULL) {
+      Message frame;
+      encodeFrame(buff, buff_size, frame);
+      int rc = sendFrame(frame, timout_ms);
+      return rc > 0 ? (int)buff_size : rc;
+    }
+    if (transport_ != NULL) {
+      DataBuffer part = {buff, buff_size};
+      return sendTransport(&part, 1, timout_ms);
+    }
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLOUT, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
     }
+    rc = zmq_send(socket_, buff, (size_t)buff_size, flags);
+    if (rc < 0) {
+      return handleSocketError("Error sending data on Socket.");
+    }
+    if (JZMQ_METRICS_ON) {
+      recordSend(1, rc);
+    }
+    return rc;
+  }
+
+  int Connection::sendData(char* buff, const uint64_t buff_size, 
+    FreeFunc* free_func, void* hint, const int timout_ms) {
+    // From here on ZeroMQ owns the buffer and will call free_func when the
+    // message is closed (by the I/O thread, or when msg goes out of scope if
+    // it could not be queued).
+    Message msg(buff, buff_size, free_func, hint);
+    return sendMessage(msg, timout_ms);
+  }
+
+  static void deleteArrayFreeFunc(void* data, void* hint) {
+    delete[] static_cast<char*>(data);
+  }
 
-    if (items[0].revents & ZMQ_POLLOUT) {
-      int rc = zmq_send(socket_, buff, buff_size, 0);
-      if (rc >= 0) {
+  int Connection::sendDataOwned(char* buff, const uint64_t buff_size, 
+    const int timout_ms) {
+    return sendData(buff, buff_size, deleteArrayFreeFunc, NULL, timout_ms);
+  }
+
+  int Connection::sendMessage(Message& msg, const int timout_ms) {
+    if (codec_ != NULL) {
+      Message frame;
+      encodeFrame(msg.data(), msg.size(), frame);
+      int rc = sendFrame(frame, timout_ms);
+      if (rc <= 0) {
         return rc;
+      }
+      const uint64_t size = msg.size();
+      msg = Message();  // Sent: leave it empty as without a codec
+      return (int)size;
+    }
+    return sendFrame(msg, timout_ms);
+  }
+
+  int Connection::sendFrame(Message& msg, const int timout_ms) {
+    if (type_ == SubscriberType) {
+      throw std::wruntime_error("Connection::sendData() - ERROR: "
+        "A Subscriber is trying to send data (they can only receive data).");
+    }
+    if (transport_ != NULL) {
+      transport_parts_.clear();
+      transport_parts_.push_back(std::move(msg));
+      int rc = sendTransport(transport_parts_, timout_ms);
+      if (rc <= 0) {
+        msg = std::move(transport_parts_[0]);  // Not sent: give it back
+      }
+      transport_parts_.clear();
+      return rc;
+    }
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLOUT, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    rc = zmq_msg_send(static_cast<zmq_msg_t*>(msg.zmqMsg()), socket_, flags);
+    if (rc < 0) {
+      return handleSocketError("Error sending data on Socket.");
+    }
+    if (JZMQ_METRICS_ON) {
+      recordSend(1, rc);
+    }
+    return rc;
+  }
+
+  int Connection::sendMultipart(const DataBuffer* parts, 
+    const uint32_t n_parts, const int timout_ms) {
+    if (type_ == SubscriberType) {
+      throw std::wruntime_error("Connection::sendMultipart() - ERROR: "
+        "A Subscriber is trying to send data (they can only receive data).");
+    }
+    if (n_parts == 0) {
+      throw std::wruntime_error("Connection::sendMultipart() - ERROR: "
+        "A message must have at least one part.");
+    }
+    if (transport_ != NULL) {
+      return sendTransport(parts, n_parts, timout_ms);
+    }
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLOUT, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    // Once the first frame is accepted the high water mark is not checked 
+    // again until the last frame, so the remaining frames cannot block.
+    int bytes_sent = 0;
+    for (uint32_t i = 0; i < n_parts; i++) {
+      if (i + 1 < n_parts) {
+        flags |= ZMQ_SNDMORE;
+      }
+      rc = zmq_send(socket_, parts[i].data, (size_t)parts[i].size, flags);
+      if (rc < 0) {
+        return handleSocketError("Error sending data on Socket.");
+      }
+      bytes_sent += rc;
+      flags = 0;
+    }
+    if (JZMQ_METRICS_ON) {
+      recordSend(1, bytes_sent);
+    }
+    return bytes_sent;
+  }
+
+  int Connection::sendMultipart(std::vector<Message>& parts, 
+    const int timout_ms) {
+    if (type_ == SubscriberType) {
+      throw std::wruntime_error("Connection::sendMultipart() - ERROR: "
+        "A Subscriber is trying to send data (they can only receive data).");
+    }
+    if (parts.size() == 0) {
+      throw std::wruntime_error("Connection::sendMultipart() - ERROR: "
+        "A message must have at least one part.");
+    }
+    if (transport_ != NULL) {
+      return sendTransport(parts, timout_ms);
+    }
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLOUT, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    int bytes_sent = 0;
+    for (size_t i = 0; i < parts.size(); i++) {
+      if (i + 1 < parts.size()) {
+        flags |= ZMQ_SNDMORE;
+      }
+      rc = zmq_msg_send(static_cast<zmq_msg_t*>(parts[i].zmqMsg()), socket_,
+        flags);
+      if (rc < 0) {
+        return handleSocketError("Error sending data on Socket.");
+      }
+      bytes_sent += rc;
+      flags = 0;
+    }
+    if (JZMQ_METRICS_ON) {
+      recordSend(1, bytes_sent);
+    }
+    return bytes_sent;
+  }
+
+  int Connection::sendBatch(Message* msgs, const uint32_t n_msgs, 
+    const int timout_ms) {
+    if (type_ == SubscriberType) {
+      throw std::wruntime_error("Connection::sendBatch() - ERROR: "
+        "A Subscriber is trying to send data (they can only receive data).");
+    }
+    if (transport_ != NULL) {
+      throw std::wruntime_error("Connection::sendBatch() - ERROR: "
+        "Not supported on shm:// and thread:// connections.");
+    }
+    if (n_msgs == 0) {
+      return 0;
+    }
+    const uint32_t batch_size = isLockstep() ? 1 : n_msgs;
+
+    int flags;
+    int rc = waitForSocket(ZMQ_POLLOUT, timout_ms, flags);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    uint32_t n_sent = 0;
+    uint64_t n_bytes = 0;
+    while (n_sent < batch_size) {
+      rc = zmq_msg_send(static_cast<zmq_msg_t*>(msgs[n_sent].zmqMsg()), 
+        socket_, flags);
+      if (rc < 0) {
+        if (n_sent > 0 && (zmq_errno() == EAGAIN || zmq_errno() == EFSM)) {
+          break;  // High water mark reached (or it is our turn to receive)
+        }
+        rc = handleSocketError("Error sending data on Socket.");
+        if (n_sent > 0 && JZMQ_METRICS_ON) {
+          recordSend(n_sent, n_bytes);
+        }
+        return n_sent > 0 ? (int)n_sent : rc;
+      }
+      n_bytes += rc;
+      n_sent++;
+      // Only the first send may block
+      flags = ZMQ_DONTWAIT;
+    }
+    if (JZMQ_METRICS_ON) {
+      recordSend(n_sent, n_bytes);
+    }
+    return (int)n_sent;
+  }
+
+  int Connection::sendTransport(const DataBuffer* parts, 
+    const uint32_t n_parts, const int timout_ms) {
+    if (JZMQ_METRICS_ON) {
+      call_start_ns_ = MetricsRecorder::nowNs();
+    }
+    return recordTransportSend(transport_->send(parts, n_parts, timout_ms));
+  }
+
+  int Connection::sendTransport(std::vector<Message>& parts, 
+    const int timout_ms) {
+    if (JZMQ_METRICS_ON) {
+      call_start_ns_ = MetricsRecorder::nowNs();
+    }
+    return recordTransportSend(transport_->send(parts, timout_ms));
+  }
+
+  int Connection::recordTransportSend(const int rc) {
+    if (JZMQ_METRICS_ON) {
+      if (rc > 0) {
+        recordSend(1, rc);
       } else {
-        rc = zmq_errno();
+        metrics_.load(std::memory_order_relaxed)->recordBlocked(
+          MetricsRecorder::nowNs() - call_start_ns_, true);
       }
+    }
+    return rc;
+  }
+
+  int Connection::receiveTransport(std::vector<Message>& parts, 
+    const int timout_ms) {
+    if (JZMQ_METRICS_ON) {
+      call_start_ns_ = MetricsRecorder::nowNs();
+    }
+    int rc = transport_->receive(parts, timout_ms);
+    if (JZMQ_METRICS_ON) {
+      if (rc > 0) {
+        uint64_t n_bytes = 0;
+        for (size_t i = 0; i < parts.size(); i++) {
+          n_bytes += parts[i].size();
+        }
+        recordReceive(1, n_bytes);
+      } else {
+        metrics_.load(std::memory_order_relaxed)->recordBlocked(
+          MetricsRecorder::nowNs() - call_start_ns_, true);
+      }
+    }
+    return rc;
+  }
+
+  void Connection::setTimeoutMode(const TimeoutMode mode) {
+    timeout_mode_ = mode;
+  }
+
+  // Prepended to every frame sent with a codec
+  struct CodecFrameHeader {
+    uint8_t encoded;  // 1 if the body went through the codec
+    uint8_t reserved[3];
+    uint32_t raw_size;
+  };
+
+  void Connection::setMetricsEnabled(const bool enabled) {
+#ifdef JZMQ_NO_METRICS
+    (void)enabled;
+#else
+    if (enabled && metrics_.load() == NULL) {
+      metrics_.store(new MetricsRecorder());
+    }
+    metrics_enabled_ = enabled;
+#endif
+  }
+
+  bool Connection::metrics(ConnectionMetrics& snapshot) const {
+    MetricsRecorder* metrics = metrics_.load();
+    if (metrics == NULL) {
+      return false;
+    }
+    metrics->snapshot(snapshot);
+    return true;
+  }
+
+  void Connection::recordSend(const uint64_t n_msgs, const uint64_t n_bytes) {
+    metrics_.load(std::memory_order_relaxed)->recordSend(n_msgs, n_bytes,
+      MetricsRecorder::nowNs() - call_start_ns_);
+  }
+
+  void Connection::recordReceive(const uint64_t n_msgs, 
+    const uint64_t n_bytes) {
+    metrics_.load(std::memory_order_relaxed)->recordReceive(n_msgs, n_bytes,
+      MetricsRecorder::nowNs() - call_start_ns_);
+  }
+
+  void Connection::setCodec(Codec* codec, const uint64_t min_size,
+    const uint64_t max_size) {
+    codec_ = codec;
+    codec_min_size_ = min_size;
+    codec_max_size_ = max_size;
+  }
+
+  void Connection::encodeFrame(const char* data, const uint64_t size, 
+    Message& frame) {
+    if (size > 0xffffffff) {
+      throw std::wruntime_error("Connection::encodeFrame() - ERROR: "
+        "Messages sent with a codec must be smaller than 4GB.");
+    }
+    CodecFrameHeader header = {0, {0, 0, 0}, (uint32_t)size};
+    const char* body = data;
+    uint64_t body_size = size;
+    if (size >= codec_min_size_ && size > 0) {
+      if (codec_buf_.size() < size) {
+        codec_buf_.resize((size_t)size);
+      }
+      const uint64_t n = codec_->encode(data, size, &codec_buf_[0]);
+      if (n > 0 && n < size) {
+        header.encoded = 1;
+        body = &codec_buf_[0];
+        body_size = n;
+      }
+    }
+    frame = Message(sizeof(header) + body_size);
+    memcpy(frame.data(), &header, sizeof(header));
+    memcpy(frame.data() + sizeof(header), body, (size_t)body_size);
+  }
+
+  void Connection::decodeFrame(Message& frame) {
+    CodecFrameHeader header;
+    if (frame.size() < sizeof(header)) {
+      throw std::wruntime_error("Connection::decodeFrame() - ERROR: "
+        "Frame is too short for a codec header (is the codec set on both "
+        "ends?).");
+    }
+    memcpy(&header, frame.data(), sizeof(header));
+    const char* body = frame.data() + sizeof(header);
+    const uint64_t body_size = frame.size() - sizeof(header);
+    // Check the header before allocating what it asks for
+    if ((header.encoded == 0 && body_size != header.raw_size) ||
+      header.encoded > 1) {
+      throw std::wruntime_error("Connection::decodeFrame() - ERROR: "
+        "Corrupt codec header.");
+    }
+    if (header.raw_size > codec_max_size_) {
       std::stringstream ss;
-      ss << "Error sending data on Socket.  " << zmq_strerror(rc);
+      ss << "Connection::decodeFrame() - ERROR: A " << header.raw_size;
+      ss << " byte frame is larger than the codec maximum of ";
+      ss << codec_max_size_ << " bytes (see setCodec).";
       throw std::wruntime_error(ss.str());
     }
-    return 0;
+    Message raw(header.raw_size);
+    if (header.encoded == 0) {
+      memcpy(raw.data(), body, (size_t)body_size);
+    } else {
+      codec_->decode(body, body_size, raw.data(), header.raw_size);
+    }
+    frame = std::move(raw);
+  }
+
+  int Connection::waitForSocket(const int events, const int timout_ms, 
+    int& flags) {
+    flags = 0;
+    if (JZMQ_METRICS_ON) {
+      call_start_ns_ = MetricsRecorder::nowNs();
+    }
+    if (timeout_mode_ == SocketTimeout) {
+      // No poll: non-blocking calls use ZMQ_DONTWAIT and blocking calls rely
+      // on the socket's own timeout, which is only updated when it changes.
+      if (timout_ms == 0) {
+        flags = ZMQ_DONTWAIT;
+        return 1;
+      }
+      const int option = (events == ZMQ_POLLIN) ? ZMQ_RCVTIMEO : ZMQ_SNDTIMEO;
+      int& cached_ms = (events == ZMQ_POLLIN) ? rcv_timeout_ms_ : 
+        snd_timeout_ms_;
+      if (cached_ms != timout_ms) {
+        int rc = zmq_setsockopt(socket_, option, &timout_ms, 
+          sizeof(timout_ms));
+        if (rc != 0) {
+          throwErrorMessage("Could not set socket timeout");
+        }
+        cached_ms = timout_ms;
+      }
+      return 1;
+    }
+
+    // Poll the socket with timeout.  If the event is in the revent, then 
+    // we're gaurenteed at least one message may be sent or received without
+    // blocking.
+    zmq_pollitem_t items [] = {{socket_, 0, (short)events, 0}};
+    int rc = zmq_poll(items, 1, timout_ms);
+    if (rc == -1) {
+      if (zmq_errno() == EINTR) {
+        return kInterrupted;
+      }
+      throwErrorMessage("Error polling Socket.");
+    }
+    const bool ready = (items[0].revents & events) != 0;
+    if (JZMQ_METRICS_ON) {
+      metrics_.load(std::memory_order_relaxed)->recordBlocked(
+        MetricsRecorder::nowNs() - call_start_ns_, !ready);
+    }
+    return ready ? 1 : 0;
+  }
+
+  int Connection::handleSocketError(const std::string& err_msg) {
+    int rc = zmq_errno();
+    if (rc == EAGAIN) {
+      if (JZMQ_METRICS_ON) {
+        metrics_.load(std::memory_order_relaxed)->recordWouldBlock();
+      }
+      return 0;  // ZMQ_DONTWAIT or the socket timeout expired
+    } else if (rc == EINTR) {
+      if (JZMQ_METRICS_ON) {
+        metrics_.load(std::memory_order_relaxed)->recordInterrupt();
+      }
+      return kInterrupted;
+    }
+    std::stringstream ss;
+    ss << err_msg << "  " << zmq_strerror(rc);
+    throw std::wruntime_error(ss.str());
+  }
+
+  void* Connection::zmqMsg(Message& msg) {
+    return msg.zmqMsg();
+  }
+
+  void Connection::initShm(const std::string& name, const bool writer) {
+    const uint64_t size = options_.shm_ring_mb > 0 ? 
+      (uint64_t)options_.shm_ring_mb * 1024 * 1024 : ShmRing::kDefaultSize;
+    try {
+      transport_ = new ShmChannel(name, 
+        writer ? ShmRing::Writer : ShmRing::Reader, socket_, size);
+    } catch (...) {
+      closeSocket();
+      throw;
+    }
+  }
+
+  bool Connection::initThreadTransport() {
+    const std::string name = ThreadTransport::threadName(conn_str_);
+    if (name.empty()) {
+      return false;
+    }
+    transport_ = new ThreadTransport(name, type_, options_.receive_hwm);
+    return true;
+  }
+
+  void Connection::closeSocket() {
+    SAFE_DELETE(transport_);
+    transport_parts_.clear();
+    if (socket_ == NULL) {
+      return;  // thread:// connections have no socket (or context)
+    }
+    zmq_close(socket_);
+    socket_ = NULL;
+    rcv_timeout_ms_ = -1;
+    snd_timeout_ms_ = -1;
+    killContext();
   }
 
   void Connection::setSendHighWaterMark(const int n_messages) {
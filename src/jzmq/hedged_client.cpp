@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <iostream>
+#include "jzmq/hedged_client.h"
+#include "jzmq/async_client.h"
+#include "jzmq/poller.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  // The hedge delay is recomputed from the histograms every this many
+  // replies (a percentile is a scan of every bucket).
+  static const uint64_t hedge_delay_interval = 16;
+
+  struct HedgedReplica {
+    AsyncClient* client;
+    AsyncClient::Callback callback;  // Calls HedgedClient::onReply
+    LatencyHistogram latency_ns[2];  // The current and the previous window
+    uint32_t current;  // Index of the current window
+    uint32_t n_current;  // Replies in the current window
+    uint64_t n_replies;
+    double smoothed_ns;  // 0 until the first reply
+    int hedge_delay_ms;
+    uint64_t request_id;  // Copy of the request in progress (0 if none)
+    uint64_t sent_ns;
+  };
+
+  HedgedClient::HedgedClient(const std::vector<std::string>& replicas,
+    const HedgeOptions& options) {
+    if (replicas.size() == 0) {
+      throw std::wruntime_error("HedgedClient::HedgedClient() - ERROR: "
+        "At least one replica is needed.");
+    }
+    if (options.hedge_percentile <= 0 || options.hedge_percentile > 1 ||
+      options.latency_window == 0) {
+      throw std::wruntime_error("HedgedClient::HedgedClient() - ERROR: "
+        "hedge_percentile must be in (0, 1] and latency_window at least 1.");
+    }
+    options_ = options;
+    poller_ = NULL;
+    reply_ = NULL;
+    winner_ = -1;
+    num_requests_ = 0;
+    num_hedged_ = 0;
+    num_hedge_wins_ = 0;
+    for (uint32_t i = 0; i < replicas.size(); i++) {
+      HedgedReplica* replica = new HedgedReplica();
+      // Cancelled copies leave the window, so one slot is enough
+      replica->client = new AsyncClient(replicas[i], 1,
+        options.connection_options);
+      replica->callback = [this, i](const uint64_t,
+        std::vector<Message>& frames) {
+        onReply(i, frames);
+      };
+      replica->current = 0;
+      replica->n_current = 0;
+      replica->n_replies = 0;
+      replica->smoothed_ns = 0;
+      replica->hedge_delay_ms = options.initial_hedge_delay_ms;
+      replica->request_id = 0;
+      replica->sent_ns = 0;
+      replicas_.push_back(replica);
+    }
+  }
+
+  HedgedClient::~HedgedClient() {
+    if (poller_ != NULL) {
+      killConn();
+    }
+    for (uint32_t i = 0; i < replicas_.size(); i++) {
+      SAFE_DELETE(replicas_[i]->client);
+      SAFE_DELETE(replicas_[i]);
+    }
+  }
+
+  void HedgedClient::initConn() {
+    if (poller_ != NULL) {
+      throw std::wruntime_error("HedgedClient::initConn() - ERROR: "
+        "connection already initialized.");
+    }
+    for (uint32_t i = 0; i < replicas_.size(); i++) {
+      try {
+        replicas_[i]->client->initConn();
+      } catch (...) {
+        for (uint32_t j = 0; j < i; j++) {
+          replicas_[j]->client->killConn();
+        }
+        throw;
+      }
+    }
+    poller_ = new Poller();
+    for (uint32_t i = 0; i < replicas_.size(); i++) {
+      AsyncClient* client = replicas_[i]->client;
+      poller_->add(*client, Poller::ReadEvent, [client](Connection&,
+        const int) {
+        client->processReplies(0);  // Drops the late copies
+      });
+    }
+  }
+
+  void HedgedClient::killConn() {
+    if (poller_ == NULL) {
+      throw std::wruntime_error("HedgedClient::killConn() - ERROR: "
+        "Socket has not been initialized!");
+    }
+    SAFE_DELETE(poller_);
+    for (uint32_t i = 0; i < replicas_.size(); i++) {
+      replicas_[i]->client->killConn();
+      replicas_[i]->request_id = 0;
+    }
+  }
+
+  int HedgedClient::request(const char* data, const uint64_t size,
+    Message& reply, const int timout_ms) {
+    DataBuffer part = {data, size};
+    int rc = request(&part, 1, frames_, timout_ms);
+    if (rc > 0) {
+      reply = std::move(frames_[0]);
+    }
+    return rc;
+  }
+
+  int HedgedClient::request(const DataBuffer* parts, const uint32_t n_parts,
+    std::vector<Message>& reply, const int timout_ms) {
+    if (poller_ == NULL) {
+      throw std::wruntime_error("HedgedClient::request() - ERROR: "
+        "Socket has not been initialized!");
+    }
+    num_requests_++;
+    reply_ = &reply;
+    winner_ = -1;
+    const uint64_t start_ns = MetricsRecorder::nowNs();
+    const uint64_t deadline_ns = start_ns + (uint64_t)timout_ms * 1000000;
+
+    const uint32_t primary = pickReplica(-1);
+    int hedge = -1;
+    uint32_t n_in_flight = sendTo(primary, parts, n_parts) ? 1 : 0;
+    // Hedge straight away if the primary couldn't take the request
+    const uint64_t hedge_ns = n_in_flight == 0 ? start_ns : start_ns +
+      (uint64_t)replicas_[primary]->hedge_delay_ms * 1000000;
+    const bool can_hedge = replicas_.size() > 1;
+
+    int rc = 0;
+    while (winner_ < 0) {
+      const uint64_t now_ns = MetricsRecorder::nowNs();
+      if (can_hedge && hedge < 0 && now_ns >= hedge_ns) {
+        hedge = (int)pickReplica(primary);
+        num_hedged_++;
+        if (sendTo(hedge, parts, n_parts)) {
+          n_in_flight++;
+        }
+        continue;
+      }
+      if (n_in_flight == 0 && (!can_hedge || hedge >= 0)) {
+        break;  // Nothing can answer
+      }
+      if (timout_ms >= 0 && now_ns >= deadline_ns) {
+        break;
+      }
+      // Wait for a reply, the hedge or the deadline (whichever is first)
+      uint64_t wake_ns = 0;
+      if (can_hedge && hedge < 0) {
+        wake_ns = hedge_ns;
+      }
+      if (timout_ms >= 0 && (wake_ns == 0 || deadline_ns < wake_ns)) {
+        wake_ns = deadline_ns;
+      }
+      const int wait_ms = wake_ns == 0 ? -1 :
+        (int)((wake_ns - now_ns + 999999) / 1000000);
+      rc = poller_->poll(wait_ms);
+      if (rc == Connection::kInterrupted) {
+        break;
+      }
+    }
+
+    // Cancel the copies that didn't answer
+    const uint64_t now_ns = MetricsRecorder::nowNs();
+    for (uint32_t i = 0; i < replicas_.size(); i++) {
+      HedgedReplica& replica = *replicas_[i];
+      if (replica.request_id != 0) {
+        replica.client->cancelRequest(replica.request_id);
+        replica.request_id = 0;
+        chargeLoser(i, now_ns);
+      }
+    }
+    reply_ = NULL;
+    if (winner_ < 0) {
+      return rc == Connection::kInterrupted ? rc : 0;
+    }
+    if (winner_ == hedge) {
+      num_hedge_wins_++;
+    }
+    return (int)reply.size();
+  }
+
+  uint32_t HedgedClient::pickReplica(const int exclude) const {
+    int best = -1;
+    for (uint32_t i = 0; i < replicas_.size(); i++) {
+      if ((int)i == exclude) {
+        continue;
+      }
+      if (best < 0 ||
+        replicas_[i]->smoothed_ns < replicas_[best]->smoothed_ns) {
+        best = i;
+      }
+    }
+    return (uint32_t)best;
+  }
+
+  bool HedgedClient::sendTo(const uint32_t replica, const DataBuffer* parts,
+    const uint32_t n_parts) {
+    HedgedReplica& r = *replicas_[replica];
+    r.sent_ns = MetricsRecorder::nowNs();
+    r.request_id = r.client->sendRequest(parts, n_parts, r.callback, 0);
+    return r.request_id != 0;
+  }
+
+  void HedgedClient::onReply(const uint32_t replica,
+    std::vector<Message>& frames) {
+    HedgedReplica& r = *replicas_[replica];
+    r.request_id = 0;
+    const uint64_t latency_ns = MetricsRecorder::nowNs() - r.sent_ns;
+    if (r.n_current >= options_.latency_window) {
+      r.current ^= 1;  // The previous window is forgotten
+      r.latency_ns[r.current].reset();
+      r.n_current = 0;
+    }
+    r.latency_ns[r.current].record(latency_ns);
+    r.n_current++;
+    r.n_replies++;
+    // Smoothed like TCP's round trip time estimate (gain 1/8)
+    r.smoothed_ns = r.smoothed_ns == 0 ? (double)latency_ns :
+      r.smoothed_ns + ((double)latency_ns - r.smoothed_ns) / 8;
+    if (r.n_replies <= options_.min_samples ||
+      r.n_replies % hedge_delay_interval == 0) {
+      updateHedgeDelay(r);
+    }
+    if (winner_ < 0) {
+      winner_ = (int)replica;
+      reply_->swap(frames);
+    }
+  }
+
+  void HedgedClient::chargeLoser(const uint32_t replica,
+    const uint64_t now_ns) {
+    // The reply would have taken at least this long
+    HedgedReplica& r = *replicas_[replica];
+    const double elapsed_ns = (double)(now_ns - r.sent_ns);
+    if (elapsed_ns > r.smoothed_ns) {
+      r.smoothed_ns += (elapsed_ns - r.smoothed_ns) / 8;
+    }
+  }
+
+  void HedgedClient::updateHedgeDelay(HedgedReplica& replica) {
+    HistogramSnapshot snap;
+    HistogramSnapshot previous;
+    replica.latency_ns[0].snapshot(snap);
+    replica.latency_ns[1].snapshot(previous);
+    snap.merge(previous);
+    int delay_ms = options_.initial_hedge_delay_ms;
+    if (snap.count >= options_.min_samples) {
+      const uint64_t ns = snap.percentile(options_.hedge_percentile);
+      delay_ms = (int)((ns + 999999) / 1000000);
+    }
+    delay_ms = std::max<int>(delay_ms, options_.min_hedge_delay_ms);
+    delay_ms = std::min<int>(delay_ms, options_.max_hedge_delay_ms);
+    replica.hedge_delay_ms = delay_ms;
+  }
+
+  uint32_t HedgedClient::numReplicas() const {
+    return (uint32_t)replicas_.size();
+  }
+
+  uint32_t HedgedClient::primary() const {
+    return pickReplica(-1);
+  }
+
+  int HedgedClient::hedgeDelayMs(const uint32_t replica) const {
+    return replicas_[replica]->hedge_delay_ms;
+  }
+
+  void HedgedClient::replicaLatency(const uint32_t replica,
+    HistogramSnapshot& snap) const {
+    HistogramSnapshot previous;
+    replicas_[replica]->latency_ns[0].snapshot(snap);
+    replicas_[replica]->latency_ns[1].snapshot(previous);
+    snap.merge(previous);
+  }
+
+  uint64_t HedgedClient::numRequests() const {
+    return num_requests_;
+  }
+
+  uint64_t HedgedClient::numHedged() const {
+    return num_hedged_;
+  }
+
+  uint64_t HedgedClient::numHedgeWins() const {
+    return num_hedge_wins_;
+  }
+
+}  // namespace jzmq
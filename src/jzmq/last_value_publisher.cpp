@@ -0,0 +1,144 @@
+#include <iostream>
+#include <sstream>
+#include <zmq.h>
+#include "jzmq/last_value_publisher.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  LastValuePublisher::LastValuePublisher(const std::string& conn_str,
+    const ConnectionOptions& options) :
+    Connection(conn_str, PublisherType, options) {
+  }
+
+  LastValuePublisher::~LastValuePublisher() {
+    closeSocket();
+  }
+
+  void LastValuePublisher::initConn() {
+    if (socket_ != NULL) {
+      throw std::wruntime_error("LastValuePublisher::initConn() - ERROR: "
+        "connection already initialized.");
+    }
+    void* context = Connection::initContext();
+
+    socket_ = zmq_socket(context, ZMQ_XPUB);
+    if (socket_ == NULL) {
+      killContext();
+      throwErrorMessage("LastValuePublisher::initConn() - ERROR: "
+        "Could not create ZMQ_XPUB socket");
+    }
+    applySocketOptions();
+
+    // Pass on every subscription, not just the first one for each topic, so
+    // that each new subscriber gets the cached values
+    const int verbose = 1;
+    int rc = zmq_setsockopt(socket_, ZMQ_XPUB_VERBOSE, &verbose,
+      sizeof(verbose));
+    if (rc != 0) {
+      closeAndThrow("LastValuePublisher::initConn() - ERROR: "
+        "Could not set ZMQ_XPUB_VERBOSE");
+    }
+
+    rc = zmq_bind(socket_, conn_str_.c_str());
+    if (rc != 0) {
+      closeAndThrow("LastValuePublisher::initConn() - ERROR: "
+        "Could not bind ZMQ_XPUB socket");
+    }
+  }
+
+  void LastValuePublisher::killConn() {
+    if (socket_ == NULL) {
+      throw std::wruntime_error("LastValuePublisher::killConn() - ERROR: "
+        "Socket has not been initialized!");
+    }
+    closeSocket();
+  }
+
+  int LastValuePublisher::publish(const std::string& topic, const char* data,
+    const uint64_t size, const int timout_ms) {
+    processSubscriptions(0);
+
+    std::map<std::string, std::string>::iterator it = cache_.find(topic);
+    if (it == cache_.end()) {
+      it = cache_.insert(std::make_pair(topic, std::string())).first;
+    }
+    it->second.assign(data, (size_t)size);
+
+    DataBuffer parts[2] = {{topic.data(), topic.size()}, {data, size}};
+    return sendMultipart(parts, 2, timout_ms);
+  }
+
+  int LastValuePublisher::processSubscriptions(const int timout_ms) {
+    if (socket_ == NULL) {
+      throw std::wruntime_error("LastValuePublisher::processSubscriptions() "
+        "- ERROR: Socket has not been initialized!");
+    }
+    if (timout_ms != 0) {
+      zmq_pollitem_t item = {socket_, 0, ZMQ_POLLIN, 0};
+      int rc = zmq_poll(&item, 1, timout_ms);
+      if (rc < 0) {
+        if (zmq_errno() == EINTR) {
+          return kInterrupted;
+        }
+        throwErrorMessage("LastValuePublisher::processSubscriptions() - "
+          "ERROR: Could not poll ZMQ_XPUB socket");
+      }
+      if (rc == 0) {
+        return 0;
+      }
+    }
+
+    // Each subscription message is a single frame: 1 (subscribe) or 0
+    // (unsubscribe) followed by the topic prefix
+    int n_subscriptions = 0;
+    while (true) {
+      Message msg;
+      int rc = zmq_msg_recv(static_cast<zmq_msg_t*>(zmqMsg(msg)), socket_,
+        ZMQ_DONTWAIT);
+      if (rc < 0) {
+        const int err = zmq_errno();
+        if (err == EAGAIN || err == EINTR) {
+          break;
+        }
+        throwErrorMessage("LastValuePublisher::processSubscriptions() - "
+          "ERROR: Could not receive subscription");
+      }
+      if (msg.size() > 0 && msg.data()[0] == 1) {
+        prefix_.assign(msg.data() + 1, (size_t)msg.size() - 1);
+        replayPrefix();
+        n_subscriptions++;
+      }
+    }
+    return n_subscriptions;
+  }
+
+  void LastValuePublisher::replayPrefix() {
+    // The cache is ordered, so the matching topics are contiguous
+    std::map<std::string, std::string>::iterator it =
+      cache_.lower_bound(prefix_);
+    while (it != cache_.end() &&
+      it->first.compare(0, prefix_.size(), prefix_) == 0) {
+      DataBuffer parts[2] = {{it->first.data(), it->first.size()},
+        {it->second.data(), it->second.size()}};
+      sendMultipart(parts, 2, 0);
+      it++;
+    }
+  }
+
+  void LastValuePublisher::clearTopic(const std::string& topic) {
+    cache_.erase(topic);
+  }
+
+  void LastValuePublisher::clearCache() {
+    cache_.clear();
+  }
+
+  uint64_t LastValuePublisher::cacheSize() const {
+    return cache_.size();
+  }
+
+}  // namespace jzmq
@@ -0,0 +1,111 @@
+#include <sstream>
+#include <string.h>
+#include <zmq.h>
+#include "jzmq/message.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+namespace jzmq {
+
+  static_assert(sizeof(zmq_msg_t) <= sizeof(uint64_t) * 8,
+    "Message storage is too small for zmq_msg_t");
+
+  static void throwMessageError(const std::string& err_msg) {
+    int rc = zmq_errno();
+    std::stringstream ss;
+    ss << err_msg << " (zmqerr[" << rc << "]=" << zmq_strerror(rc) << ")";
+    throw std::wruntime_error(ss.str());
+  }
+
+  Message::Message() {
+    zmq_msg_init(static_cast<zmq_msg_t*>(zmqMsg()));
+  }
+
+  Message::Message(const uint64_t size) {
+    int rc = zmq_msg_init_size(static_cast<zmq_msg_t*>(zmqMsg()),
+      (size_t)size);
+    if (rc != 0) {
+      throwMessageError("Message::Message() - ERROR: "
+        "Could not allocate message");
+    }
+  }
+
+  Message::Message(const char* data, const uint64_t size) {
+    int rc = zmq_msg_init_size(static_cast<zmq_msg_t*>(zmqMsg()),
+      (size_t)size);
+    if (rc != 0) {
+      throwMessageError("Message::Message() - ERROR: "
+        "Could not allocate message");
+    }
+    if (size > 0) {
+      memcpy(this->data(), data, (size_t)size);
+    }
+  }
+
+  Message::Message(char* data, const uint64_t size, FreeFunc* free_func,
+    void* hint) {
+    int rc = zmq_msg_init_data(static_cast<zmq_msg_t*>(zmqMsg()), data,
+      (size_t)size, free_func, hint);
+    if (rc != 0) {
+      free_func(data, hint);
+      throwMessageError("Message::Message() - ERROR: "
+        "Could not initialize zero-copy message");
+    }
+  }
+
+  Message::Message(Message&& other) {
+    zmq_msg_init(static_cast<zmq_msg_t*>(zmqMsg()));
+    zmq_msg_move(static_cast<zmq_msg_t*>(zmqMsg()),
+      static_cast<zmq_msg_t*>(other.zmqMsg()));
+  }
+
+  Message& Message::operator=(Message&& other) {
+    if (this != &other) {
+      // zmq_msg_move releases our current content before taking other's
+      zmq_msg_move(static_cast<zmq_msg_t*>(zmqMsg()),
+        static_cast<zmq_msg_t*>(other.zmqMsg()));
+    }
+    return *this;
+  }
+
+  Message::~Message() {
+    zmq_msg_close(static_cast<zmq_msg_t*>(zmqMsg()));
+  }
+
+  char* Message::data() {
+    return static_cast<char*>(zmq_msg_data(static_cast<zmq_msg_t*>(zmqMsg())));
+  }
+
+  const char* Message::data() const {
+    // zmq_msg_data is not const-correct but does not modify the message
+    return static_cast<const char*>(zmq_msg_data(
+      const_cast<zmq_msg_t*>(static_cast<const zmq_msg_t*>(zmqMsg()))));
+  }
+
+  uint64_t Message::size() const {
+    return zmq_msg_size(static_cast<const zmq_msg_t*>(zmqMsg()));
+  }
+
+  bool Message::more() const {
+    return zmq_msg_more(static_cast<const zmq_msg_t*>(zmqMsg())) != 0;
+  }
+
+  Message Message::share() {
+    Message copy;
+    int rc = zmq_msg_copy(static_cast<zmq_msg_t*>(copy.zmqMsg()),
+      static_cast<zmq_msg_t*>(zmqMsg()));
+    if (rc != 0) {
+      throwMessageError("Message::share() - ERROR: "
+        "Could not copy message");
+    }
+    return copy;
+  }
+
+  void* Message::zmqMsg() {
+    return msg_;
+  }
+
+  const void* Message::zmqMsg() const {
+    return msg_;
+  }
+
+}  // namespace jzmq
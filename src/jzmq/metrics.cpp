@@ -0,0 +1,211 @@
+#include <chrono>
+#include "jzmq/metrics.h"
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  const uint32_t LatencyHistogram::kSubBucketBits;
+  const uint32_t LatencyHistogram::kNumBuckets;
+
+  // The recording thread is the only writer, so an add doesn't need a locked
+  // read-modify-write
+  static inline void add(std::atomic<uint64_t>& counter, const uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+      std::memory_order_relaxed);
+  }
+
+  static inline uint64_t get(const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+  static inline uint32_t log2Floor(const uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (uint32_t)index;
+#elif defined(__GNUC__)
+    return 63 - (uint32_t)__builtin_clzll(value);
+#else
+    uint32_t index = 0;
+    uint64_t v = value;
+    while (v >>= 1) {
+      index++;
+    }
+    return index;
+#endif
+  }
+
+  LatencyHistogram::LatencyHistogram() {
+    reset();
+  }
+
+  uint32_t LatencyHistogram::bucketIndex(const uint64_t value) {
+    const uint64_t n_sub = 1 << kSubBucketBits;
+    if (value < n_sub) {
+      return (uint32_t)value;
+    }
+    const uint32_t e = log2Floor(value);
+    const uint32_t sub = (uint32_t)(value >> (e - kSubBucketBits)) &
+      (n_sub - 1);
+    return ((e - kSubBucketBits + 1) << kSubBucketBits) + sub;
+  }
+
+  uint64_t LatencyHistogram::bucketLow(const uint32_t index) {
+    const uint64_t n_sub = 1 << kSubBucketBits;
+    if (index < n_sub) {
+      return index;
+    }
+    const uint32_t e = (index >> kSubBucketBits) + kSubBucketBits - 1;
+    const uint64_t sub = index & (n_sub - 1);
+    return (n_sub + sub) << (e - kSubBucketBits);
+  }
+
+  uint64_t LatencyHistogram::bucketHigh(const uint32_t index) {
+    if (index + 1 >= kNumBuckets) {
+      return ~(uint64_t)0;
+    }
+    return bucketLow(index + 1) - 1;
+  }
+
+  void LatencyHistogram::record(const uint64_t value) {
+    add(counts_[bucketIndex(value)], 1);
+    add(count_, 1);
+    add(sum_, value);
+    if (value > get(max_)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  void LatencyHistogram::snapshot(HistogramSnapshot& snap) const {
+    snap.counts.resize(kNumBuckets);
+    snap.count = 0;
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+      snap.counts[i] = get(counts_[i]);
+      snap.count += snap.counts[i];  // Consistent with counts
+    }
+    snap.sum = get(sum_);
+    snap.max = get(max_);
+  }
+
+  void LatencyHistogram::reset() {
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+      counts_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t HistogramSnapshot::percentile(const double p) const {
+    if (count == 0) {
+      return 0;
+    }
+    uint64_t rank = (uint64_t)(p * (double)count + 0.5);
+    if (rank < 1) {
+      rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < counts.size(); i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        const uint64_t high = LatencyHistogram::bucketHigh(i);
+        return high < max ? high : max;
+      }
+    }
+    return max;
+  }
+
+  double HistogramSnapshot::mean() const {
+    return count > 0 ? (double)sum / (double)count : 0;
+  }
+
+  void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    if (counts.size() < other.counts.size()) {
+      counts.resize(other.counts.size(), 0);
+    }
+    for (uint32_t i = 0; i < other.counts.size(); i++) {
+      counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    max = other.max > max ? other.max : max;
+  }
+
+  MetricsRecorder::MetricsRecorder() {
+    reset();
+  }
+
+  void MetricsRecorder::recordSend(const uint64_t n_msgs,
+    const uint64_t n_bytes, const uint64_t latency_ns) {
+    add(msgs_sent_, n_msgs);
+    add(bytes_sent_, n_bytes);
+    send_latency_.record(latency_ns);
+  }
+
+  void MetricsRecorder::recordReceive(const uint64_t n_msgs,
+    const uint64_t n_bytes, const uint64_t latency_ns) {
+    add(msgs_received_, n_msgs);
+    add(bytes_received_, n_bytes);
+    receive_latency_.record(latency_ns);
+  }
+
+  void MetricsRecorder::recordBlocked(const uint64_t ns,
+    const bool timed_out) {
+    add(blocked_ns_, ns);
+    if (timed_out) {
+      add(poll_timeouts_, 1);
+    }
+  }
+
+  void MetricsRecorder::recordWouldBlock() {
+    add(would_block_, 1);
+  }
+
+  void MetricsRecorder::recordInterrupt() {
+    add(interrupts_, 1);
+  }
+
+  void MetricsRecorder::recordTruncated() {
+    add(truncated_receives_, 1);
+  }
+
+  void MetricsRecorder::snapshot(ConnectionMetrics& metrics) const {
+    metrics.msgs_sent = get(msgs_sent_);
+    metrics.bytes_sent = get(bytes_sent_);
+    metrics.msgs_received = get(msgs_received_);
+    metrics.bytes_received = get(bytes_received_);
+    metrics.poll_timeouts = get(poll_timeouts_);
+    metrics.would_block = get(would_block_);
+    metrics.interrupts = get(interrupts_);
+    metrics.truncated_receives = get(truncated_receives_);
+    metrics.blocked_ns = get(blocked_ns_);
+    send_latency_.snapshot(metrics.send_latency_ns);
+    receive_latency_.snapshot(metrics.receive_latency_ns);
+  }
+
+  void MetricsRecorder::reset() {
+    msgs_sent_.store(0, std::memory_order_relaxed);
+    bytes_sent_.store(0, std::memory_order_relaxed);
+    msgs_received_.store(0, std::memory_order_relaxed);
+    bytes_received_.store(0, std::memory_order_relaxed);
+    poll_timeouts_.store(0, std::memory_order_relaxed);
+    would_block_.store(0, std::memory_order_relaxed);
+    interrupts_.store(0, std::memory_order_relaxed);
+    truncated_receives_.store(0, std::memory_order_relaxed);
+    blocked_ns_.store(0, std::memory_order_relaxed);
+    send_latency_.reset();
+    receive_latency_.reset();
+  }
+
+  uint64_t MetricsRecorder::nowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+}  // namespace jzmq
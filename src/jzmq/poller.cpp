@@ -0,0 +1,218 @@
+#include <iostream>
+#include <sstream>
+#include <zmq.h>
+#include "jzmq/poller.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  static short toZmqEvents(const int events) {
+    short zmq_events = 0;
+    if (events & Poller::ReadEvent) {
+      zmq_events |= ZMQ_POLLIN;
+    }
+    if (events & Poller::WriteEvent) {
+      zmq_events |= ZMQ_POLLOUT;
+    }
+    return zmq_events;
+  }
+
+  static int fromZmqEvents(const short zmq_events) {
+    int events = 0;
+    if (zmq_events & ZMQ_POLLIN) {
+      events |= Poller::ReadEvent;
+    }
+    if (zmq_events & ZMQ_POLLOUT) {
+      events |= Poller::WriteEvent;
+    }
+    return events;
+  }
+
+  Poller::Poller() {
+    items_ = NULL;
+    items_capacity_ = 0;
+    items_dirty_ = true;
+    dispatching_ = false;
+    running_ = false;
+  }
+
+  Poller::~Poller() {
+    for (uint32_t i = 0; i < entries_.size(); i++) {
+      delete entries_[i];
+    }
+    zmq_pollitem_t* items = static_cast<zmq_pollitem_t*>(items_);
+    SAFE_DELETE_ARR(items);
+    items_ = NULL;
+  }
+
+  void Poller::add(Connection& conn, const int events,
+    const Callback& callback) {
+    if (conn.transport_ != NULL) {
+      // zmq_poll only sees sockets, not the ring or the thread:// queues
+      throw std::wruntime_error("Poller::add() - ERROR: "
+        "shm:// and thread:// connections can't be polled.");
+    }
+    if (conn.socket_ == NULL) {
+      throw std::wruntime_error("Poller::add() - ERROR: "
+        "Connection has not been initialized!");
+    }
+    if (findEntry(conn) != NULL) {
+      throw std::wruntime_error("Poller::add() - ERROR: "
+        "Connection is already registered.");
+    }
+    Entry* entry = new Entry();
+    entry->conn = &conn;
+    entry->events = events;
+    entry->callback = callback;
+    entry->removed = false;
+    entries_.push_back(entry);
+    items_dirty_ = true;
+  }
+
+  void Poller::modify(Connection& conn, const int events) {
+    Entry* entry = findEntry(conn);
+    if (entry == NULL) {
+      throw std::wruntime_error("Poller::modify() - ERROR: "
+        "Connection is not registered.");
+    }
+    entry->events = events;
+    items_dirty_ = true;
+  }
+
+  void Poller::remove(Connection& conn) {
+    Entry* entry = findEntry(conn);
+    if (entry == NULL) {
+      return;
+    }
+    // The entry may be in the middle of being dispatched, so just flag it
+    entry->removed = true;
+    items_dirty_ = true;
+    if (!dispatching_) {
+      reclaimRemovedEntries();
+    }
+  }
+
+  uint32_t Poller::size() const {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < entries_.size(); i++) {
+      if (!entries_[i]->removed) {
+        n++;
+      }
+    }
+    return n;
+  }
+
+  Poller::Entry* Poller::findEntry(const Connection& conn) {
+    for (uint32_t i = 0; i < entries_.size(); i++) {
+      if (entries_[i]->conn == &conn && !entries_[i]->removed) {
+        return entries_[i];
+      }
+    }
+    return NULL;
+  }
+
+  void Poller::rebuildItems() {
+    if (items_capacity_ < entries_.size()) {
+      zmq_pollitem_t* items = static_cast<zmq_pollitem_t*>(items_);
+      SAFE_DELETE_ARR(items);
+      items_capacity_ = (uint32_t)entries_.size() * 2;
+      items_ = new zmq_pollitem_t[items_capacity_];
+    }
+    zmq_pollitem_t* items = static_cast<zmq_pollitem_t*>(items_);
+    polled_.clear();
+    for (uint32_t i = 0; i < entries_.size(); i++) {
+      Entry* entry = entries_[i];
+      if (entry->removed || entry->events == 0) {
+        continue;
+      }
+      zmq_pollitem_t& item = items[polled_.size()];
+      item.socket = entry->conn->socket_;
+      item.fd = 0;
+      item.events = toZmqEvents(entry->events);
+      item.revents = 0;
+      polled_.push_back(entry);
+    }
+    items_dirty_ = false;
+  }
+
+  void Poller::reclaimRemovedEntries() {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < entries_.size(); i++) {
+      if (entries_[i]->removed) {
+        delete entries_[i];
+      } else {
+        entries_[n++] = entries_[i];
+      }
+    }
+    entries_.resize(n);
+  }
+
+  int Poller::poll(const int timout_ms) {
+    if (items_dirty_) {
+      rebuildItems();
+    }
+    if (polled_.size() == 0 && timout_ms < 0) {
+      throw std::wruntime_error("Poller::poll() - ERROR: "
+        "Nothing to poll (this would block forever).");
+    }
+
+    zmq_pollitem_t* items = static_cast<zmq_pollitem_t*>(items_);
+    int rc = zmq_poll(items, (int)polled_.size(), timout_ms);
+    if (rc == -1) {
+      int err = zmq_errno();
+      if (err == EINTR) {
+        return Connection::kInterrupted;
+      }
+      std::stringstream ss;
+      ss << "Poller::poll() - ERROR: Error polling sockets.  " <<
+        zmq_strerror(err);
+      throw std::wruntime_error(ss.str());
+    }
+    if (rc == 0) {
+      return 0;
+    }
+
+    // Callbacks may change the registrations.  That only marks the poll 
+    // items dirty (they are rebuilt on the next poll) so it is safe to keep
+    // walking them, skipping entries that get removed along the way.
+    int n_dispatched = 0;
+    dispatching_ = true;
+    const uint32_t n_items = (uint32_t)polled_.size();
+    try {
+      for (uint32_t i = 0; i < n_items && rc > 0; i++) {
+        if (items[i].revents == 0) {
+          continue;
+        }
+        rc--;
+        Entry* entry = polled_[i];
+        if (entry->removed) {
+          continue;
+        }
+        entry->callback(*entry->conn, fromZmqEvents(items[i].revents));
+        n_dispatched++;
+      }
+    } catch (...) {
+      dispatching_ = false;
+      reclaimRemovedEntries();
+      throw;
+    }
+    dispatching_ = false;
+    reclaimRemovedEntries();
+    return n_dispatched;
+  }
+
+  void Poller::run() {
+    running_ = true;
+    while (running_) {
+      poll(-1);
+    }
+  }
+
+  void Poller::stop() {
+    running_ = false;
+  }
+
+}  // namespace jzmq
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <zmq.h>
 #include "jzmq/publisher.h"
+#include "jzmq/shm_ring.h"
 #include "jtil/exceptions/wruntime_error.h"
 
 #define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
@@ -11,48 +12,69 @@
 
 namespace jzmq {
 
-  Publisher::Publisher(const std::string& conn_str) : 
-    Connection(conn_str, PublisherType){
+  Publisher::Publisher(const std::string& conn_str, 
+    const ConnectionOptions& options) : 
+    Connection(conn_str, PublisherType, options) {
   }
 
   Publisher::~Publisher() {
-    if (socket_ != NULL) {
-      // A socket might not close correctly on a fatal error condition
-      // Don't throw an exception or raise an assertion, but let the user know.
-      std::cout << "Warning: Socket was not closed!" << std::endl;
-    }
+    closeSocket();
+  }
+
+  Publisher::Publisher(Publisher&& other) : Connection(std::move(other)) {
+  }
+
+  Publisher& Publisher::operator=(Publisher&& other) {
+    Connection::operator=(std::move(other));
+    return *this;
   }
   
   void Publisher::initConn() {
-    if (socket_ != NULL) {
+    if (socket_ != NULL || transport_ != NULL) {
       throw std::wruntime_error("Publisher::initConn() - ERROR: "
         "connection already initialized.");
     }
+    if (initThreadTransport()) {
+      return;
+    }
+    // shm:// data goes through the ring; the socket only carries control
+    const std::string shm_name = ShmRing::shmName(conn_str_);
     void* context = Connection::initContext();
     
     socket_ = zmq_socket(context, ZMQ_PUB);
     if (socket_ == NULL) {
+      killContext();
       throwErrorMessage("Publisher::initConn() - ERROR: "
         "Could not create ZMQ_PUB socket");
     }
+    applySocketOptions();
 
-    int rc = zmq_bind(socket_, conn_str_.c_str());
+    // Subscribers also poll for the ring, so its first announcement can go
+    // out before the bind
+    if (!shm_name.empty()) {
+      initShm(shm_name, true);
+    }
+    const std::string address = shm_name.empty() ? conn_str_ : 
+      ShmRing::controlAddress(shm_name);
+    int rc = zmq_bind(socket_, address.c_str());
     if (rc != 0) {
-      throwErrorMessage("Publisher::initConn() - ERROR: "
+      closeAndThrow("Publisher::initConn() - ERROR: "
         "Could not bind ZMQ_PUB socket");
     }
-    num_open_connections_++;
   }
 
   void Publisher::killConn() {
-    if (socket_ == NULL) {
+    if (socket_ == NULL && transport_ == NULL) {
       throw std::wruntime_error("Publisher::killConn() - ERROR: "
         "Socket has not been initialized!");
     }
-    zmq_close(socket_);
-    socket_ = NULL;
-    num_open_connections_--;
-    killContext();
+    closeSocket();
+  }
+
+  int Publisher::publish(const std::string& topic, const char* data, 
+    const uint64_t size, const int timout_ms) {
+    DataBuffer parts[2] = {{topic.data(), topic.size()}, {data, size}};
+    return sendMultipart(parts, 2, timout_ms);
   }
 
 }  // namespace jzmq
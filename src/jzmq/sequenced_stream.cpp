@@ -0,0 +1,257 @@
+#include <iostream>
+#include <random>
+#include <string.h>
+#include "jzmq/sequenced_stream.h"
+#include "jzmq/metrics.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  // First frame of a snapshot request (the prefixes follow)
+  static const char* snapshot_request_msg = "SNAPSHOT";
+
+  const int SequencedSubscriber::kSnapshot;
+
+  SequencedPublisher::SequencedPublisher(const std::string& conn_str,
+    const std::string& snapshot_conn_str, const ConnectionOptions& options) :
+    publisher_(conn_str, options), snapshots_(snapshot_conn_str) {
+    num_snapshots_served_ = 0;
+    // Mix in the clock in case random_device is deterministic
+    std::random_device rd;
+    session_ = (((uint64_t)rd() << 32) | rd()) ^ MetricsRecorder::nowNs();
+  }
+
+  void SequencedPublisher::initConn() {
+    publisher_.initConn();
+    try {
+      snapshots_.initConn();
+    } catch (...) {
+      publisher_.killConn();
+      throw;
+    }
+  }
+
+  void SequencedPublisher::killConn() {
+    snapshots_.killConn();
+    publisher_.killConn();
+  }
+
+  int SequencedPublisher::publish(const std::string& topic,
+    const char* data, const uint64_t size, const int timout_ms) {
+    processSnapshots(0);
+
+    SequencedValue& entry = state_[topic];
+    entry.sequence++;
+    entry.value.assign(data, (size_t)size);
+
+    DataBuffer parts[4] = {{topic.data(), topic.size()},
+      {reinterpret_cast<const char*>(&session_), sizeof(uint64_t)},
+      {reinterpret_cast<const char*>(&entry.sequence), sizeof(uint64_t)},
+      {data, size}};
+    return publisher_.sendMultipart(parts, 4, timout_ms);
+  }
+
+  int SequencedPublisher::processSnapshots(const int timout_ms) {
+    int n_served = 0;
+    int wait_ms = timout_ms;
+    while (snapshots_.receiveMultipart(request_, wait_ms) > 0) {
+      sendSnapshot();
+      n_served++;
+      wait_ms = 0;  // Then answer whatever else is already queued
+    }
+    num_snapshots_served_ += n_served;
+    return n_served;
+  }
+
+  void SequencedPublisher::sendSnapshot() {
+    // request_ holds the subscribed prefixes (an empty one matches all)
+    reply_.clear();
+    DataBuffer session = {reinterpret_cast<const char*>(&session_),
+      sizeof(uint64_t)};
+    reply_.push_back(session);
+    const uint64_t cmd_size = strlen(snapshot_request_msg);
+    const bool valid = request_[0].size() == cmd_size &&
+      memcmp(request_[0].data(), snapshot_request_msg, (size_t)cmd_size) == 0;
+    SequencedState::const_iterator it = valid ? state_.begin() : state_.end();
+    for (; it != state_.end(); it++) {
+      bool match = false;
+      for (uint32_t i = 1; i < request_.size() && !match; i++) {
+        const uint64_t n = request_[i].size();
+        match = it->first.size() >= n &&
+          memcmp(it->first.data(), request_[i].data(), (size_t)n) == 0;
+      }
+      if (match) {
+        DataBuffer topic = {it->first.data(), it->first.size()};
+        DataBuffer sequence = {
+          reinterpret_cast<const char*>(&it->second.sequence),
+          sizeof(uint64_t)};
+        DataBuffer value = {it->second.value.data(), it->second.value.size()};
+        reply_.push_back(topic);
+        reply_.push_back(sequence);
+        reply_.push_back(value);
+      }
+    }
+    // The subscriber is waiting, so this doesn't block for long
+    snapshots_.sendMultipart(&reply_[0], (uint32_t)reply_.size(), 0);
+  }
+
+  const SequencedState& SequencedPublisher::state() const {
+    return state_;
+  }
+
+  uint64_t SequencedPublisher::numSnapshotsServed() const {
+    return num_snapshots_served_;
+  }
+
+  uint64_t SequencedPublisher::session() const {
+    return session_;
+  }
+
+  SequencedSubscriber::SequencedSubscriber(const std::string& conn_str,
+    const std::string& snapshot_conn_str, const int snapshot_timeout_ms,
+    const ConnectionOptions& options) : subscriber_(conn_str, options),
+    snapshots_(snapshot_conn_str) {
+    snapshot_timeout_ms_ = snapshot_timeout_ms;
+    session_ = 0;
+    synced_ = false;
+    num_snapshots_ = 0;
+    num_gaps_ = 0;
+    num_restarts_ = 0;
+  }
+
+  void SequencedSubscriber::subscribe(const std::string& topic) {
+    topics_.push_back(topic);
+    subscriber_.subscribe(topic);
+  }
+
+  void SequencedSubscriber::initConn() {
+    if (topics_.size() == 0) {
+      topics_.push_back("");
+    }
+    // Subscribe first so that no update after the snapshot is missed
+    subscriber_.initConn();
+    try {
+      snapshots_.initConn();
+    } catch (...) {
+      subscriber_.killConn();
+      throw;
+    }
+    fetchSnapshot();
+  }
+
+  void SequencedSubscriber::killConn() {
+    snapshots_.killConn();
+    subscriber_.killConn();
+    synced_ = false;
+  }
+
+  bool SequencedSubscriber::fetchSnapshot() {
+    synced_ = false;
+    std::vector<DataBuffer> request(topics_.size() + 1);
+    request[0].data = snapshot_request_msg;
+    request[0].size = strlen(snapshot_request_msg);
+    for (uint32_t i = 0; i < topics_.size(); i++) {
+      request[i + 1].data = topics_[i].data();
+      request[i + 1].size = topics_[i].size();
+    }
+    if (snapshots_.sendMultipart(&request[0], (uint32_t)request.size(),
+      snapshot_timeout_ms_) <= 0 ||
+      snapshots_.receiveMultipart(frames_, snapshot_timeout_ms_) <= 0) {
+      // The ZMQ_REQ socket is still waiting for the reply: start afresh
+      snapshots_.killConn();
+      snapshots_.initConn();
+      return false;
+    }
+    if (frames_[0].size() != sizeof(uint64_t)) {
+      return false;  // Not a snapshot
+    }
+    memcpy(&session_, frames_[0].data(), sizeof(uint64_t));
+    SequencedState state;
+    for (uint32_t i = 1; i + 2 < frames_.size(); i += 3) {
+      if (frames_[i + 1].size() != sizeof(uint64_t)) {
+        continue;
+      }
+      SequencedValue& entry = state[std::string(frames_[i].data(),
+        (size_t)frames_[i].size())];
+      memcpy(&entry.sequence, frames_[i + 1].data(), sizeof(uint64_t));
+      entry.value.assign(frames_[i + 2].data(), (size_t)frames_[i + 2].size());
+    }
+    state_.swap(state);
+    synced_ = true;
+    num_snapshots_++;
+    return true;
+  }
+
+  int SequencedSubscriber::receive(std::string& topic, std::string& value,
+    const int timout_ms) {
+    if (!synced_) {
+      return fetchSnapshot() ? kSnapshot : 0;
+    }
+    const uint64_t deadline_ns = MetricsRecorder::nowNs() +
+      (uint64_t)timout_ms * 1000000;
+    int wait_ms = timout_ms;
+    while (true) {
+      int rc = subscriber_.receiveMultipart(frames_, wait_ms);
+      if (rc <= 0) {
+        return rc;  // Timeout or interrupt
+      }
+      if (timout_ms > 0) {
+        const uint64_t now_ns = MetricsRecorder::nowNs();
+        wait_ms = now_ns >= deadline_ns ? 0 :
+          (int)((deadline_ns - now_ns) / 1000000);
+      }
+      if (rc != 4 || frames_[1].size() != sizeof(uint64_t) ||
+        frames_[2].size() != sizeof(uint64_t)) {
+        continue;  // Not an update
+      }
+      uint64_t session;
+      memcpy(&session, frames_[1].data(), sizeof(session));
+      if (session != session_) {
+        // The publisher restarted and its sequence numbers with it
+        num_restarts_++;
+        return fetchSnapshot() ? kSnapshot : 0;
+      }
+      uint64_t sequence;
+      memcpy(&sequence, frames_[2].data(), sizeof(sequence));
+      topic_.assign(frames_[0].data(), (size_t)frames_[0].size());
+      SequencedValue& entry = state_[topic_];
+      if (sequence <= entry.sequence) {
+        continue;  // Already in the snapshot
+      }
+      if (sequence != entry.sequence + 1) {
+        // Updates were lost; the snapshot has them (and this one)
+        num_gaps_++;
+        return fetchSnapshot() ? kSnapshot : 0;
+      }
+      entry.sequence = sequence;
+      entry.value.assign(frames_[3].data(), (size_t)frames_[3].size());
+      topic = topic_;
+      value = entry.value;
+      return 1;
+    }
+  }
+
+  const SequencedState& SequencedSubscriber::state() const {
+    return state_;
+  }
+
+  bool SequencedSubscriber::synced() const {
+    return synced_;
+  }
+
+  uint64_t SequencedSubscriber::numSnapshots() const {
+    return num_snapshots_;
+  }
+
+  uint64_t SequencedSubscriber::numGaps() const {
+    return num_gaps_;
+  }
+
+  uint64_t SequencedSubscriber::numRestarts() const {
+    return num_restarts_;
+  }
+
+}  // namespace jzmq
@@ -11,48 +11,54 @@
 
 namespace jzmq {
 
-  Server::Server(const std::string& conn_str) : 
-    Connection(conn_str, ServerType){
+  Server::Server(const std::string& conn_str, 
+    const ConnectionOptions& options) : 
+    Connection(conn_str, ServerType, options) {
   }
 
   Server::~Server() {
-    if (socket_ != NULL) {
-      // A socket might not close correctly on a fatal error condition
-      // Don't throw an exception or raise an assertion, but let the user know.
-      std::cout << "Warning: Socket was not closed!" << std::endl;
-    }
+    closeSocket();
+  }
+
+  Server::Server(Server&& other) : Connection(std::move(other)) {
+  }
+
+  Server& Server::operator=(Server&& other) {
+    Connection::operator=(std::move(other));
+    return *this;
   }
   
   void Server::initConn() {
-    if (socket_ != NULL) {
+    if (socket_ != NULL || transport_ != NULL) {
       throw std::wruntime_error("Server::initConn() - ERROR: connection "
         "already initialized.");
     }
+    if (initThreadTransport()) {
+      return;
+    }
     void* context = Connection::initContext();
     
     socket_ = zmq_socket(context, ZMQ_REP);
     if (socket_ == NULL) {
+      killContext();
       throwErrorMessage("Server::initConn() - ERROR: "
         "Could not create ZMQ_REP socket");
     }
+    applySocketOptions();
 
     int rc = zmq_bind(socket_, conn_str_.c_str());
     if (rc != 0) {
-      throwErrorMessage("Server::initConn() - ERROR: "
+      closeAndThrow("Server::initConn() - ERROR: "
         "Could not bind ZMQ_REP socket");
     }
-    num_open_connections_++;
   }
 
   void Server::killConn() {
-    if (socket_ == NULL) {
+    if (socket_ == NULL && transport_ == NULL) {
       throw std::wruntime_error("Server::killConn() - ERROR: "
         "Socket has not been initialized!");
     }
-    zmq_close(socket_);
-    socket_ = NULL;
-    num_open_connections_--;
-    killContext();
+    closeSocket();
   }
 
 }  // namespace jzmq
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include "jzmq/server_pool.h"
+#include "jzmq/async_server.h"
+#include "jzmq/client.h"
+#include "jzmq/poller.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  // Control messages from the workers and the broker (single frame, so they
+  // can't be confused with a request or reply, which always carry the
+  // client's envelope and a delimiter).
+  static const char* worker_ready_msg = "READY";
+  static const char* worker_stop_msg = "STOP";
+  // How often the broker checks for stop() while idle
+  static const int broker_poll_ms = 100;
+  // Once a worker has died stop() can't tell whether the requests it took
+  // will be answered, so it waits at most this long for them
+  static const int drain_timeout_ms = 2000;
+
+  using jtil::string_util::ToNarrowString;
+
+  std::atomic<uint64_t> ServerPool::num_instances_(0);
+
+  ServerPool::ServerPool(const std::string& conn_str,
+    const uint32_t num_workers, const Handler& handler) : running_(false),
+    stopping_(false), broker_running_(false), num_failed_workers_(0),
+    num_requests_served_(0) {
+    if (num_workers == 0) {
+      throw std::wruntime_error("ServerPool::ServerPool() - ERROR: "
+        "num_workers must be at least 1.");
+    }
+    conn_str_ = conn_str;
+    num_workers_ = num_workers;
+    handler_ = handler;
+    frontend_ = NULL;
+    backend_ = NULL;
+    std::stringstream ss;
+    ss << "inproc://jzmq_server_pool_workers_" << num_instances_++;
+    backend_conn_str_ = ss.str();
+  }
+
+  ServerPool::~ServerPool() {
+    if (running_) {
+      stop();
+    }
+  }
+
+  void ServerPool::start() {
+    if (running_) {
+      throw std::wruntime_error("ServerPool::start() - ERROR: "
+        "pool is already running.");
+    }
+    // Bind here so that errors go to the caller.  The sockets are handed to
+    // the broker thread (thread creation is a full memory barrier).
+    frontend_ = new AsyncServer(conn_str_);
+    backend_ = new AsyncServer(backend_conn_str_);
+    try {
+      frontend_->initConn();
+    } catch (...) {
+      SAFE_DELETE(frontend_);
+      SAFE_DELETE(backend_);
+      throw;
+    }
+    try {
+      backend_->initConn();  // inproc: must bind before the workers connect
+    } catch (...) {
+      frontend_->killConn();
+      SAFE_DELETE(frontend_);
+      SAFE_DELETE(backend_);
+      throw;
+    }
+
+    stopping_ = false;
+    broker_running_ = true;
+    num_failed_workers_ = 0;
+    running_ = true;
+    broker_ = std::thread(&ServerPool::brokerThread, this);
+    for (uint32_t i = 0; i < num_workers_; i++) {
+      workers_.push_back(std::thread(&ServerPool::workerThread, this));
+    }
+  }
+
+  void ServerPool::stop() {
+    if (!running_) {
+      return;
+    }
+    // The broker stops reading new requests, waits until every worker is
+    // idle and then tells the workers to exit.
+    stopping_ = true;
+    for (uint32_t i = 0; i < workers_.size(); i++) {
+      workers_[i].join();
+    }
+    workers_.clear();
+    broker_.join();
+
+    frontend_->killConn();
+    backend_->killConn();
+    SAFE_DELETE(frontend_);
+    SAFE_DELETE(backend_);
+    running_ = false;
+  }
+
+  bool ServerPool::running() const {
+    return running_;
+  }
+
+  uint64_t ServerPool::numRequestsServed() const {
+    return num_requests_served_;
+  }
+
+  // Moves frames[start, end) onto the back of dst
+  static void moveFrames(std::vector<Message>& src, const size_t start,
+    const size_t end, std::vector<Message>& dst) {
+    for (size_t i = start; i < end; i++) {
+      dst.push_back(std::move(src[i]));
+    }
+  }
+
+  // Index of the first empty (delimiter) frame, or frames.size()
+  static size_t findDelimiter(const std::vector<Message>& frames) {
+    size_t i = 0;
+    while (i < frames.size() && frames[i].size() > 0) {
+      i++;
+    }
+    return i;
+  }
+
+  void ServerPool::brokerThread() {
+    // Envelopes of the idle workers, least recently used first
+    std::deque<std::vector<Message> > idle_workers;
+    uint32_t num_registered = 0;
+    uint32_t num_busy = 0;
+    AsyncServer::Request request;
+    std::vector<Message> frames;
+
+    try {
+      Poller poller;
+
+      // Worker messages: a READY or a reply to pass back to the client
+      poller.add(*backend_, Poller::ReadEvent, [&](Connection&, const int) {
+        while (backend_->receiveRequest(request, 0) > 0) {
+          if (request.parts.size() == 1) {
+            if (request.parts[0].size() == strlen(worker_ready_msg)) {
+              num_registered++;
+              idle_workers.push_back(std::move(request.envelope));
+            }
+            continue;
+          }
+          // [client envelope...][empty][reply...]
+          size_t delim = findDelimiter(request.parts);
+          if (delim < request.parts.size()) {
+            std::vector<Message> client_envelope;
+            frames.clear();
+            moveFrames(request.parts, 0, delim, client_envelope);
+            moveFrames(request.parts, delim + 1, request.parts.size(),
+              frames);
+            frontend_->sendReply(client_envelope, frames);
+            num_requests_served_++;
+          }
+          num_busy--;
+          idle_workers.push_back(std::move(request.envelope));
+        }
+      });
+
+      // Client requests: hand each one to the least recently used worker
+      poller.add(*frontend_, 0, [&](Connection&, const int) {
+        while (!idle_workers.empty() &&
+          frontend_->receiveRequest(request, 0) > 0) {
+          frames.clear();
+          moveFrames(request.envelope, 0, request.envelope.size(), frames);
+          frames.push_back(Message());
+          moveFrames(request.parts, 0, request.parts.size(), frames);
+          backend_->sendReply(idle_workers.front(), frames);
+          idle_workers.pop_front();
+          num_busy++;
+        }
+      });
+
+      bool draining = false;
+      std::chrono::steady_clock::time_point drain_deadline;
+      while (true) {
+        if (stopping_ && !draining) {
+          draining = true;
+          drain_deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(drain_timeout_ms);
+        }
+        if (draining && num_busy == 0 && num_registered == num_workers_) {
+          break;  // Drained: every worker is idle
+        }
+        // A failed worker never registers (or never replies): give up on
+        // it, once the others are idle or the drain timeout is up
+        if (draining && num_failed_workers_ > 0 && (num_busy == 0 ||
+          std::chrono::steady_clock::now() >= drain_deadline)) {
+          break;
+        }
+        // Only read requests while there is a worker free to take them
+        const bool accept = !stopping_ && !idle_workers.empty();
+        poller.modify(*frontend_, accept ? Poller::ReadEvent : 0);
+        poller.poll(broker_poll_ms);
+      }
+
+      // Release the workers
+      DataBuffer stop_msg = {worker_stop_msg, strlen(worker_stop_msg)};
+      while (!idle_workers.empty()) {
+        backend_->sendReply(idle_workers.front(), &stop_msg, 1);
+        idle_workers.pop_front();
+      }
+    } catch (std::wruntime_error& e) {
+      std::cout << "ServerPool::brokerThread() - ERROR: " <<
+        ToNarrowString(e.errorMsg()) << std::endl;
+    }
+    broker_running_ = false;
+  }
+
+  void ServerPool::workerThread() {
+    try {
+      Client worker(backend_conn_str_);
+      worker.initConn();
+      worker.sendData(const_cast<char*>(worker_ready_msg),
+        strlen(worker_ready_msg));
+
+      std::vector<Message> frames;
+      std::vector<Message> request;
+      std::vector<Message> reply;
+      std::vector<Message> out;
+      while (true) {
+        if (worker.receiveMultipart(frames, broker_poll_ms) <= 0) {
+          if (!broker_running_) {
+            break;  // The broker has gone away
+          }
+          continue;
+        }
+        if (frames.size() == 1) {
+          break;  // Stop message from the broker
+        }
+        // [client envelope...][empty][request...]
+        size_t delim = findDelimiter(frames);
+        request.clear();
+        reply.clear();
+        out.clear();
+        if (delim < frames.size()) {
+          moveFrames(frames, delim + 1, frames.size(), request);
+        }
+        try {
+          handler_(request, reply);
+        } catch (std::wruntime_error& e) {
+          // Don't leave the client hanging: reply with an empty message
+          std::cout << "ServerPool::workerThread() - ERROR: handler threw: " <<
+            ToNarrowString(e.errorMsg()) << std::endl;
+          reply.clear();
+        } catch (std::exception& e) {
+          std::cout << "ServerPool::workerThread() - ERROR: handler threw: " <<
+            e.what() << std::endl;
+          reply.clear();
+        } catch (...) {
+          std::cout << "ServerPool::workerThread() - ERROR: handler threw an "
+            "unknown exception" << std::endl;
+          reply.clear();
+        }
+        if (reply.empty()) {
+          reply.push_back(Message());
+        }
+        moveFrames(frames, 0, std::min(delim + 1, frames.size()), out);
+        moveFrames(reply, 0, reply.size(), out);
+        worker.sendMultipart(out);
+      }
+
+      worker.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cout << "ServerPool::workerThread() - ERROR: " <<
+        ToNarrowString(e.errorMsg()) << std::endl;
+      num_failed_workers_++;
+    } catch (std::exception& e) {
+      std::cout << "ServerPool::workerThread() - ERROR: " << e.what() <<
+        std::endl;
+      num_failed_workers_++;
+    }
+  }
+
+}  // namespace jzmq
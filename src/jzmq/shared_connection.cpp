@@ -0,0 +1,464 @@
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <zmq.h>
+#include "jzmq/shared_connection.h"
+#include "jzmq/client.h"
+#include "jzmq/connection.h"
+#include "jzmq/poller.h"
+#include "jzmq/publisher.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  // How often the proxy threads check for stop() while idle
+  static const int proxy_poll_ms = 100;
+
+  using jtil::string_util::ToNarrowString;
+
+  // A bare socket for the proxy stages (none of the public Connections has
+  // the socket types they need).
+  class ProxySocket : public Connection {
+  public:
+    ProxySocket(const std::string& conn_str, const SocketType type,
+      const int zmq_type, const bool bind,
+      const ConnectionOptions& options = ConnectionOptions()) :
+      Connection(conn_str, type, options) {
+      zmq_type_ = zmq_type;
+      bind_ = bind;
+    }
+
+    virtual ~ProxySocket() {
+      closeSocket();
+    }
+
+    virtual void initConn() {
+      if (socket_ != NULL) {
+        throw std::wruntime_error("ProxySocket::initConn() - ERROR: "
+          "connection already initialized.");
+      }
+      void* context = Connection::initContext();
+
+      socket_ = zmq_socket(context, zmq_type_);
+      if (socket_ == NULL) {
+        killContext();
+        throwErrorMessage("ProxySocket::initConn() - ERROR: "
+          "Could not create socket");
+      }
+      applySocketOptions();
+
+      int rc = bind_ ? zmq_bind(socket_, conn_str_.c_str()) :
+        zmq_connect(socket_, conn_str_.c_str());
+      if (rc != 0) {
+        closeAndThrow(bind_ ? "ProxySocket::initConn() - ERROR: "
+          "Could not bind socket" : "ProxySocket::initConn() - ERROR: "
+          "Could not connect socket");
+      }
+    }
+
+    virtual void killConn() {
+      if (socket_ == NULL) {
+        throw std::wruntime_error("ProxySocket::killConn() - ERROR: "
+          "Socket has not been initialized!");
+      }
+      closeSocket();
+    }
+
+  private:
+    int zmq_type_;
+    bool bind_;
+
+    // Non-copyable, non-assignable.
+    ProxySocket(ProxySocket&);
+    ProxySocket& operator=(const ProxySocket&);
+  };
+
+  // One thread's socket.  It is closed by whichever comes first: the thread
+  // exiting or SharedSockets::closeAll (lck_ makes sure only one does it).
+  struct SharedSlot {
+    std::mutex lck;
+    Connection* conn;
+  };
+
+  static void closeSlot(SharedSlot& slot) {
+    std::lock_guard<std::mutex> lck(slot.lck);
+    if (slot.conn == NULL) {
+      return;
+    }
+    try {
+      slot.conn->killConn();
+    } catch (std::wruntime_error& e) {
+      std::cout << "SharedSockets - ERROR: " << ToNarrowString(e.errorMsg())
+        << std::endl;
+    }
+    SAFE_DELETE(slot.conn);
+  }
+
+  // The calling thread's sockets, keyed by SharedSockets::id_.  There is
+  // usually only one or two so a vector is the fastest lookup.
+  struct ThreadSlots {
+    std::vector<std::pair<uint64_t, std::shared_ptr<SharedSlot> > > slots;
+
+    ~ThreadSlots() {
+      for (size_t i = 0; i < slots.size(); i++) {
+        closeSlot(*slots[i].second);
+      }
+    }
+  };
+
+  static thread_local ThreadSlots thread_slots_;
+
+  std::atomic<uint64_t> SharedSockets::num_instances_(0);
+
+  SharedSockets::SharedSockets() {
+    id_ = num_instances_++;
+  }
+
+  SharedSockets::~SharedSockets() {
+    closeAll();
+  }
+
+  Connection* SharedSockets::find() const {
+    const ThreadSlots& cache = thread_slots_;
+    for (size_t i = 0; i < cache.slots.size(); i++) {
+      if (cache.slots[i].first == id_) {
+        return cache.slots[i].second->conn;
+      }
+    }
+    return NULL;
+  }
+
+  void SharedSockets::add(Connection* conn) {
+    std::shared_ptr<SharedSlot> slot = std::make_shared<SharedSlot>();
+    slot->conn = conn;
+    {
+      // Forget the sockets of threads that have exited (or closed them), so
+      // that slots_ doesn't grow as threads come and go
+      std::lock_guard<std::mutex> lck(lck_);
+      size_t n = 0;
+      for (size_t i = 0; i < slots_.size(); i++) {
+        std::lock_guard<std::mutex> slot_lck(slots_[i]->lck);
+        if (slots_[i]->conn != NULL) {
+          slots_[n++] = slots_[i];
+        }
+      }
+      slots_.resize(n);
+      slots_.push_back(slot);
+    }
+    // Replace our old entry and drop the ones closed by closeAll
+    ThreadSlots& cache = thread_slots_;
+    size_t n = 0;
+    for (size_t i = 0; i < cache.slots.size(); i++) {
+      bool closed;
+      {
+        std::lock_guard<std::mutex> lck(cache.slots[i].second->lck);
+        closed = cache.slots[i].second->conn == NULL;
+      }
+      if (cache.slots[i].first != id_ && !closed) {
+        cache.slots[n++] = cache.slots[i];
+      }
+    }
+    cache.slots.resize(n);
+    cache.slots.push_back(std::make_pair(id_, slot));
+  }
+
+  void SharedSockets::close() {
+    ThreadSlots& cache = thread_slots_;
+    for (size_t i = 0; i < cache.slots.size(); i++) {
+      if (cache.slots[i].first == id_) {
+        closeSlot(*cache.slots[i].second);
+        cache.slots.erase(cache.slots.begin() + i);
+        return;
+      }
+    }
+  }
+
+  void SharedSockets::closeAll() {
+    std::lock_guard<std::mutex> lck(lck_);
+    for (size_t i = 0; i < slots_.size(); i++) {
+      closeSlot(*slots_[i]);
+    }
+    slots_.clear();
+  }
+
+  std::atomic<uint64_t> SharedPublisher::num_instances_(0);
+
+  SharedPublisher::SharedPublisher(const std::string& conn_str,
+    const ConnectionOptions& options) : running_(false), stopping_(false) {
+    conn_str_ = conn_str;
+    options_ = options;
+    publisher_ = NULL;
+    backend_ = NULL;
+    std::stringstream ss;
+    ss << "inproc://jzmq_shared_publisher_" << num_instances_++;
+    backend_conn_str_ = ss.str();
+  }
+
+  SharedPublisher::~SharedPublisher() {
+    if (running_) {
+      stop();
+    }
+  }
+
+  void SharedPublisher::start() {
+    if (running_) {
+      throw std::wruntime_error("SharedPublisher::start() - ERROR: "
+        "already running.");
+    }
+    // Bind here so that errors go to the caller.  The sockets are handed to
+    // the proxy thread (thread creation is a full memory barrier).
+    publisher_ = new Publisher(conn_str_, options_);
+    backend_ = new ProxySocket(backend_conn_str_, Connection::SubscriberType,
+      ZMQ_PULL, true);
+    try {
+      publisher_->initConn();
+    } catch (...) {
+      SAFE_DELETE(publisher_);
+      SAFE_DELETE(backend_);
+      throw;
+    }
+    try {
+      backend_->initConn();  // inproc: must bind before the threads connect
+    } catch (...) {
+      publisher_->killConn();
+      SAFE_DELETE(publisher_);
+      SAFE_DELETE(backend_);
+      throw;
+    }
+
+    stopping_ = false;
+    running_ = true;
+    proxy_ = std::thread(&SharedPublisher::proxyThread, this);
+  }
+
+  void SharedPublisher::stop() {
+    if (!running_) {
+      return;
+    }
+    // The proxy forwards what is already queued before it exits
+    stopping_ = true;
+    proxy_.join();
+
+    sockets_.closeAll();
+    backend_->killConn();
+    publisher_->killConn();
+    SAFE_DELETE(backend_);
+    SAFE_DELETE(publisher_);
+    running_ = false;
+  }
+
+  bool SharedPublisher::running() const {
+    return running_;
+  }
+
+  Connection& SharedPublisher::threadSocket() {
+    Connection* conn = sockets_.find();
+    if (conn != NULL) {
+      return *conn;
+    }
+    if (!running_) {
+      throw std::wruntime_error("SharedPublisher - ERROR: "
+        "start() has not been called.");
+    }
+    conn = new ProxySocket(backend_conn_str_, Connection::PublisherType,
+      ZMQ_PUSH, false);
+    try {
+      conn->initConn();
+    } catch (...) {
+      SAFE_DELETE(conn);
+      throw;
+    }
+    sockets_.add(conn);
+    return *conn;
+  }
+
+  int SharedPublisher::sendData(const char* buff, const uint64_t size,
+    const int timout_ms) {
+    DataBuffer part = {buff, size};
+    return threadSocket().sendMultipart(&part, 1, timout_ms);
+  }
+
+  int SharedPublisher::sendMultipart(const DataBuffer* parts,
+    const uint32_t n_parts, const int timout_ms) {
+    return threadSocket().sendMultipart(parts, n_parts, timout_ms);
+  }
+
+  int SharedPublisher::sendMultipart(std::vector<Message>& parts,
+    const int timout_ms) {
+    return threadSocket().sendMultipart(parts, timout_ms);
+  }
+
+  int SharedPublisher::publish(const std::string& topic, const char* data,
+    const uint64_t size, const int timout_ms) {
+    DataBuffer parts[2] = {{topic.data(), topic.size()}, {data, size}};
+    return threadSocket().sendMultipart(parts, 2, timout_ms);
+  }
+
+  void SharedPublisher::proxyThread() {
+    std::vector<Message> frames;
+    try {
+      while (true) {
+        // Once stopping, drain what the threads have already sent
+        const bool stopping = stopping_;
+        if (backend_->receiveMultipart(frames,
+          stopping ? 0 : proxy_poll_ms) > 0) {
+          publisher_->sendMultipart(frames);
+        } else if (stopping) {
+          break;
+        }
+      }
+    } catch (std::wruntime_error& e) {
+      std::cout << "SharedPublisher::proxyThread() - ERROR: " <<
+        ToNarrowString(e.errorMsg()) << std::endl;
+    }
+  }
+
+  std::atomic<uint64_t> SharedClient::num_instances_(0);
+
+  SharedClient::SharedClient(const std::string& conn_str,
+    const ConnectionOptions& options) : running_(false), stopping_(false) {
+    conn_str_ = conn_str;
+    options_ = options;
+    frontend_ = NULL;
+    backend_ = NULL;
+    std::stringstream ss;
+    ss << "inproc://jzmq_shared_client_" << num_instances_++;
+    backend_conn_str_ = ss.str();
+  }
+
+  SharedClient::~SharedClient() {
+    if (running_) {
+      stop();
+    }
+  }
+
+  void SharedClient::start() {
+    if (running_) {
+      throw std::wruntime_error("SharedClient::start() - ERROR: "
+        "already running.");
+    }
+    frontend_ = new ProxySocket(conn_str_, Connection::ClientType,
+      ZMQ_DEALER, false, options_);
+    backend_ = new ProxySocket(backend_conn_str_, Connection::ServerType,
+      ZMQ_ROUTER, true);
+    try {
+      frontend_->initConn();
+    } catch (...) {
+      SAFE_DELETE(frontend_);
+      SAFE_DELETE(backend_);
+      throw;
+    }
+    try {
+      backend_->initConn();
+    } catch (...) {
+      frontend_->killConn();
+      SAFE_DELETE(frontend_);
+      SAFE_DELETE(backend_);
+      throw;
+    }
+
+    stopping_ = false;
+    running_ = true;
+    proxy_ = std::thread(&SharedClient::proxyThread, this);
+  }
+
+  void SharedClient::stop() {
+    if (!running_) {
+      return;
+    }
+    stopping_ = true;
+    proxy_.join();
+
+    sockets_.closeAll();
+    frontend_->killConn();
+    backend_->killConn();
+    SAFE_DELETE(frontend_);
+    SAFE_DELETE(backend_);
+    running_ = false;
+  }
+
+  bool SharedClient::running() const {
+    return running_;
+  }
+
+  Connection& SharedClient::threadSocket() {
+    Connection* conn = sockets_.find();
+    if (conn != NULL) {
+      return *conn;
+    }
+    if (!running_) {
+      throw std::wruntime_error("SharedClient - ERROR: "
+        "start() has not been called.");
+    }
+    conn = new Client(backend_conn_str_);
+    try {
+      conn->initConn();
+    } catch (...) {
+      SAFE_DELETE(conn);
+      throw;
+    }
+    sockets_.add(conn);
+    return *conn;
+  }
+
+  int SharedClient::request(const DataBuffer* parts, const uint32_t n_parts,
+    std::vector<Message>& reply, const int timout_ms) {
+    Connection& conn = threadSocket();
+    int rc = conn.sendMultipart(parts, n_parts, timout_ms);
+    if (rc <= 0) {
+      return rc;  // Not sent, so the socket can still send
+    }
+    rc = conn.receiveMultipart(reply, timout_ms);
+    if (rc <= 0) {
+      sockets_.close();  // A ZMQ_REQ socket can't send until it has a reply
+    }
+    return rc;
+  }
+
+  int SharedClient::request(const char* data, const uint64_t size,
+    Message& reply, const int timout_ms) {
+    Connection& conn = threadSocket();
+    DataBuffer part = {data, size};
+    int rc = conn.sendMultipart(&part, 1, timout_ms);
+    if (rc <= 0) {
+      return rc;
+    }
+    rc = conn.receiveMessage(reply, timout_ms);
+    if (rc <= 0) {
+      sockets_.close();
+    }
+    return rc;
+  }
+
+  void SharedClient::proxyThread() {
+    // [thread identity][empty][request...] goes out unchanged through the
+    // DEALER, and the server's reply comes back with the same envelope for
+    // the ROUTER to route.  Sends don't wait: a request the server can't
+    // take is dropped and its thread times out.
+    std::vector<Message> frames;
+    try {
+      Poller poller;
+      poller.add(*backend_, Poller::ReadEvent, [&](Connection&, const int) {
+        while (backend_->receiveMultipart(frames, 0) > 0) {
+          frontend_->sendMultipart(frames, 0);
+        }
+      });
+      poller.add(*frontend_, Poller::ReadEvent, [&](Connection&, const int) {
+        while (frontend_->receiveMultipart(frames, 0) > 0) {
+          backend_->sendMultipart(frames, 0);
+        }
+      });
+      while (!stopping_) {
+        poller.poll(proxy_poll_ms);
+      }
+    } catch (std::wruntime_error& e) {
+      std::cout << "SharedClient::proxyThread() - ERROR: " <<
+        ToNarrowString(e.errorMsg()) << std::endl;
+    }
+  }
+
+}  // namespace jzmq
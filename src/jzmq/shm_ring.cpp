@@ -0,0 +1,754 @@
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <zmq.h>
+#include "jzmq/shm_ring.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#if !defined(_WIN32)
+  #include <fcntl.h>
+  #include <signal.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#if defined(__linux__)
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+#endif
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  const uint64_t ShmRing::kDefaultSize;
+  const uint32_t ShmRing::kMaxReaders;
+  const uint32_t ShmRing::kMaxPending;
+  const int ShmRing::kClosed;
+
+  static const uint32_t kShmMagic = 0x4a5a534d;  // "JZSM"
+  static const uint32_t kShmVersion = 1;
+  // Records (and so the frame data) are aligned to this
+  static const uint64_t kRecordAlign = 32;
+  static const uint64_t kPageSize = 4096;
+  // Record flags
+  static const uint32_t kFrameMore = 1;  // Another frame of the message follows
+  static const uint32_t kFramePad = 2;  // Skip to the start of the ring
+  // Reader slot states.  A claimed slot is ignored by the writer until the
+  // reader has set its tail.
+  static const uint32_t kSlotFree = 0;
+  static const uint32_t kSlotClaimed = 1;
+  static const uint32_t kSlotActive = 2;
+  // Blocking calls wake up at least this often to check the other side is
+  // still alive (and for new rings on the control socket)
+  static const int kSliceMs = 100;
+
+  struct ShmReaderSlot {
+    std::atomic<uint32_t> state;
+    int32_t pid;
+    std::atomic<uint64_t> tail;  // Everything before tail has been released
+    char pad[48];
+  };
+
+  // The start of the segment.  The groups written by different processes are
+  // kept on separate cache lines.
+  struct ShmRingHeader {
+    std::atomic<uint32_t> magic;  // Set last, once the header is initialized
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t generation;
+    int32_t writer_pid;
+    std::atomic<uint32_t> closed;
+    char pad0[32];
+    std::atomic<uint64_t> head;  // Everything before head has been committed
+    char pad1[56];
+    std::atomic<uint32_t> data_seq;  // Futex word: bumped on every commit
+    std::atomic<uint32_t> data_waiters;
+    char pad2[56];
+    std::atomic<uint32_t> space_seq;  // Futex word: bumped on every release
+    std::atomic<uint32_t> space_waiters;
+    char pad3[56];
+    ShmReaderSlot readers[ShmRing::kMaxReaders];
+  };
+
+  // Every frame is one record: this header followed by the frame data,
+  // padded to kRecordAlign.  A frame that doesn't fit before the end of the
+  // ring goes at the start behind a kFramePad record.
+  struct ShmRecord {
+    uint64_t size;  // Frame size (for kFramePad the whole record)
+    uint64_t msg_seq;
+    uint32_t flags;
+    uint32_t reserved[3];
+  };
+
+  class ShmRing::Pending {
+  public:
+    uint64_t end;  // Position just past the message
+    std::atomic<uint32_t> refs;  // Frames not yet released
+  };
+
+  static uint64_t recordSize(const uint64_t frame_size) {
+    const uint64_t size = sizeof(ShmRecord) + frame_size;
+    return (size + kRecordAlign - 1) & ~(kRecordAlign - 1);
+  }
+
+  // Where a record of record_size bytes written at pos starts (after a
+  // padding record if it would wrap)
+  static uint64_t placeRecord(const uint64_t pos, const uint64_t record_size,
+    const uint64_t capacity) {
+    const uint64_t index = pos % capacity;
+    return index + record_size > capacity ? pos + capacity - index : pos;
+  }
+
+  static uint64_t dataOffset() {
+    return (sizeof(ShmRingHeader) + kPageSize - 1) & ~(kPageSize - 1);
+  }
+
+  static int64_t nowMs() {
+    return (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // -1 for no deadline
+  static int64_t deadlineMs(const int timout_ms) {
+    return timout_ms < 0 ? -1 : nowMs() + timout_ms;
+  }
+
+  // How long the next wait may be: the time left, capped at kSliceMs
+  static int sliceMs(const int64_t deadline_ms) {
+    if (deadline_ms < 0) {
+      return kSliceMs;
+    }
+    const int64_t left = deadline_ms - nowMs();
+    return left <= 0 ? 0 : (int)std::min<int64_t>(left, kSliceMs);
+  }
+
+  static void throwErrno(const std::string& err_msg) {
+    std::stringstream ss;
+    ss << err_msg << " (errno[" << errno << "]=" << strerror(errno) << ")";
+    throw std::wruntime_error(ss.str());
+  }
+
+  // The words live in a shared mapping, so these are not FUTEX_PRIVATE
+  static void futexWait(std::atomic<uint32_t>& word, const uint32_t value,
+    const int timout_ms) {
+#if defined(__linux__)
+    struct timespec ts;
+    ts.tv_sec = timout_ms / 1000;
+    ts.tv_nsec = (long)(timout_ms % 1000) * 1000000L;
+    // EINTR, EAGAIN and ETIMEDOUT all mean "check again"
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value,
+      &ts, NULL, 0);
+#else
+    if (word.load() == value && timout_ms > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+#endif
+  }
+
+  static void futexWake(std::atomic<uint32_t>& word) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE,
+      INT_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+  }
+
+  static bool processAlive(const int32_t pid) {
+#if defined(_WIN32)
+    (void)pid;
+    return true;
+#else
+    return kill(pid, 0) == 0 || errno != ESRCH;
+#endif
+  }
+
+  // Returns the pid of the writer of the ring at path if it is still open
+  // and its writer alive, otherwise 0
+  static int32_t liveWriter(const std::string& path) {
+#if defined(_WIN32)
+    (void)path;
+    return 0;
+#else
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      return 0;
+    }
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+      (uint64_t)st.st_size >= sizeof(ShmRingHeader)) {
+      addr = mmap(NULL, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      return 0;
+    }
+    const ShmRingHeader* header = static_cast<ShmRingHeader*>(addr);
+    int32_t pid = 0;
+    if (header->magic.load(std::memory_order_acquire) == kShmMagic &&
+      header->closed.load() == 0 && processAlive(header->writer_pid)) {
+      pid = header->writer_pid;
+    }
+    munmap(addr, sizeof(ShmRingHeader));
+    return pid;
+#endif
+  }
+
+  ShmRing::ShmRing() {
+  }
+
+  ShmRing::ShmRing(const std::string& name, const uint64_t size) {
+    init(name, Writer);
+#if defined(_WIN32)
+    (void)size;
+    throw std::wruntime_error("ShmRing::ShmRing() - ERROR: "
+      "shm:// is not supported on Windows.");
+#else
+    if (size < kPageSize) {
+      throw std::wruntime_error("ShmRing::ShmRing() - ERROR: "
+        "The ring must hold at least 4096 bytes.");
+    }
+    capacity_ = (size + kPageSize - 1) & ~(kPageSize - 1);
+
+    // A stale ring left behind by a publisher that died is replaced
+    // (subscribers still mapping it see its writer is gone), but not one
+    // that is still being written
+    const int32_t writer_pid = liveWriter(path_);
+    if (writer_pid != 0) {
+      std::stringstream ss;
+      ss << "ShmRing::ShmRing() - ERROR: " << path_ << " is in use by ";
+      ss << "process " << writer_pid;
+      throw std::wruntime_error(ss.str());
+    }
+    shm_unlink(path_.c_str());
+    int fd = shm_open(path_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      throwErrno("ShmRing::ShmRing() - ERROR: Could not create " + path_);
+    }
+    if (ftruncate(fd, (off_t)(dataOffset() + capacity_)) != 0) {
+      ::close(fd);
+      shm_unlink(path_.c_str());
+      throwErrno("ShmRing::ShmRing() - ERROR: Could not size " + path_);
+    }
+    try {
+      map(fd, dataOffset() + capacity_);
+    } catch (...) {
+      shm_unlink(path_.c_str());
+      throw;
+    }
+
+    // ftruncate zero filled the segment: every counter and slot starts at 0
+    header_->version = kShmVersion;
+    header_->capacity = capacity_;
+    header_->writer_pid = (int32_t)getpid();
+    header_->generation = (uint64_t)std::chrono::steady_clock::now().
+      time_since_epoch().count() ^ ((uint64_t)header_->writer_pid << 48);
+    header_->magic.store(kShmMagic, std::memory_order_release);
+    space_limit_ = capacity_;
+#endif
+  }
+
+  void ShmRing::init(const std::string& name, const Role role) {
+    path_ = "/jzmq_" + name;
+    role_ = role;
+    header_ = NULL;
+    data_ = NULL;
+    map_size_ = 0;
+    capacity_ = 0;
+    refs_.store(1);
+    head_ = 0;
+    space_limit_ = 0;
+    msg_seq_ = 0;
+    slot_ = kMaxReaders;
+    pos_ = 0;
+    started_ = false;
+    read_seq_.store(0);
+    retire_seq_.store(0);
+    pending_ = NULL;
+  }
+
+  ShmRing* ShmRing::attach(const std::string& name) {
+#if defined(_WIN32)
+    (void)name;
+    throw std::wruntime_error("ShmRing::attach() - ERROR: "
+      "shm:// is not supported on Windows.");
+#else
+    ShmRing* ring = new ShmRing();
+    ring->init(name, Reader);
+    int fd = shm_open(ring->path_.c_str(), O_RDWR, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+      (uint64_t)st.st_size < dataOffset()) {
+      if (fd >= 0) {
+        ::close(fd);  // Still being created
+      }
+      delete ring;
+      return NULL;
+    }
+    try {
+      ring->map(fd, (uint64_t)st.st_size);
+    } catch (...) {
+      delete ring;
+      throw;
+    }
+
+    ShmRingHeader* header = ring->header_;
+    if (header->magic.load(std::memory_order_acquire) != kShmMagic ||
+      header->closed.load() != 0 || !processAlive(header->writer_pid)) {
+      delete ring;  // Not initialized yet, or dead
+      return NULL;
+    }
+    if (header->version != kShmVersion ||
+      dataOffset() + header->capacity != ring->map_size_) {
+      delete ring;
+      throw std::wruntime_error("ShmRing::attach() - ERROR: "
+        "Incompatible ring /jzmq_" + name);
+    }
+    ring->capacity_ = header->capacity;
+
+    // Claim a slot.  The writer ignores it until it is active, so the tail
+    // must be valid first; the head is read again once the writer can see
+    // the slot and anything after that can't be overwritten before we read
+    // it.
+    for (uint32_t i = 0; i < kMaxReaders && ring->slot_ == kMaxReaders; i++) {
+      uint32_t expected = kSlotFree;
+      if (header->readers[i].state.compare_exchange_strong(expected,
+        kSlotClaimed)) {
+        ring->slot_ = i;
+      }
+    }
+    if (ring->slot_ == kMaxReaders) {
+      delete ring;
+      throw std::wruntime_error("ShmRing::attach() - ERROR: "
+        "Too many subscribers on /jzmq_" + name);
+    }
+    ShmReaderSlot& slot = header->readers[ring->slot_];
+    slot.pid = (int32_t)getpid();
+    slot.tail.store(header->head.load());
+    slot.state.store(kSlotActive);
+    ring->pos_ = header->head.load();
+    slot.tail.store(ring->pos_);
+    ring->pending_ = new Pending[kMaxPending];
+    return ring;
+#endif
+  }
+
+  ShmRing::~ShmRing() {
+#if !defined(_WIN32)
+    if (header_ != NULL) {
+      if (role_ == Reader && slot_ < kMaxReaders) {
+        header_->readers[slot_].state.store(kSlotFree);
+        // A writer waiting for this reader can go ahead
+        header_->space_seq.fetch_add(1);
+        futexWake(header_->space_seq);
+      }
+      munmap(header_, (size_t)map_size_);
+    }
+#endif
+    SAFE_DELETE_ARR(pending_);
+  }
+
+  void ShmRing::map(const int fd, const uint64_t size) {
+#if defined(_WIN32)
+    (void)fd;
+    (void)size;
+#else
+    void* addr = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      throwErrno("ShmRing::map() - ERROR: Could not map " + path_);
+    }
+    header_ = static_cast<ShmRingHeader*>(addr);
+    data_ = static_cast<char*>(addr) + dataOffset();
+    map_size_ = size;
+#endif
+  }
+
+  void ShmRing::unref() {
+    if (refs_.fetch_sub(1) == 1) {
+      delete this;
+    }
+  }
+
+  void ShmRing::close() {
+#if !defined(_WIN32)
+    if (role_ == Writer && header_ != NULL) {
+      header_->closed.store(1);
+      header_->data_seq.fetch_add(1);
+      futexWake(header_->data_seq);
+      shm_unlink(path_.c_str());
+    }
+#endif
+    unref();
+  }
+
+  uint64_t ShmRing::generation() const {
+    return header_->generation;
+  }
+
+  uint64_t ShmRing::capacity() const {
+    return capacity_;
+  }
+
+  uint64_t ShmRing::minReaderTail(const bool reap_dead_readers) {
+    uint64_t min_tail = head_;
+    for (uint32_t i = 0; i < kMaxReaders; i++) {
+      ShmReaderSlot& slot = header_->readers[i];
+      if (slot.state.load() != kSlotActive) {
+        continue;
+      }
+      if (reap_dead_readers && !processAlive(slot.pid)) {
+        uint32_t expected = kSlotActive;
+        slot.state.compare_exchange_strong(expected, kSlotFree);
+        continue;
+      }
+      min_tail = std::min<uint64_t>(min_tail, slot.tail.load());
+    }
+    return min_tail;
+  }
+
+  bool ShmRing::waitForSpace(const uint64_t end, const int timout_ms) {
+    const int64_t deadline_ms = deadlineMs(timout_ms);
+    bool reap = false;
+    while (true) {
+      const uint32_t seq = header_->space_seq.load();
+      space_limit_ = minReaderTail(reap) + capacity_;
+      if (end <= space_limit_) {
+        return true;
+      }
+      const int slice_ms = sliceMs(deadline_ms);
+      if (slice_ms == 0) {
+        return false;
+      }
+      // Readers check space_waiters after moving their tail, so either they
+      // see us waiting or we see the new tail
+      header_->space_waiters.fetch_add(1);
+      if (minReaderTail(false) + capacity_ < end) {
+        futexWait(header_->space_seq, seq, slice_ms);
+      }
+      header_->space_waiters.fetch_sub(1);
+      reap = true;  // A reader is slow: check it is still alive
+    }
+  }
+
+  int ShmRing::write(const DataBuffer* parts, const uint32_t n_parts,
+    const int timout_ms) {
+    uint64_t end = head_;
+    uint64_t n_bytes = 0;
+    for (uint32_t i = 0; i < n_parts; i++) {
+      const uint64_t record_size = recordSize(parts[i].size);
+      end = placeRecord(end, record_size, capacity_) + record_size;
+      n_bytes += parts[i].size;
+    }
+    if (end - head_ > capacity_ / 2 || n_bytes > INT_MAX) {
+      std::stringstream ss;
+      ss << "ShmRing::write() - ERROR: A " << n_bytes << " byte message ";
+      ss << "doesn't fit in the " << capacity_ << " byte ring (see ";
+      ss << "ConnectionOptions::shm_ring_mb).";
+      throw std::wruntime_error(ss.str());
+    }
+    if (end > space_limit_ && !waitForSpace(end, timout_ms)) {
+      return 0;
+    }
+
+    uint64_t pos = head_;
+    for (uint32_t i = 0; i < n_parts; i++) {
+      const uint64_t record_size = recordSize(parts[i].size);
+      const uint64_t start = placeRecord(pos, record_size, capacity_);
+      if (start != pos) {
+        ShmRecord* pad = reinterpret_cast<ShmRecord*>(data_ + pos % capacity_);
+        pad->size = start - pos;
+        pad->msg_seq = msg_seq_;
+        pad->flags = kFramePad;
+      }
+      ShmRecord* record = reinterpret_cast<ShmRecord*>(data_ +
+        start % capacity_);
+      record->size = parts[i].size;
+      record->msg_seq = msg_seq_;
+      record->flags = (i + 1 < n_parts) ? kFrameMore : 0;
+      memcpy(record + 1, parts[i].data, (size_t)parts[i].size);
+      pos = start + record_size;
+    }
+
+    // Commit the whole message at once.  Readers check head after announcing
+    // they are waiting, so either they see it or we see them.
+    msg_seq_++;
+    head_ = pos;
+    header_->head.store(head_);
+    header_->data_seq.fetch_add(1);
+    if (header_->data_waiters.load() > 0) {
+      futexWake(header_->data_seq);
+    }
+    return (int)n_bytes;
+  }
+
+  bool ShmRing::matches(const ShmRecord* record,
+    const std::vector<std::string>& topics) const {
+    const char* data = reinterpret_cast<const char*>(record + 1);
+    for (uint32_t i = 0; i < topics.size(); i++) {
+      if (topics[i].size() <= record->size &&
+        memcmp(data, topics[i].data(), topics[i].size()) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int ShmRing::read(std::vector<Message>& parts,
+    const std::vector<std::string>& topics, const int timout_ms) {
+    parts.clear();
+    const int64_t deadline_ms = deadlineMs(timout_ms);
+    while (true) {
+      const uint32_t seq = header_->data_seq.load();
+      const uint64_t head = header_->head.load();
+      while (pos_ < head) {
+        const ShmRecord* first = reinterpret_cast<const ShmRecord*>(data_ +
+          pos_ % capacity_);
+        if ((first->flags & kFramePad) != 0) {
+          pos_ += first->size;
+          continue;
+        }
+        const uint64_t msg_seq = first->msg_seq;
+        if (!started_) {
+          started_ = true;
+          read_seq_.store(msg_seq);
+          retire_seq_.store(msg_seq);
+        }
+        if (msg_seq - retire_seq_.load() >= kMaxPending) {
+          throw std::wruntime_error("ShmRing::read() - ERROR: "
+            "Too many received messages have not been released.");
+        }
+
+        // Find the end of the message and its frames; the writer commits
+        // whole messages so they are all there
+        const bool wanted = matches(first, topics);
+        uint32_t n_refs = 0;
+        uint64_t end = pos_;
+        bool more = true;
+        while (more) {
+          const ShmRecord* record = reinterpret_cast<const ShmRecord*>(
+            data_ + end % capacity_);
+          if ((record->flags & kFramePad) != 0) {
+            end += record->size;
+            continue;
+          }
+          n_refs += (wanted && record->size > 0) ? 1 : 0;
+          more = (record->flags & kFrameMore) != 0;
+          end += recordSize(record->size);
+        }
+
+        // The message is retired (and its space handed back) once every
+        // frame has been released
+        Pending& pending = pending_[msg_seq % kMaxPending];
+        pending.end = end;
+        pending.refs.store(n_refs);
+        refs_.fetch_add(n_refs);
+        read_seq_.store(msg_seq + 1);
+        uint64_t pos = pos_;
+        pos_ = end;
+        if (!wanted || n_refs == 0) {
+          retire();
+        }
+        if (!wanted) {
+          continue;
+        }
+        while (pos < end) {
+          ShmRecord* record = reinterpret_cast<ShmRecord*>(data_ +
+            pos % capacity_);
+          if ((record->flags & kFramePad) == 0) {
+            if (record->size > 0) {
+              parts.push_back(Message(reinterpret_cast<char*>(record + 1),
+                record->size, releaseFrame, this));
+            } else {
+              parts.push_back(Message());
+            }
+          }
+          pos += (record->flags & kFramePad) != 0 ? record->size :
+            recordSize(record->size);
+        }
+        return (int)parts.size();
+      }
+
+      const int slice_ms = sliceMs(deadline_ms);
+      if (slice_ms == 0) {
+        return 0;
+      }
+      if (header_->closed.load() != 0 ||
+        !processAlive(header_->writer_pid)) {
+        if (header_->head.load() == pos_) {
+          return kClosed;
+        }
+        continue;  // Read what was committed before it closed
+      }
+      header_->data_waiters.fetch_add(1);
+      if (header_->head.load() == pos_) {
+        futexWait(header_->data_seq, seq, slice_ms);
+      }
+      header_->data_waiters.fetch_sub(1);
+    }
+  }
+
+  void ShmRing::retire() {
+    std::unique_lock<std::mutex> lck(retire_lck_);
+    const uint64_t read_seq = read_seq_.load();
+    uint64_t seq = retire_seq_.load();
+    uint64_t tail = 0;
+    while (seq < read_seq && pending_[seq % kMaxPending].refs.load() == 0) {
+      tail = pending_[seq % kMaxPending].end;
+      seq++;
+    }
+    if (seq == retire_seq_.load()) {
+      return;
+    }
+    retire_seq_.store(seq);
+    header_->readers[slot_].tail.store(tail);
+    header_->space_seq.fetch_add(1);
+    if (header_->space_waiters.load() > 0) {
+      futexWake(header_->space_seq);
+    }
+  }
+
+  void ShmRing::releaseFrame(void* data, void* hint) {
+    ShmRing* ring = static_cast<ShmRing*>(hint);
+    const ShmRecord* record = reinterpret_cast<const ShmRecord*>(data) - 1;
+    Pending& pending = ring->pending_[record->msg_seq % kMaxPending];
+    if (pending.refs.fetch_sub(1) == 1) {
+      ring->retire();
+    }
+    ring->unref();
+  }
+
+  std::string ShmRing::shmName(const std::string& conn_str) {
+    const std::string prefix = "shm://";
+    if (conn_str.compare(0, prefix.size(), prefix) != 0) {
+      return "";
+    }
+    std::string name = conn_str.substr(prefix.size());
+    if (name.size() == 0 || name.find('/') != std::string::npos) {
+      throw std::wruntime_error("ShmRing::shmName() - ERROR: "
+        "Invalid shm:// name in " + conn_str);
+    }
+    return name;
+  }
+
+  std::string ShmRing::controlAddress(const std::string& name) {
+    return "ipc:///tmp/jzmq_shm_" + name;
+  }
+
+  ShmChannel::ShmChannel(const std::string& name, const ShmRing::Role role,
+    void* control, const uint64_t size) {
+    name_ = name;
+    role_ = role;
+    control_ = control;
+    ring_ = NULL;
+    if (role_ == ShmRing::Writer) {
+      ring_ = new ShmRing(name_, size);
+      announce(ring_->generation());
+    } else {
+      reattach();  // The publisher may not have started yet
+    }
+  }
+
+  ShmChannel::~ShmChannel() {
+    if (ring_ != NULL) {
+      ring_->close();
+      ring_ = NULL;
+    }
+  }
+
+  int ShmChannel::send(const DataBuffer* parts, const uint32_t n_parts,
+    const int timout_ms) {
+    return ring_->write(parts, n_parts, timout_ms);
+  }
+
+  int ShmChannel::send(std::vector<Message>& parts, const int timout_ms) {
+    // The frames are copied into the ring either way
+    buffers_.resize(parts.size());
+    for (size_t i = 0; i < parts.size(); i++) {
+      buffers_[i].data = parts[i].data();
+      buffers_[i].size = parts[i].size();
+    }
+    int rc = ring_->write(&buffers_[0], (uint32_t)parts.size(), timout_ms);
+    for (size_t i = 0; rc > 0 && i < parts.size(); i++) {
+      parts[i] = Message();
+    }
+    return rc;
+  }
+
+  int ShmChannel::receive(std::vector<Message>& parts, const int timout_ms) {
+    const int64_t deadline_ms = deadlineMs(timout_ms);
+    while (true) {
+      const int slice_ms = sliceMs(deadline_ms);
+      if (ring_ != NULL) {
+        int rc = ring_->read(parts, topics_, slice_ms);
+        if (rc > 0) {
+          return rc;
+        }
+        if (rc == ShmRing::kClosed) {
+          ring_->close();
+          ring_ = NULL;
+          reattach();
+        } else if (pollControl(0)) {
+          reattach();  // The publisher restarted
+        }
+      } else {
+        // Wait for an announcement, but also look for the segment directly
+        // in case we connected after it was sent
+        pollControl(slice_ms);
+        reattach();
+      }
+      if (sliceMs(deadline_ms) == 0) {
+        return 0;
+      }
+    }
+  }
+
+  void ShmChannel::setTopics(const std::vector<std::string>& topics) {
+    topics_ = topics;
+  }
+
+  void ShmChannel::announce(const uint64_t generation) {
+    // Best effort: subscribers also poll for the segment
+    zmq_send(control_, &generation, sizeof(generation), ZMQ_DONTWAIT);
+  }
+
+  bool ShmChannel::pollControl(const int timout_ms) {
+    zmq_pollitem_t items [] = {{control_, 0, ZMQ_POLLIN, 0}};
+    if (zmq_poll(items, 1, timout_ms) <= 0) {
+      return false;  // Timeout or EINTR
+    }
+    bool changed = false;
+    uint64_t generation;
+    while (zmq_recv(control_, &generation, sizeof(generation),
+      ZMQ_DONTWAIT) >= 0) {
+      changed = changed || ring_ == NULL ||
+        generation != ring_->generation();
+    }
+    return changed;
+  }
+
+  void ShmChannel::reattach() {
+    ShmRing* ring = ShmRing::attach(name_);
+    if (ring == NULL) {
+      return;
+    }
+    if (ring_ != NULL && ring->generation() == ring_->generation()) {
+      ring->close();  // Already attached to it
+      return;
+    }
+    if (ring_ != NULL) {
+      ring_->close();
+    }
+    ring_ = ring;
+  }
+
+}  // namespace jzmq
@@ -1,9 +1,11 @@
 #include <mutex>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 #include <assert.h>
 #include <zmq.h>
 #include "jzmq/subscriber.h"
+#include "jzmq/shm_ring.h"
 #include "jtil/exceptions/wruntime_error.h"
 
 #define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
@@ -11,56 +13,152 @@
 
 namespace jzmq {
 
-  Subscriber::Subscriber(const std::string& conn_str) : 
-    Connection(conn_str, SubscriberType){
+  Subscriber::Subscriber(const std::string& conn_str, 
+    const ConnectionOptions& options) : 
+    Connection(conn_str, SubscriberType, options) {
+    default_subscription_ = false;
   }
 
   Subscriber::~Subscriber() {
-    if (socket_ != NULL) {
-      // A socket might not close correctly on a fatal error condition
-      // Don't throw an exception or raise an assertion, but let the user know.
-      std::cout << "Warning: Socket was not closed!" << std::endl;
+    closeSocket();
+  }
+
+  Subscriber::Subscriber(Subscriber&& other) : 
+    Connection(std::move(other)), topics_(std::move(other.topics_)),
+    default_subscription_(other.default_subscription_),
+    frames_(std::move(other.frames_)), topic_(std::move(other.topic_)) {
+  }
+
+  Subscriber& Subscriber::operator=(Subscriber&& other) {
+    if (this != &other) {
+      Connection::operator=(std::move(other));
+      topics_ = std::move(other.topics_);
+      default_subscription_ = other.default_subscription_;
+      frames_ = std::move(other.frames_);
+      topic_ = std::move(other.topic_);
     }
+    return *this;
   }
   
   void Subscriber::initConn() {
-    if (socket_ != NULL) {
+    if (socket_ != NULL || transport_ != NULL) {
       throw std::wruntime_error("Subscriber::initConn() - ERROR: "
         "connection already initialized.");
     }
+    // Don't filter anything until a topic is subscribed
+    default_subscription_ = topics_.size() == 0;
+    const std::vector<std::string> everything(1, "");
+    const std::vector<std::string>& filter = default_subscription_ ? 
+      everything : topics_;
+    if (initThreadTransport()) {
+      transport_->setTopics(filter);
+      return;
+    }
+    // shm:// data goes through the ring; the socket only carries control
+    const std::string shm_name = ShmRing::shmName(conn_str_);
     void* context = Connection::initContext();
     
     socket_ = zmq_socket(context, ZMQ_SUB);
     if (socket_ == NULL) {
+      killContext();
       throwErrorMessage("Subscriber::initConn() - ERROR: "
         "Could not create ZMQ_SUB socket");
     }
+    applySocketOptions();
 
-    int rc = zmq_connect(socket_, conn_str_.c_str());
+    const std::string address = shm_name.empty() ? conn_str_ : 
+      ShmRing::controlAddress(shm_name);
+    int rc = zmq_connect(socket_, address.c_str());
     if (rc != 0) {
-      throwErrorMessage("Subscriber::initConn() - ERROR: "
+      closeAndThrow("Subscriber::initConn() - ERROR: "
         "Could not connect ZMQ_SUB socket");
     }
 
-    const char* filter = "";  // Don't filter anything
-    rc = zmq_setsockopt(socket_, ZMQ_SUBSCRIBE, filter, strlen(filter));
-    if (rc != 0) {
-      throwErrorMessage("Subscriber::initConn() - ERROR: "
-        "Could not subscribe ZMQ_SUB socket");
+    if (!shm_name.empty()) {
+      // Every announcement is needed; topics are filtered by the ring reader
+      setSubscription(ZMQ_SUBSCRIBE, "");
+      initShm(shm_name, false);
+      transport_->setTopics(filter);
+    } else {
+      for (uint32_t i = 0; i < filter.size(); i++) {
+        setSubscription(ZMQ_SUBSCRIBE, filter[i]);
+      }
     }
-
-    num_open_connections_++;
   }
 
   void Subscriber::killConn() {
-    if (socket_ == NULL) {
+    if (socket_ == NULL && transport_ == NULL) {
       throw std::wruntime_error("Subscriber::killConn() - ERROR: "
         "Socket has not been initialized!");
     }
-    zmq_close(socket_);
-    socket_ = NULL;
-    num_open_connections_--;
-    killContext();
+    closeSocket();
+  }
+
+  void Subscriber::subscribe(const std::string& topic) {
+    if (socket_ != NULL && transport_ == NULL) {
+      setSubscription(ZMQ_SUBSCRIBE, topic);
+      if (default_subscription_) {
+        setSubscription(ZMQ_UNSUBSCRIBE, "");  // Now narrowed to topic
+      }
+    }
+    default_subscription_ = false;
+    topics_.push_back(topic);
+    if (transport_ != NULL) {
+      transport_->setTopics(topics_);
+    }
+  }
+
+  void Subscriber::unsubscribe(const std::string& topic) {
+    std::vector<std::string>::iterator it = std::find(topics_.begin(), 
+      topics_.end(), topic);
+    if (it == topics_.end()) {
+      throw std::wruntime_error("Subscriber::unsubscribe() - ERROR: "
+        "Not subscribed to topic " + topic);
+    }
+    if (socket_ != NULL && transport_ == NULL) {
+      setSubscription(ZMQ_UNSUBSCRIBE, topic);
+    }
+    topics_.erase(it);
+    if (transport_ != NULL) {
+      transport_->setTopics(topics_);
+    }
+  }
+
+  const std::vector<std::string>& Subscriber::topics() const {
+    return topics_;
+  }
+
+  int Subscriber::receiveLatest(
+    std::map<std::string, std::vector<Message> >& latest, 
+    const int timout_ms) {
+    int rc = receiveMultipart(frames_, timout_ms);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    int n_msgs = 0;
+    do {
+      n_msgs++;
+      // Superseded messages are just swapped out and released; the reused 
+      // topic_ means no allocation once every topic has been seen
+      topic_.assign(frames_[0].data(), (size_t)frames_[0].size());
+      std::map<std::string, std::vector<Message> >::iterator it = 
+        latest.find(topic_);
+      if (it == latest.end()) {
+        it = latest.insert(std::make_pair(topic_, 
+          std::vector<Message>())).first;
+      }
+      it->second.swap(frames_);
+    } while (receiveMultipart(frames_, 0) > 0);
+    return n_msgs;
+  }
+
+  void Subscriber::setSubscription(const int option, 
+    const std::string& topic) {
+    int rc = zmq_setsockopt(socket_, option, topic.data(), topic.size());
+    if (rc != 0) {
+      throwErrorMessage("Subscriber::setSubscription() - ERROR: "
+        "Could not set subscription on ZMQ_SUB socket");
+    }
   }
 
 }  // namespace jzmq
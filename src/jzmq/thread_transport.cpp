@@ -0,0 +1,411 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+  defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+#include "jzmq/thread_transport.h"
+#include "jzmq/bounded_queue.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  static const char* kThreadPrefix = "thread://";
+  static const uint32_t kDefaultQueueSize = 1000;  // ZeroMQ's default HWM
+  static const uint32_t kMaxQueueSize = 1 << 20;
+  // Bounds of the adaptive spin of an empty receive queue (in pauses)
+  static const uint32_t kMinSpin = 16;
+  static const uint32_t kMaxSpin = 4096;
+  // Yields between spinning and blocking
+  static const uint32_t kNumYields = 16;
+  static const uint32_t kEnvelopePoolSize = 4096;
+
+  static inline void cpuRelax() {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+  defined(__x86_64__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  typedef std::chrono::steady_clock Clock;
+
+  // One message in flight between two threads.
+  struct ThreadEnvelope {
+    std::vector<Message> frames;
+    std::shared_ptr<ThreadInbox> reply_to;  // Client requests only
+  };
+
+  // Released envelopes (and the capacity of their frame vectors) are reused
+  // so steady state traffic doesn't allocate.  The pool is never freed:
+  // envelopes may still be released during static destruction.
+  static BoundedQueue<ThreadEnvelope*>* envelope_pool_ =
+    new BoundedQueue<ThreadEnvelope*>(kEnvelopePoolSize);
+
+  static ThreadEnvelope* getEnvelope() {
+    ThreadEnvelope* env;
+    if (!envelope_pool_->pop(env)) {
+      env = new ThreadEnvelope();
+    }
+    return env;
+  }
+
+  static void putEnvelope(ThreadEnvelope* env) {
+    env->frames.clear();
+    env->reply_to.reset();
+    if (!envelope_pool_->push(env)) {
+      delete env;
+    }
+  }
+
+  // The receive queue of one connection.  Any thread may push; only the
+  // owning connection pops.
+  class ThreadInbox {
+  public:
+    explicit ThreadInbox(const uint32_t capacity) : queue_(capacity) {
+      sleepers_.store(0);
+      spin_ = kMinSpin;
+    }
+
+    ~ThreadInbox() {
+      ThreadEnvelope* env;
+      while (queue_.pop(env)) {
+        putEnvelope(env);
+      }
+    }
+
+    // Waits up to timout_ms for space.  The queue only fills up when its
+    // consumer falls behind, so the wait polls with an increasing back-off
+    // rather than making every pop signal producers.
+    bool push(ThreadEnvelope* env, const int timout_ms) {
+      if (!queue_.push(env)) {
+        if (timout_ms == 0) {
+          return false;
+        }
+        const Clock::time_point deadline = Clock::now() +
+          std::chrono::milliseconds(timout_ms);
+        for (uint32_t i = 0; !queue_.push(env); i++) {
+          if (timout_ms > 0 && Clock::now() >= deadline) {
+            return false;
+          }
+          if (i < kMinSpin) {
+            cpuRelax();
+          } else if (i < kMinSpin + kNumYields) {
+            std::this_thread::yield();
+          } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+          }
+        }
+      }
+      // Pairs with the fence in pop: either the consumer sees the envelope
+      // before it sleeps or we see it sleeping.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleepers_.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lck(lck_);
+        cond_.notify_all();
+      }
+      return true;
+    }
+
+    // Spins, then yields, then blocks until an envelope arrives or
+    // timout_ms expires.  The spin doubles every time it catches a message
+    // and halves every time it doesn't, so a busy connection never sleeps
+    // and an idle one gives its core back quickly.
+    bool pop(ThreadEnvelope*& env, const int timout_ms) {
+      if (queue_.pop(env)) {
+        return true;
+      }
+      if (timout_ms == 0) {
+        return false;
+      }
+      for (uint32_t i = 0; i < spin_; i++) {
+        cpuRelax();
+        if (queue_.pop(env)) {
+          spin_ = std::min<uint32_t>(spin_ * 2, kMaxSpin);
+          return true;
+        }
+      }
+      spin_ = std::max<uint32_t>(spin_ / 2, kMinSpin);
+      for (uint32_t i = 0; i < kNumYields; i++) {
+        std::this_thread::yield();
+        if (queue_.pop(env)) {
+          return true;
+        }
+      }
+
+      const Clock::time_point deadline = Clock::now() +
+        std::chrono::milliseconds(std::max<int>(timout_ms, 0));
+      std::unique_lock<std::mutex> lck(lck_);
+      sleepers_++;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      bool popped = true;
+      while (!queue_.pop(env)) {
+        if (timout_ms < 0) {
+          cond_.wait(lck);
+        } else if (cond_.wait_until(lck, deadline) ==
+          std::cv_status::timeout) {
+          popped = queue_.pop(env);
+          break;
+        }
+      }
+      sleepers_--;
+      return popped;
+    }
+
+  private:
+    BoundedQueue<ThreadEnvelope*> queue_;
+    std::atomic<uint32_t> sleepers_;  // Consumers blocked on cond_
+    std::mutex lck_;
+    std::condition_variable cond_;
+    uint32_t spin_;  // Only touched by the consumer
+
+    // Non-copyable, non-assignable.
+    ThreadInbox(ThreadInbox&);
+    ThreadInbox& operator=(const ThreadInbox&);
+  };
+
+  // Everything connections on one thread:// name share.
+  struct ThreadHub {
+    std::mutex lck;
+    // The Server's queue.  Created by whichever of the Server or the first
+    // Client comes first, so requests can queue before the Server binds (the
+    // Clients keep pointers to it, so it can't be resized on bind).
+    std::shared_ptr<ThreadInbox> server;
+    bool server_bound;
+    std::vector<std::shared_ptr<ThreadInbox> > subscribers;
+    std::atomic<uint64_t> subscribers_version;
+
+    ThreadHub() : server_bound(false) {
+      subscribers_version.store(0);
+    }
+  };
+
+  // Hubs stay registered while any connection uses them.
+  static std::mutex registry_lck_;
+  static std::map<std::string, std::weak_ptr<ThreadHub> > registry_;
+
+  static std::shared_ptr<ThreadHub> findHub(const std::string& name) {
+    std::lock_guard<std::mutex> lck(registry_lck_);
+    // Drop the names nobody uses any more, so that the registry doesn't
+    // grow with every name ever used
+    std::map<std::string, std::weak_ptr<ThreadHub> >::iterator it =
+      registry_.begin();
+    while (it != registry_.end()) {
+      if (it->second.expired()) {
+        it = registry_.erase(it);
+      } else {
+        it++;
+      }
+    }
+    std::weak_ptr<ThreadHub>& entry = registry_[name];
+    std::shared_ptr<ThreadHub> hub = entry.lock();
+    if (hub == NULL) {
+      hub = std::make_shared<ThreadHub>();
+      entry = hub;
+    }
+    return hub;
+  }
+
+  static uint32_t queueSize(const int receive_hwm) {
+    if (receive_hwm < 0) {
+      return kDefaultQueueSize;
+    }
+    if (receive_hwm == 0) {
+      return kMaxQueueSize;
+    }
+    return std::min<uint32_t>((uint32_t)receive_hwm, kMaxQueueSize);
+  }
+
+  static int messageSize(const std::vector<Message>& parts) {
+    uint64_t size = 0;
+    for (size_t i = 0; i < parts.size(); i++) {
+      size += parts[i].size();
+    }
+    return (int)size;
+  }
+
+  ThreadTransport::ThreadTransport(const std::string& name,
+    const Connection::SocketType type, const int receive_hwm) {
+    type_ = type;
+    hub_ = findHub(name);
+    awaiting_reply_ = false;
+    subscribers_version_ = 0;
+
+    std::lock_guard<std::mutex> lck(hub_->lck);
+    switch (type_) {
+    case Connection::ServerType:
+      if (hub_->server_bound) {
+        throw std::wruntime_error("ThreadTransport::ThreadTransport() - "
+          "ERROR: thread://" + name + " is already bound.");
+      }
+      if (hub_->server == NULL) {
+        hub_->server = std::make_shared<ThreadInbox>(queueSize(receive_hwm));
+      }
+      hub_->server_bound = true;
+      inbox_ = hub_->server;
+      break;
+    case Connection::ClientType:
+      if (hub_->server == NULL) {
+        hub_->server = std::make_shared<ThreadInbox>(kDefaultQueueSize);
+      }
+      peer_ = hub_->server;
+      inbox_ = std::make_shared<ThreadInbox>(queueSize(receive_hwm));
+      break;
+    case Connection::SubscriberType:
+      inbox_ = std::make_shared<ThreadInbox>(queueSize(receive_hwm));
+      hub_->subscribers.push_back(inbox_);
+      hub_->subscribers_version++;
+      break;
+    case Connection::PublisherType:
+      break;
+    }
+  }
+
+  ThreadTransport::~ThreadTransport() {
+    std::lock_guard<std::mutex> lck(hub_->lck);
+    if (type_ == Connection::ServerType) {
+      hub_->server_bound = false;
+    } else if (type_ == Connection::SubscriberType) {
+      hub_->subscribers.erase(std::find(hub_->subscribers.begin(),
+        hub_->subscribers.end(), inbox_));
+      hub_->subscribers_version++;
+    }
+  }
+
+  int ThreadTransport::send(const DataBuffer* parts, const uint32_t n_parts,
+    const int timout_ms) {
+    // The frames must outlive the call, so this is the one copy thread://
+    // makes.  Send Messages to avoid it.
+    copy_parts_.clear();
+    for (uint32_t i = 0; i < n_parts; i++) {
+      copy_parts_.push_back(Message(parts[i].data, parts[i].size));
+    }
+    return send(copy_parts_, timout_ms);
+  }
+
+  int ThreadTransport::send(std::vector<Message>& parts,
+    const int timout_ms) {
+    if (type_ == Connection::PublisherType) {
+      return publish(parts);
+    }
+    if (peer_ == NULL || (type_ == Connection::ClientType && awaiting_reply_)) {
+      return 0;  // Out of turn
+    }
+    const int size = messageSize(parts);
+    ThreadEnvelope* env = getEnvelope();
+    env->frames.swap(parts);  // Leaves parts empty
+    if (type_ == Connection::ClientType) {
+      env->reply_to = inbox_;
+    }
+    if (!peer_->push(env, timout_ms)) {
+      parts.swap(env->frames);
+      putEnvelope(env);
+      return 0;
+    }
+    if (type_ == Connection::ClientType) {
+      awaiting_reply_ = true;
+    } else {
+      peer_.reset();  // Replied
+    }
+    return size;
+  }
+
+  int ThreadTransport::receive(std::vector<Message>& parts,
+    const int timout_ms) {
+    if ((type_ == Connection::ClientType && !awaiting_reply_) ||
+      (type_ == Connection::ServerType && peer_ != NULL)) {
+      return 0;  // Out of turn
+    }
+    const Clock::time_point deadline = Clock::now() +
+      std::chrono::milliseconds(std::max<int>(timout_ms, 0));
+    int wait_ms = timout_ms;
+    ThreadEnvelope* env;
+    while (true) {
+      if (!inbox_->pop(env, wait_ms)) {
+        return 0;
+      }
+      if (type_ != Connection::SubscriberType || matches(env->frames[0])) {
+        break;
+      }
+      putEnvelope(env);  // Not subscribed to it
+      if (timout_ms > 0) {
+        wait_ms = (int)std::max<int64_t>(0,
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - Clock::now()).count());
+      }
+    }
+    parts.clear();
+    parts.swap(env->frames);
+    if (type_ == Connection::ServerType) {
+      peer_ = env->reply_to;
+    } else if (type_ == Connection::ClientType) {
+      awaiting_reply_ = false;
+    }
+    putEnvelope(env);
+    return (int)parts.size();
+  }
+
+  void ThreadTransport::setTopics(const std::vector<std::string>& topics) {
+    topics_ = topics;
+  }
+
+  std::string ThreadTransport::threadName(const std::string& conn_str) {
+    const size_t prefix_len = strlen(kThreadPrefix);
+    if (conn_str.compare(0, prefix_len, kThreadPrefix) != 0) {
+      return "";
+    }
+    return conn_str.substr(prefix_len);
+  }
+
+  void ThreadTransport::refreshSubscribers() {
+    const uint64_t version = hub_->subscribers_version.load();
+    if (version == subscribers_version_) {
+      return;
+    }
+    std::lock_guard<std::mutex> lck(hub_->lck);
+    subscribers_ = hub_->subscribers;
+    subscribers_version_ = hub_->subscribers_version.load();
+  }
+
+  int ThreadTransport::publish(std::vector<Message>& parts) {
+    refreshSubscribers();
+    const int size = messageSize(parts);
+    for (size_t i = 0; i < subscribers_.size(); i++) {
+      ThreadEnvelope* env = getEnvelope();
+      if (i + 1 == subscribers_.size()) {
+        env->frames.swap(parts);  // The last subscriber gets the originals
+      } else {
+        for (size_t j = 0; j < parts.size(); j++) {
+          env->frames.push_back(parts[j].share());
+        }
+      }
+      if (!subscribers_[i]->push(env, 0)) {
+        putEnvelope(env);  // Queue full: dropped, as by a ZMQ_PUB socket
+      }
+    }
+    parts.clear();
+    return size;
+  }
+
+  bool ThreadTransport::matches(const Message& topic) const {
+    for (size_t i = 0; i < topics_.size(); i++) {
+      const std::string& prefix = topics_[i];
+      if (prefix.empty() || (prefix.size() <= topic.size() &&
+        memcmp(topic.data(), prefix.data(), prefix.size()) == 0)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+}  // namespace jzmq
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <sstream>
+#include "jzmq/topic_dispatcher.h"
+#include "jtil/exceptions/wruntime_error.h"
+
+#define SAFE_DELETE(x) if (x != NULL) { delete x; x = NULL; }
+#define SAFE_DELETE_ARR(x) if (x != NULL) { delete[] x; x = NULL; }
+
+namespace jzmq {
+
+  TopicDispatcher::TopicDispatcher(Subscriber& subscriber) :
+    subscriber_(subscriber) {
+  }
+
+  TopicDispatcher::~TopicDispatcher() {
+    deleteChildren(&root_);
+  }
+
+  void TopicDispatcher::deleteChildren(TrieNode* node) {
+    std::map<uint8_t, TrieNode*>::iterator it;
+    for (it = node->children.begin(); it != node->children.end(); it++) {
+      deleteChildren(it->second);
+      delete it->second;
+    }
+    node->children.clear();
+  }
+
+  void TopicDispatcher::addHandler(const std::string& topic,
+    const Handler& handler) {
+    TrieNode* node = &root_;
+    for (uint32_t i = 0; i < topic.size(); i++) {
+      TrieNode*& child = node->children[(uint8_t)topic[i]];
+      if (child == NULL) {
+        child = new TrieNode();
+      }
+      node = child;
+    }
+    if (!node->has_handler) {
+      subscriber_.subscribe(topic);
+    }
+    node->handler = handler;
+    node->has_handler = true;
+  }
+
+  void TopicDispatcher::removeHandler(const std::string& topic) {
+    std::vector<TrieNode*> path;
+    path.push_back(&root_);
+    for (uint32_t i = 0; i < topic.size(); i++) {
+      std::map<uint8_t, TrieNode*>::iterator it =
+        path.back()->children.find((uint8_t)topic[i]);
+      if (it == path.back()->children.end()) {
+        return;  // No handler for this topic
+      }
+      path.push_back(it->second);
+    }
+    TrieNode* node = path.back();
+    if (!node->has_handler) {
+      return;
+    }
+    subscriber_.unsubscribe(topic);
+    node->handler = Handler();
+    node->has_handler = false;
+
+    // Prune the nodes that no longer lead to a handler
+    for (uint32_t i = (uint32_t)topic.size(); i > 0; i--) {
+      TrieNode* child = path[i];
+      if (child->has_handler || !child->children.empty()) {
+        break;
+      }
+      path[i - 1]->children.erase((uint8_t)topic[i - 1]);
+      delete child;
+    }
+  }
+
+  int TopicDispatcher::dispatch(const int timout_ms) {
+    int rc = subscriber_.receiveMultipart(frames_, timout_ms);
+    if (rc <= 0) {
+      return rc;  // Timeout or interrupt
+    }
+    int n_msgs = 0;
+    do {
+      dispatchMessage(frames_);
+      n_msgs++;
+    } while (subscriber_.receiveMultipart(frames_, 0) > 0);
+    return n_msgs;
+  }
+
+  int TopicDispatcher::dispatchMessage(std::vector<Message>& frames) {
+    if (frames.size() == 0) {
+      return 0;
+    }
+    // Walk the trie along the topic bytes, calling every handler on the way
+    const uint8_t* topic = reinterpret_cast<const uint8_t*>(frames[0].data());
+    const uint64_t topic_size = frames[0].size();
+    int n_handlers = 0;
+    TrieNode* node = &root_;
+    uint64_t i = 0;
+    while (true) {
+      if (node->has_handler) {
+        node->handler(frames);
+        n_handlers++;
+      }
+      if (i == topic_size) {
+        break;
+      }
+      std::map<uint8_t, TrieNode*>::iterator it =
+        node->children.find(topic[i]);
+      if (it == node->children.end()) {
+        break;
+      }
+      node = it->second;
+      i++;
+    }
+    return n_handlers;
+  }
+
+}  // namespace jzmq
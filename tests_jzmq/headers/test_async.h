@@ -0,0 +1,169 @@
+//
+//  test_async.h
+//
+//  Pipelines requests from an AsyncClient (ZMQ_DEALER) to a plain Server
+//  (ZMQ_REP) and checks every reply is matched to its request.  Then checks
+//  that an AsyncServer (ZMQ_ROUTER) can reply out of order, and from another
+//  thread, to both a Client and an AsyncClient.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/server.h"
+#include "jzmq/async_client.h"
+#include "jzmq/async_server.h"
+#include "jzmq/client.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace async_test {
+  const int timeout_ms = 1000;
+  const uint32_t max_outstanding = 8;
+  const uint32_t num_requests = 64;
+  const uint32_t buffer_len = 512;
+
+  uint32_t n_replies = 0;
+  uint32_t n_errors = 0;
+
+  // Each request is its index and the server echoes it back
+  void onReply(const uint32_t expected, const uint64_t request_id,
+    std::vector<Message>& reply) {
+    uint32_t value;
+    if (reply.size() != 1 || reply[0].size() != sizeof(value)) {
+      n_errors++;
+      return;
+    }
+    memcpy(&value, reply[0].data(), sizeof(value));
+    if (value != expected) {
+      n_errors++;
+    }
+    n_replies++;
+  }
+
+  // Service whatever requests the REP server has queued
+  void serviceRequests(Server& server) {
+    char buffer[buffer_len];
+    int bytes_recieved;
+    while ((bytes_recieved = server.receiveData(buffer, buffer_len, 0)) > 0) {
+      server.sendData(buffer, bytes_recieved, timeout_ms);
+    }
+  }
+
+};  // namespace async_test
+
+TEST(JZMQTests, AsyncClientPipelined) {
+  using namespace async_test;
+  bool ok = true;
+
+  try {
+    Server server("inproc://async_test");
+    server.initConn();
+    AsyncClient client("inproc://async_test", max_outstanding);
+    client.initConn();
+
+    uint32_t n_sent = 0;
+    while (n_replies < num_requests && n_errors == 0) {
+      // Fill the window without waiting for replies
+      while (n_sent < num_requests &&
+        client.numOutstanding() < client.maxOutstanding()) {
+        uint64_t id = client.sendRequest(reinterpret_cast<char*>(&n_sent),
+          sizeof(n_sent), std::bind(onReply, n_sent, std::placeholders::_1,
+          std::placeholders::_2), timeout_ms);
+        if (id == 0) {
+          n_errors++;
+          break;
+        }
+        n_sent++;
+      }
+      serviceRequests(server);
+      if (client.processReplies(timeout_ms) <= 0) {
+        n_errors++;
+      }
+    }
+
+    ok = ok && client.numOutstanding() == 0;
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_replies == num_requests);
+}
+
+TEST(JZMQTests, AsyncServerOutOfOrder) {
+  using namespace async_test;
+  bool ok = true;
+  n_replies = 0;
+  n_errors = 0;
+
+  try {
+    AsyncServer server("inproc://async_server_test");
+    server.initConn();
+    Client client("inproc://async_server_test");
+    client.initConn();
+    AsyncClient async_client("inproc://async_server_test", max_outstanding);
+    async_client.initConn();
+
+    // Two pipelined requests from the AsyncClient and one from the Client
+    uint32_t values[3] = {0, 1, 2};
+    for (uint32_t i = 0; i < 2; i++) {
+      async_client.sendRequest(reinterpret_cast<char*>(&values[i]),
+        sizeof(values[i]), std::bind(onReply, values[i],
+        std::placeholders::_1, std::placeholders::_2), timeout_ms);
+    }
+    client.sendData(reinterpret_cast<char*>(&values[2]), sizeof(values[2]),
+      timeout_ms);
+
+    std::vector<AsyncServer::Request> requests(3);
+    for (uint32_t i = 0; i < 3; i++) {
+      ok = ok && server.receiveRequest(requests[i], timeout_ms) == 1;
+      ok = ok && requests[i].parts.size() == 1;
+    }
+    if (!ok) {
+      throw std::wruntime_error("Requests were not received");
+    }
+
+    // Reply to the last request received first, from another thread
+    std::thread replier([&]() {
+      server.postReply(requests[2].envelope, requests[2].parts);
+    });
+    replier.join();
+    // Then the remaining two (in reverse order) from this thread
+    server.sendReply(requests[1].envelope, requests[1].parts);
+    server.sendReply(requests[0].envelope, requests[0].parts);
+    server.flushReplies();
+
+    uint32_t value = 0;
+    int bytes_recieved = client.receiveData(reinterpret_cast<char*>(&value),
+      sizeof(value), timeout_ms);
+    ok = ok && bytes_recieved == sizeof(value) && value == values[2];
+    while (n_replies < 2 && n_errors == 0) {
+      if (async_client.processReplies(timeout_ms) <= 0) {
+        n_errors++;
+      }
+    }
+
+    async_client.killConn();
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_replies == 2);
+}
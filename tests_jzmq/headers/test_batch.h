@@ -0,0 +1,109 @@
+//
+//  test_batch.h
+//
+//  A Publisher sends batches of messages and a Subscriber drains them with
+//  receiveBatch, which must return more than one message per call.  Then a
+//  Client and Server (REQ/REP, which must alternate sends and receives)
+//  exchange a request and a reply with sendBatch and receiveBatch: every
+//  call must transfer exactly one message and leave the sockets usable.
+//
+
+#include <string.h>
+#include <string>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/publisher.h"
+#include "jzmq/server.h"
+#include "jzmq/subscriber.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace batch_test {
+  const int timeout_ms = 1000;
+  const uint32_t batch_size = 8;
+  const char* payload = "batch";
+
+  void FillBatch(Message* msgs, const uint32_t n_msgs) {
+    for (uint32_t i = 0; i < n_msgs; i++) {
+      msgs[i] = Message(payload, strlen(payload));
+    }
+  }
+
+  bool IsPayload(const Message& msg) {
+    return msg.size() == strlen(payload) &&
+      memcmp(msg.data(), payload, strlen(payload)) == 0;
+  }
+};  // namespace batch_test
+
+TEST(JZMQTests, BatchPublisherSubscriber) {
+  using namespace batch_test;
+  bool ok = true;
+  int n_batched = 0;
+
+  try {
+    Publisher publisher("inproc://jzmq_test_batch_pub");
+    publisher.initConn();
+    Subscriber subscriber("inproc://jzmq_test_batch_pub");
+    subscriber.initConn();
+
+    // Keep publishing until the subscription has propagated
+    Message msgs[batch_size];
+    Message slots[2 * batch_size];
+    for (uint32_t i = 0; i < 100 && n_batched <= 1; i++) {
+      FillBatch(msgs, batch_size);
+      ok = ok && publisher.sendBatch(msgs, batch_size, timeout_ms) ==
+        (int)batch_size;
+      n_batched = subscriber.receiveBatch(slots, 2 * batch_size, 10);
+      for (int j = 0; j < n_batched; j++) {
+        ok = ok && IsPayload(slots[j]);
+      }
+    }
+    subscriber.killConn();
+    publisher.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_batched > 1);
+}
+
+TEST(JZMQTests, BatchClientServer) {
+  using namespace batch_test;
+  bool ok = true;
+
+  try {
+    Server server("inproc://jzmq_test_batch_rep");
+    server.initConn();
+    Client client("inproc://jzmq_test_batch_rep");
+    client.initConn();
+
+    Message msgs[2];
+    Message slots[4];
+    for (uint32_t i = 0; i < 3 && ok; i++) {
+      // Only the first message of each batch can be sent
+      FillBatch(msgs, 2);
+      ok = client.sendBatch(msgs, 2, timeout_ms) == 1;
+      ok = ok && server.receiveBatch(slots, 4, timeout_ms) == 1 &&
+        IsPayload(slots[0]);
+      FillBatch(msgs, 2);
+      ok = ok && server.sendBatch(msgs, 2, timeout_ms) == 1;
+      ok = ok && client.receiveBatch(slots, 4, timeout_ms) == 1 &&
+        IsPayload(slots[0]);
+    }
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+}
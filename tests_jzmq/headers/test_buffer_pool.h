@@ -0,0 +1,136 @@
+//
+//  test_buffer_pool.h
+//
+//  Sends pooled buffers with the zero-copy sendData.  ZeroMQ must hand every
+//  buffer back to the pool, so that after the first round trip further
+//  acquires are all freelist hits and nothing is left outstanding.  A
+//  foreign buffer makes release throw, but not recycle (ZeroMQ calls it).
+//  A second test releases a buffer into a pool with other size classes,
+//  and one buffer twice: both must be rejected.
+//
+
+#include <string.h>
+#include "jtil/math/math_types.h"
+#include "jzmq/buffer_pool.h"
+#include "jzmq/client.h"
+#include "jzmq/server.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace buffer_pool_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_requests = 100;
+  const uint64_t request_size = 100000;
+};  // namespace buffer_pool_test
+
+TEST(JZMQTests, BufferPoolRecycle) {
+  using namespace buffer_pool_test;
+  bool ok = true;
+  bool release_threw = false;
+  bool recycle_threw = false;
+  BufferPoolStats stats;
+  memset(&stats, 0, sizeof(stats));
+
+  try {
+    BufferPool pool;
+    Server server("inproc://buffer_pool_test");
+    Client client("inproc://buffer_pool_test");
+    server.initConn();
+    client.initConn();
+
+    for (uint32_t i = 0; i < num_requests && ok; i++) {
+      char* buff = pool.acquire(request_size);
+      ok = BufferPool::capacity(buff) >= request_size &&
+        ((uint64_t)buff % BufferPool::kAlignment) == 0;
+      memset(buff, (int)i, (size_t)request_size);
+      ok = ok && client.sendData(buff, request_size, BufferPool::recycle,
+        &pool, timeout_ms) == (int)request_size;
+
+      // The buffer goes back to the pool when the received message is closed
+      Message request;
+      ok = ok && server.receiveMessage(request, timeout_ms) == 1;
+      ok = ok && request.size() == request_size &&
+        request.data()[request_size - 1] == (char)i;
+      request = Message();
+
+      char reply = 1;
+      ok = ok && server.sendData(&reply, 1, timeout_ms) == 1;
+      ok = ok && client.receiveData(&reply, 1, timeout_ms) == 1;
+    }
+
+    client.killConn();
+    server.killConn();
+    stats = pool.stats();
+
+    char foreign[2 * BufferPool::kAlignment] = {0};
+    try {
+      pool.release(foreign + BufferPool::kAlignment);
+    } catch (std::wruntime_error&) {
+      release_threw = true;
+    }
+    try {
+      BufferPool::recycle(foreign + BufferPool::kAlignment, &pool);
+    } catch (std::wruntime_error&) {
+      recycle_threw = true;
+    }
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(stats.misses == 1);
+  EXPECT_TRUE(stats.hits == num_requests - 1);
+  EXPECT_TRUE(stats.buffers_outstanding == 0);
+  EXPECT_TRUE(stats.bytes_outstanding == 0);
+  EXPECT_TRUE(stats.buffers_cached == 1);
+  EXPECT_TRUE(release_threw);
+  EXPECT_TRUE(!recycle_threw);
+}
+
+TEST(JZMQTests, BufferPoolWrongPool) {
+  bool ok = true;
+  bool wrong_pool_threw = false;
+  bool double_release_threw = false;
+
+  try {
+    BufferPool small(64, 1024);
+    BufferPool pool;  // 4096 byte smallest class
+    char* buff = small.acquire(64);
+    try {
+      pool.release(buff);
+    } catch (std::wruntime_error&) {
+      wrong_pool_threw = true;
+    }
+    BufferPool::recycle(buff, &pool);  // Rejected too (and not cached)
+    small.release(buff);
+    try {
+      small.release(buff);
+    } catch (std::wruntime_error&) {
+      double_release_threw = true;
+    }
+
+    // Nothing of the small pool may have reached the 4096 byte class
+    buff = pool.acquire(4096);
+    ok = BufferPool::capacity(buff) >= 4096;
+    memset(buff, 0, 4096);
+    pool.release(buff);
+    BufferPoolStats stats = pool.stats();
+    ok = ok && stats.misses == 1 && stats.buffers_outstanding == 0;
+    stats = small.stats();
+    ok = ok && stats.buffers_outstanding == 0 && stats.buffers_cached == 1;
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(wrong_pool_threw);
+  EXPECT_TRUE(double_release_threw);
+}
@@ -0,0 +1,150 @@
+//
+//  test_client_pool.h
+//
+//  Connections are move-only: a connected Server and Client are moved (into
+//  a vector and by assignment) and must keep talking, with the moved-from
+//  instances left closed.  Then a ClientPool makes requests to two Server
+//  threads in turn and must only connect one Client per endpoint; a request
+//  that times out must not give its Client back to the pool.
+//
+
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/client_pool.h"
+#include "jzmq/server.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace client_pool_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_requests = 200;  // Per server
+
+  std::atomic<uint64_t> n_errors = 0;
+
+  // Replies to every request with the value incremented
+  void ServerThread(Server* server) {
+    for (uint32_t i = 0; i < num_requests; i++) {
+      uint32_t value;
+      if (server->receiveData(reinterpret_cast<char*>(&value),
+        sizeof(value), timeout_ms) != sizeof(value)) {
+        n_errors++;
+        break;
+      }
+      value++;
+      server->sendData(reinterpret_cast<char*>(&value), sizeof(value),
+        timeout_ms);
+    }
+  }
+
+  bool Request(Connection& client, Connection& server, uint32_t value) {
+    char buff[4];
+    bool ok = client.sendData(reinterpret_cast<char*>(&value),
+      sizeof(value), timeout_ms) == sizeof(value);
+    ok = ok && server.receiveData(buff, sizeof(buff), timeout_ms) == 4;
+    ok = ok && server.sendData(buff, sizeof(buff), timeout_ms) == 4;
+    ok = ok && client.receiveData(buff, sizeof(buff), timeout_ms) == 4;
+    return ok && memcmp(buff, &value, sizeof(value)) == 0;
+  }
+
+  // killConn throws on a connection that isn't open
+  bool IsClosed(Connection& conn) {
+    try {
+      conn.killConn();
+    } catch (std::wruntime_error&) {
+      return true;
+    }
+    return false;
+  }
+};  // namespace client_pool_test
+
+TEST(JZMQTests, MoveConnections) {
+  using namespace client_pool_test;
+  bool ok = true;
+
+  try {
+    Server first_server("inproc://jzmq_test_move");
+    first_server.initConn();
+    Server server(std::move(first_server));
+    Client first_client("inproc://jzmq_test_move");
+    first_client.initConn();
+    ok = Request(first_client, server, 1);
+
+    std::vector<Client> clients;
+    clients.push_back(std::move(first_client));
+    ok = ok && Request(clients[0], server, 2);
+
+    Client client("inproc://jzmq_test_move");
+    client.initConn();
+    client = std::move(clients[0]);  // Closes the socket client had
+    ok = ok && Request(client, server, 3);
+
+    ok = ok && IsClosed(first_server) && IsClosed(first_client);
+    ok = ok && IsClosed(clients[0]);
+    // client and server are closed by their destructors
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+}
+
+TEST(JZMQTests, ClientPool) {
+  using namespace client_pool_test;
+  bool ok = true;
+  n_errors = 0;
+  uint64_t n_idle = 0;
+  uint64_t n_connected = 0;
+  int timed_out = -1;
+
+  try {
+    const std::string endpoints[2] = {"inproc://jzmq_test_pool_a",
+      "inproc://jzmq_test_pool_b"};
+    Server server_a(endpoints[0]);
+    Server server_b(endpoints[1]);
+    server_a.initConn();
+    server_b.initConn();
+    std::thread thread_a(ServerThread, &server_a);
+    std::thread thread_b(ServerThread, &server_b);
+
+    ClientPool pool;
+    for (uint32_t i = 0; i < 2 * num_requests && ok; i++) {
+      Message reply;
+      ok = pool.request(endpoints[i % 2], reinterpret_cast<const char*>(&i),
+        sizeof(i), reply, timeout_ms) == 1 && reply.size() == sizeof(i) &&
+        *reinterpret_cast<uint32_t*>(reply.data()) == i + 1;
+    }
+    thread_a.join();
+    thread_b.join();
+
+    // Nobody answers here
+    Message reply;
+    uint32_t value = 0;
+    timed_out = pool.request("inproc://jzmq_test_pool_none",
+      reinterpret_cast<const char*>(&value), sizeof(value), reply, 10);
+
+    n_idle = pool.numIdle();
+    n_connected = pool.numConnected();
+    pool.clear();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(timed_out == 0);
+  EXPECT_TRUE(n_idle == 2);
+  EXPECT_TRUE(n_connected == 3);
+}
@@ -0,0 +1,113 @@
+//
+//  test_codec.h
+//
+//  Round trips a smooth float array (a stand-in for a depth image) through
+//  ShuffleLZCodec, which must shrink it, and then sends it and a small
+//  message (below the codec threshold) between a Client and Server that
+//  both have a codec attached.  A frame that decodes to more than the
+//  receiver's codec maximum must be rejected.
+//
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/codec.h"
+#include "jzmq/server.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace codec_test {
+  const int timeout_ms = 1000;
+  const uint32_t image_size = 320 * 240;
+
+  void makeImage(std::vector<float>& image) {
+    image.resize(image_size);
+    for (uint32_t i = 0; i < image_size; i++) {
+      image[i] = 1000.0f + 10.0f * (float)sin(0.001 * i);
+    }
+  }
+};  // namespace codec_test
+
+TEST(JZMQTests, CodecRoundTrip) {
+  using namespace codec_test;
+  std::vector<float> image;
+  makeImage(image);
+  const uint64_t size = image.size() * sizeof(image[0]);
+  const char* raw = reinterpret_cast<const char*>(&image[0]);
+
+  ShuffleLZCodec codec(sizeof(float), true);
+  ShuffleLZCodec decoder;  // Settings come from the frame
+  std::vector<char> encoded((size_t)size);
+  std::vector<float> decoded(image.size());
+  uint64_t encoded_size = codec.encode(raw, size, &encoded[0]);
+  bool ok = encoded_size > 0 && encoded_size < size / 2;
+  if (ok) {
+    decoder.decode(&encoded[0], encoded_size,
+      reinterpret_cast<char*>(&decoded[0]), size);
+    ok = memcmp(&decoded[0], raw, (size_t)size) == 0;
+  }
+  EXPECT_TRUE(ok);
+}
+
+TEST(JZMQTests, CodecConnection) {
+  using namespace codec_test;
+  bool ok = true;
+  bool threw_on_large = false;
+  std::vector<float> image;
+  makeImage(image);
+  const uint64_t size = image.size() * sizeof(image[0]);
+
+  try {
+    ShuffleLZCodec server_codec(sizeof(float), true);
+    ShuffleLZCodec client_codec(sizeof(float), true);
+    Server server("inproc://codec_test");
+    Client client("inproc://codec_test");
+    server.setCodec(&server_codec);
+    client.setCodec(&client_codec);
+    server.initConn();
+    client.initConn();
+
+    // Large: encoded
+    ok = client.sendData(reinterpret_cast<char*>(&image[0]), size,
+      timeout_ms) == (int)size;
+    Message request;
+    ok = ok && server.receiveMessage(request, timeout_ms) == 1;
+    ok = ok && request.size() == size &&
+      memcmp(request.data(), &image[0], (size_t)size) == 0;
+
+    // Small: sent raw (behind the codec header)
+    char reply[] = "ok";
+    ok = ok && server.sendData(reply, sizeof(reply), timeout_ms) ==
+      sizeof(reply);
+    char buff[sizeof(reply)];
+    ok = ok && client.receiveData(buff, sizeof(buff), timeout_ms) ==
+      sizeof(reply);
+    ok = ok && memcmp(buff, reply, sizeof(reply)) == 0;
+
+    // Frames that decode to more than the receiver's maximum are rejected
+    server.setCodec(&server_codec, 4096, size / 2);
+    ok = ok && client.sendData(reinterpret_cast<char*>(&image[0]), size,
+      timeout_ms) == (int)size;
+    try {
+      server.receiveMessage(request, timeout_ms);
+    } catch (std::wruntime_error&) {
+      threw_on_large = true;
+    }
+
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(threw_on_large);
+}
@@ -0,0 +1,212 @@
+//
+//  test_context.h
+//
+//  Configures the shared context with two I/O threads, pins a Server and
+//  Client to the second one and checks that they still talk.  The context
+//  options can't be changed while a connection is open.  With keep_alive
+//  the context must outlive its last connection until shutdownContext
+//  (without it, it goes with the last connection), and a failed bind or
+//  connect must not hold on to it.
+//  Also checks that ConnectionOptions are validated by the
+//  constructor and applied by initConn.
+//
+
+#include <string.h>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/server.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace context_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_requests = 10;
+};  // namespace context_test
+
+TEST(JZMQTests, ContextOptions) {
+  using namespace context_test;
+  bool ok = true;
+  bool threw_while_open = false;
+
+  try {
+    ContextOptions options;
+    options.io_threads = 2;
+    Connection::setContextOptions(options);
+
+    Server server("tcp://*:5571");
+    Client client("tcp://localhost:5571");
+    server.setAffinity(1 << 1);
+    client.setAffinity(1 << 1);
+    server.initConn();
+    client.initConn();
+
+    try {
+      Connection::setContextOptions(ContextOptions());
+    } catch (std::wruntime_error&) {
+      threw_while_open = true;
+    }
+
+    for (uint32_t i = 0; i < num_requests && ok; i++) {
+      char buff[4];
+      ok = client.sendData(reinterpret_cast<char*>(&i), sizeof(i),
+        timeout_ms) == sizeof(i);
+      ok = ok && server.receiveData(buff, sizeof(buff), timeout_ms) == 4;
+      ok = ok && server.sendData(buff, sizeof(buff), timeout_ms) == 4;
+      ok = ok && client.receiveData(buff, sizeof(buff), timeout_ms) == 4;
+      ok = ok && memcmp(buff, &i, sizeof(i)) == 0;
+    }
+
+    client.killConn();
+    server.killConn();
+
+    // No connection is open again so the defaults can be restored
+    Connection::setContextOptions(ContextOptions());
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(threw_while_open);
+}
+
+TEST(JZMQTests, ContextKeepAlive) {
+  using namespace context_test;
+  bool ok = true;
+  bool threw_while_open = false;
+
+  try {
+    Connection::shutdownContext();
+    ok = !Connection::contextExists();
+
+    ContextOptions options;
+    options.keep_alive = true;
+    Connection::setContextOptions(options);
+    Client client("tcp://localhost:5573");
+    client.initConn();
+    ok = ok && Connection::contextExists();
+    try {
+      Connection::shutdownContext();
+    } catch (std::wruntime_error&) {
+      threw_while_open = true;
+    }
+    client.killConn();
+    ok = ok && Connection::contextExists();  // Kept for the next connection
+    client.initConn();
+    client.killConn();
+    Connection::shutdownContext();
+    ok = ok && !Connection::contextExists();
+
+    // The default destroys it with the last connection
+    Connection::setContextOptions(ContextOptions());
+    client.initConn();
+    client.killConn();
+    ok = ok && !Connection::contextExists();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(threw_while_open);
+}
+
+TEST(JZMQTests, FailedBindReleasesContext) {
+  using namespace context_test;
+  bool ok = true;
+  bool threw_on_bind = false;
+  bool threw_on_connect = false;
+
+  try {
+    Server first("inproc://jzmq_test_failed_bind");
+    first.initConn();
+    Server second("inproc://jzmq_test_failed_bind");
+    try {
+      second.initConn();  // Address already in use
+    } catch (std::wruntime_error&) {
+      threw_on_bind = true;
+    }
+    Client client("tcp://");
+    try {
+      client.initConn();  // Invalid address
+    } catch (std::wruntime_error&) {
+      threw_on_connect = true;
+    }
+    first.killConn();
+    // The failed connections were left closed
+    try {
+      second.killConn();
+      ok = false;
+    } catch (std::wruntime_error&) {
+    }
+    // Throws if a failed connection still holds the context
+    Connection::shutdownContext();
+    ok = ok && !Connection::contextExists();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(threw_on_bind);
+  EXPECT_TRUE(threw_on_connect);
+}
+
+TEST(JZMQTests, ConnectionOptions) {
+  using namespace context_test;
+  bool ok = true;
+  bool threw_on_invalid = false;
+
+  ConnectionOptions invalid;
+  invalid.immediate = 2;
+  try {
+    Client client("tcp://localhost:5572", invalid);
+  } catch (std::wruntime_error&) {
+    threw_on_invalid = true;
+  }
+
+  try {
+    ConnectionOptions options;
+    options.send_hwm = 10;
+    options.receive_hwm = 10;
+    options.send_buffer = 1 << 20;
+    options.receive_buffer = 1 << 20;
+    options.linger_ms = 0;
+    options.tcp_keepalive = 1;
+    options.tcp_keepalive_idle_s = 30;
+    options.reconnect_interval_ms = 10;
+    options.reconnect_interval_max_ms = 1000;
+    options.backlog = 16;
+    Server server("tcp://*:5572", options);
+    options.immediate = 1;
+    Client client("tcp://localhost:5572", options);
+    server.initConn();
+    client.initConn();
+
+    uint32_t value = 42;
+    char buff[4];
+    ok = client.sendData(reinterpret_cast<char*>(&value), sizeof(value),
+      timeout_ms) == sizeof(value);
+    ok = ok && server.receiveData(buff, sizeof(buff), timeout_ms) == 4;
+    ok = ok && server.sendData(buff, sizeof(buff), timeout_ms) == 4;
+    ok = ok && client.receiveData(buff, sizeof(buff), timeout_ms) == 4;
+    ok = ok && memcmp(buff, &value, sizeof(value)) == 0;
+
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(threw_on_invalid);
+}
@@ -0,0 +1,99 @@
+//
+//  test_hedged.h
+//
+//  A HedgedClient makes requests to two replicas of a Server that replies
+//  with the request incremented.  The first replica takes 20ms per request
+//  and the second answers straight away.  Every request must get the right
+//  reply, the slow replica's first request must be hedged (and won by the
+//  duplicate), and the fast replica must then become the primary so that
+//  most requests are not hedged at all.
+//
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/hedged_client.h"
+#include "jzmq/server.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace hedged_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_requests = 100;
+
+  std::atomic<bool> stop_servers(false);
+
+  void ServerThread(Server* server, const int delay_ms) {
+    while (!stop_servers) {
+      uint32_t value;
+      if (server->receiveData(reinterpret_cast<char*>(&value),
+        sizeof(value), 10) != sizeof(value)) {
+        continue;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+      value++;
+      server->sendData(reinterpret_cast<char*>(&value), sizeof(value),
+        timeout_ms);
+    }
+  }
+};  // namespace hedged_test
+
+TEST(JZMQTests, HedgedClient) {
+  using namespace hedged_test;
+  bool ok = true;
+  uint32_t primary = 0;
+  uint64_t n_hedged = 0;
+  uint64_t n_hedge_wins = 0;
+  HistogramSnapshot fast_latency;
+
+  try {
+    Server slow("inproc://jzmq_test_hedged_slow");
+    Server fast("inproc://jzmq_test_hedged_fast");
+    slow.initConn();
+    fast.initConn();
+    stop_servers = false;
+    std::thread slow_thread(ServerThread, &slow, 20);
+    std::thread fast_thread(ServerThread, &fast, 0);
+
+    std::vector<std::string> replicas;
+    replicas.push_back("inproc://jzmq_test_hedged_slow");
+    replicas.push_back("inproc://jzmq_test_hedged_fast");
+    HedgeOptions options;
+    options.initial_hedge_delay_ms = 5;
+    HedgedClient client(replicas, options);
+    client.initConn();
+    for (uint32_t i = 0; i < num_requests && ok; i++) {
+      Message reply;
+      ok = client.request(reinterpret_cast<const char*>(&i), sizeof(i),
+        reply, timeout_ms) == 1 && reply.size() == sizeof(i) &&
+        *reinterpret_cast<uint32_t*>(reply.data()) == i + 1;
+    }
+    primary = client.primary();
+    n_hedged = client.numHedged();
+    n_hedge_wins = client.numHedgeWins();
+    client.replicaLatency(1, fast_latency);
+    client.killConn();
+
+    stop_servers = true;
+    slow_thread.join();
+    fast_thread.join();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(primary == 1);
+  EXPECT_TRUE(n_hedge_wins >= 1);
+  EXPECT_TRUE(n_hedged < num_requests / 2);
+  EXPECT_TRUE(fast_latency.count >= num_requests / 2);
+}
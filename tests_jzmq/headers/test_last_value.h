@@ -0,0 +1,100 @@
+//
+//  test_last_value.h
+//
+//  A LastValuePublisher publishes state before a Subscriber joins; the late
+//  Subscriber must get the current values without anything new being
+//  published.  Then a burst of updates is conflated by receiveLatest, which
+//  must only hand back the newest value of each topic.
+//
+
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/last_value_publisher.h"
+#include "jzmq/subscriber.h"
+#include "jtil/clk/clk.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::clk;
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace last_value_test {
+  const double test_time_sec = 1.0;
+  const uint32_t num_updates = 100;
+  typedef std::map<std::string, std::vector<Message> > LatestMap;
+
+  // The uint32_t payload of the newest message on topic (or 0)
+  uint32_t latestValue(LatestMap& latest, const std::string& topic) {
+    uint32_t value = 0;
+    LatestMap::iterator it = latest.find(topic);
+    if (it != latest.end() && it->second.size() == 2 &&
+      it->second[1].size() == sizeof(value)) {
+      memcpy(&value, it->second[1].data(), sizeof(value));
+    }
+    return value;
+  }
+
+};  // namespace last_value_test
+
+TEST(JZMQTests, LastValueCache) {
+  using namespace last_value_test;
+  bool ok = true;
+  uint32_t snapshot_a = 0;
+  uint32_t snapshot_b = 0;
+  uint32_t latest_a = 0;
+  int n_conflated = 0;
+
+  try {
+    LastValuePublisher publisher("inproc://last_value_test");
+    publisher.initConn();
+    uint32_t value = 7;
+    publisher.publish("state.a", reinterpret_cast<char*>(&value),
+      sizeof(value));
+    value = 8;
+    publisher.publish("state.b", reinterpret_cast<char*>(&value),
+      sizeof(value));
+    ok = publisher.cacheSize() == 2;
+
+    // Late joiner: nothing else is published until it has the snapshot
+    Subscriber subscriber("inproc://last_value_test");
+    subscriber.subscribe("state.");
+    subscriber.initConn();
+    LatestMap latest;
+    Clk clk;
+    double t0 = clk.getTime();
+    while (latest.size() < 2 && (clk.getTime() - t0) < test_time_sec) {
+      publisher.processSubscriptions(1);
+      subscriber.receiveLatest(latest, 1);
+    }
+    snapshot_a = latestValue(latest, "state.a");
+    snapshot_b = latestValue(latest, "state.b");
+
+    // A burst of updates is conflated to the last one
+    for (value = 1; value <= num_updates; value++) {
+      publisher.publish("state.a", reinterpret_cast<char*>(&value),
+        sizeof(value));
+    }
+    latest.clear();
+    n_conflated = subscriber.receiveLatest(latest, 1000);
+    latest_a = latestValue(latest, "state.a");
+    ok = ok && latest.size() == 1;
+
+    subscriber.killConn();
+    publisher.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(snapshot_a == 7);
+  EXPECT_TRUE(snapshot_b == 8);
+  EXPECT_TRUE(n_conflated == (int)num_updates);
+  EXPECT_TRUE(latest_a == num_updates);
+}
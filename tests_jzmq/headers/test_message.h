@@ -0,0 +1,104 @@
+//
+//  test_message.h
+//
+//  Tests the Message (zmq_msg_t) receive path and multi-part messages over a
+//  Server/Client pair on a single thread.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/server.h"
+#include "jzmq/client.h"
+#include "jzmq/message.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace message_test {
+  const int timeout_ms = 1000;
+  const uint32_t header_len = 16;
+  const uint32_t body_len = 1024 * 1024;  // Larger than any "a-priori" buffer
+  const uint32_t small_buffer_len = 64;
+
+};  // namespace message_test
+
+TEST(JZMQTests, MessageMultipart) {
+  using namespace message_test;
+  bool ok = true;
+  char* header = new char[header_len];
+  char* body = new char[body_len];
+  for (uint32_t i = 0; i < header_len; i++) {
+    header[i] = (char)i;
+  }
+  for (uint32_t i = 0; i < body_len; i++) {
+    body[i] = (char)(i % 251);
+  }
+
+  try {
+    // inproc requires the bind to happen before the connect
+    Server server("inproc://message_test");
+    server.initConn();
+    Client client("inproc://message_test");
+    client.initConn();
+
+    // Send the header and body as two frames (no concatenation)
+    DataBuffer parts[2] = {{header, header_len}, {body, body_len}};
+    int bytes_sent = client.sendMultipart(parts, 2, timeout_ms);
+    ok = ok && bytes_sent == (int)(header_len + body_len);
+
+    std::vector<Message> request;
+    int n_frames = server.receiveMultipart(request, timeout_ms);
+    if (n_frames != 2) {
+      throw std::wruntime_error("Multi-part request was not received");
+    }
+    ok = ok && request[0].size() == header_len;
+    ok = ok && request[1].size() == body_len;
+    ok = ok && memcmp(request[0].data(), header, header_len) == 0;
+    ok = ok && memcmp(request[1].data(), body, body_len) == 0;
+
+    // Reply with the request body (zero-copy) and make sure the client gets
+    // the whole thing back through receiveMessage without truncation.
+    std::vector<Message> reply;
+    reply.push_back(std::move(request[1]));
+    ok = ok && server.sendMultipart(reply, timeout_ms) == (int)body_len;
+    ok = ok && reply[0].size() == 0;
+
+    Message msg;
+    ok = ok && client.receiveMessage(msg, timeout_ms) == 1;
+    ok = ok && msg.size() == body_len;
+    ok = ok && memcmp(msg.data(), body, body_len) == 0;
+
+    // The buffer API truncates but still reports the full length, and only
+    // returns the first frame of a multi-part message.
+    ok = ok && client.sendMultipart(parts, 2, timeout_ms) > 0;
+    char small_buffer[small_buffer_len];
+    int bytes_received = server.receiveData(small_buffer, small_buffer_len,
+      timeout_ms);
+    ok = ok && bytes_received == (int)header_len;
+    ok = ok && memcmp(small_buffer, header, header_len) == 0;
+    // The REP socket must be ready to reply (trailing frames were consumed)
+    char* owned_body = body;
+    body = NULL;  // Now owned by ZeroMQ
+    bytes_sent = server.sendDataOwned(owned_body, body_len, timeout_ms);
+    ok = ok && bytes_sent == (int)body_len;
+    bytes_received = client.receiveData(small_buffer, small_buffer_len,
+      timeout_ms);
+    ok = ok && bytes_received == (int)body_len;
+
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  delete[] header;
+  delete[] body;
+  EXPECT_TRUE(ok);
+}
@@ -0,0 +1,107 @@
+//
+//  test_metrics.h
+//
+//  Checks the LatencyHistogram buckets and percentiles, then runs a few
+//  request / reply round trips with metrics enabled (plus a timeout and a
+//  truncated receive) and checks the counters in the snapshot.
+//
+
+#include <string.h>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/metrics.h"
+#include "jzmq/server.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace metrics_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_requests = 20;
+  const uint32_t request_size = 64;
+};  // namespace metrics_test
+
+TEST(JZMQTests, LatencyHistogram) {
+  bool ok = true;
+  // Every value must land in a bucket that contains it
+  for (uint64_t v = 0; v < 100000; v += 1 + v / 16) {
+    uint32_t i = LatencyHistogram::bucketIndex(v);
+    ok = ok && i < LatencyHistogram::kNumBuckets &&
+      LatencyHistogram::bucketLow(i) <= v &&
+      v <= LatencyHistogram::bucketHigh(i);
+  }
+  ok = ok && LatencyHistogram::bucketIndex(~(uint64_t)0) ==
+    LatencyHistogram::kNumBuckets - 1;
+
+  // 1..1000: the median must be within the 12.5% bucket resolution
+  LatencyHistogram histogram;
+  for (uint64_t v = 1; v <= 1000; v++) {
+    histogram.record(v);
+  }
+  HistogramSnapshot snap;
+  histogram.snapshot(snap);
+  uint64_t median = snap.percentile(0.5);
+  ok = ok && snap.count == 1000 && snap.max == 1000;
+  ok = ok && median >= 500 && median <= 563;
+  ok = ok && snap.percentile(1.0) == 1000;
+  EXPECT_TRUE(ok);
+}
+
+TEST(JZMQTests, ConnectionMetrics) {
+  using namespace metrics_test;
+  bool ok = true;
+  ConnectionMetrics server_metrics;
+  ConnectionMetrics client_metrics;
+  bool has_server_metrics = false;
+  bool has_client_metrics = false;
+
+  try {
+    Server server("inproc://metrics_test");
+    Client client("inproc://metrics_test");
+    server.setMetricsEnabled(true);
+    client.setMetricsEnabled(true);
+    server.initConn();
+    client.initConn();
+
+    // Nothing to receive yet
+    char buff[request_size];
+    ok = server.receiveData(buff, sizeof(buff), 0) == 0;
+
+    char request[request_size];
+    memset(request, 1, sizeof(request));
+    for (uint32_t i = 0; i < num_requests && ok; i++) {
+      ok = client.sendData(request, sizeof(request), timeout_ms) ==
+        sizeof(request);
+      // The last request is received into a buffer that is too small
+      const uint64_t size = i + 1 < num_requests ? sizeof(buff) : 1;
+      ok = ok && server.receiveData(buff, size, timeout_ms) ==
+        sizeof(request);
+      ok = ok && server.sendData(buff, 1, timeout_ms) == 1;
+      ok = ok && client.receiveData(buff, 1, timeout_ms) == 1;
+    }
+
+    has_server_metrics = server.metrics(server_metrics);
+    has_client_metrics = client.metrics(client_metrics);
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(has_server_metrics && has_client_metrics);
+  EXPECT_TRUE(server_metrics.msgs_received == num_requests);
+  EXPECT_TRUE(server_metrics.bytes_received == num_requests * request_size);
+  EXPECT_TRUE(server_metrics.msgs_sent == num_requests);
+  EXPECT_TRUE(server_metrics.poll_timeouts == 1);
+  EXPECT_TRUE(server_metrics.truncated_receives == 1);
+  EXPECT_TRUE(server_metrics.receive_latency_ns.count == num_requests);
+  EXPECT_TRUE(client_metrics.msgs_sent == num_requests);
+  EXPECT_TRUE(client_metrics.bytes_sent == num_requests * request_size);
+  EXPECT_TRUE(client_metrics.send_latency_ns.count == num_requests);
+}
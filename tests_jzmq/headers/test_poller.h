@@ -0,0 +1,112 @@
+//
+//  test_poller.h
+//
+//  Services several Server/Client pairs from one thread with a single
+//  Poller (no busy loop).
+//
+
+#include <atomic>
+#include <thread>
+#include <sstream>
+#include "jtil/math/math_types.h"
+#include "jzmq/server.h"
+#include "jzmq/client.h"
+#include "jzmq/poller.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace poller_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_pairs = 3;
+  const uint32_t num_requests = 10;
+  const uint32_t buffer_len = 512;
+
+  uint32_t n_server_pings = 0;
+  uint32_t n_client_pings = 0;
+  uint32_t n_errors = 0;
+
+  void serverCallback(Connection& conn, const int events) {
+    char buffer[buffer_len];
+    int bytes_recieved = conn.receiveData(buffer, buffer_len - 1, 0);
+    if (bytes_recieved <= 0 || (events & Poller::ReadEvent) == 0) {
+      n_errors++;
+      return;
+    }
+    n_server_pings++;
+    conn.sendData(buffer, bytes_recieved, 0);  // Echo
+  }
+
+  void clientCallback(Connection& conn, const int events) {
+    char buffer[buffer_len];
+    int bytes_recieved = conn.receiveData(buffer, buffer_len - 1, 0);
+    if (bytes_recieved <= 0) {
+      n_errors++;
+      return;
+    }
+    buffer[bytes_recieved] = '\0';
+    if (buffer != std::string("Hello server")) {
+      n_errors++;
+    }
+    n_client_pings++;
+  }
+
+};  // namespace poller_test
+
+TEST(JZMQTests, PollerManyConnections) {
+  using namespace poller_test;
+  bool ok = true;
+  Server* servers[num_pairs];
+  Client* clients[num_pairs];
+
+  try {
+    Poller poller;
+    for (uint32_t i = 0; i < num_pairs; i++) {
+      std::stringstream ss;
+      ss << "inproc://poller_test_" << i;
+      servers[i] = new Server(ss.str());
+      servers[i]->initConn();
+      clients[i] = new Client(ss.str());
+      clients[i]->initConn();
+      poller.add(*servers[i], Poller::ReadEvent, serverCallback);
+      poller.add(*clients[i], Poller::ReadEvent, clientCallback);
+    }
+
+    char request[] = "Hello server";
+    for (uint32_t r = 0; r < num_requests; r++) {
+      for (uint32_t i = 0; i < num_pairs; i++) {
+        clients[i]->sendData(request, strlen(request), timeout_ms);
+      }
+      // Service every request and reply from this one thread
+      uint32_t n_expected = (r + 1) * num_pairs;
+      while (n_client_pings < n_expected && n_errors == 0) {
+        if (poller.poll(timeout_ms) == 0) {
+          n_errors++;  // Timed out
+        }
+      }
+    }
+
+    // Removing a connection stops its callbacks
+    poller.remove(*servers[0]);
+    ok = ok && poller.size() == 2 * num_pairs - 1;
+
+    for (uint32_t i = 0; i < num_pairs; i++) {
+      clients[i]->killConn();
+      servers[i]->killConn();
+      delete clients[i];
+      delete servers[i];
+    }
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_server_pings == num_pairs * num_requests);
+  EXPECT_TRUE(n_client_pings == num_pairs * num_requests);
+}
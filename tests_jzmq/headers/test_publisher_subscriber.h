@@ -44,7 +44,7 @@ namespace pub_sub_test {
 
     snprintf(buffer, buffer_len-1, "Hello Subscriber");
     int bytes_sent = publisher.sendData(buffer, strlen(buffer), timeout_ms);
-    if (bytes_sent == 0) {
+    if (bytes_sent <= 0) {
       std::cout << "Could not publish data!" << std::endl;
       n_errors++;
       return false;
@@ -59,7 +59,7 @@ namespace pub_sub_test {
 
     try {
       // Start the ZeroMQ Publisher
-      Publisher publisher("tcp://*:5558");
+      Publisher publisher("tcp://*:5559");
       publisher.initConn();
 
       double t0 = clk.getTime();
@@ -109,7 +109,7 @@ namespace pub_sub_test {
 
     try {
       // Start the ZeroMQ Subscriber
-      Subscriber subscriber("tcp://localhost:5558");
+      Subscriber subscriber("tcp://localhost:5559");
       subscriber.initConn();
 
       double t0 = clk.getTime();
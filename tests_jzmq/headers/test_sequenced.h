@@ -0,0 +1,230 @@
+//
+//  test_sequenced.h
+//
+//  A SequencedPublisher sets three topics before a SequencedSubscriber
+//  joins, which must get them from the snapshot on initConn.  The publisher
+//  then floods one topic while the subscriber isn't reading and the high
+//  water marks are tiny, so updates are dropped.  Once the subscriber has
+//  read what was queued one last update is published: the subscriber must
+//  see the gap, fetch a new snapshot and end up with the final value.
+//  Finally a publisher is restarted on the same endpoints: its sequence
+//  numbers start again at 1, but the subscriber must still follow it.
+//
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "jtil/math/math_types.h"
+#include "jzmq/sequenced_stream.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace sequenced_test {
+  const int timeout_ms = 2000;
+  const uint32_t num_updates = 5000;
+
+  std::atomic<bool> publisher_ready(false);
+  std::atomic<bool> start_flood(false);
+  std::atomic<bool> stop_publisher(false);
+  std::atomic<uint64_t> n_errors = 0;
+
+  std::string ToString(const uint32_t value) {
+    std::stringstream ss;
+    ss << value;
+    return ss.str();
+  }
+
+  void PublisherThread() {
+    try {
+      ConnectionOptions options;
+      options.send_hwm = 10;
+      SequencedPublisher publisher("inproc://jzmq_test_seq",
+        "inproc://jzmq_test_seq_snapshot", options);
+      publisher.initConn();
+      publisher.publish("a", "0", 1, timeout_ms);
+      publisher.publish("b", "b", 1, timeout_ms);
+      publisher.publish("c", "c", 1, timeout_ms);
+      publisher_ready = true;
+      while (!start_flood) {
+        publisher.processSnapshots(10);
+      }
+      for (uint32_t i = 1; i < num_updates; i++) {
+        const std::string value = ToString(i);
+        publisher.publish("a", value.data(), value.size(), 0);
+      }
+      // A lost update is only noticed when the next one arrives
+      for (uint32_t i = 0; i < 20; i++) {
+        publisher.processSnapshots(10);
+      }
+      const std::string last = ToString(num_updates);
+      publisher.publish("a", last.data(), last.size(), timeout_ms);
+      while (!stop_publisher) {
+        publisher.processSnapshots(10);
+      }
+      publisher.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cout << "Exception caught in PublisherThread! " << std::endl;
+      std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+      n_errors++;
+    }
+  }
+
+  // Publishes value n_updates times, then keeps republishing it (so that
+  // reconnecting subscribers see an update) until stop_publisher is set.
+  void RestartThread(const std::string value, const uint32_t n_updates) {
+    try {
+      SequencedPublisher publisher("tcp://*:5575", "tcp://*:5576");
+      // The previous publisher's ports are released asynchronously
+      for (uint32_t i = 0; true; i++) {
+        try {
+          publisher.initConn();
+          break;
+        } catch (std::wruntime_error&) {
+          if (i == 100) {
+            throw;
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      }
+      for (uint32_t i = 0; i < n_updates; i++) {
+        publisher.publish("a", value.data(), value.size(), timeout_ms);
+      }
+      publisher_ready = true;
+      while (!stop_publisher) {
+        publisher.processSnapshots(10);
+        publisher.publish("a", value.data(), value.size(), timeout_ms);
+      }
+      publisher.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cout << "Exception caught in RestartThread! " << std::endl;
+      std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+      n_errors++;
+    }
+  }
+
+  bool HasValue(const SequencedState& state, const std::string& value) {
+    SequencedState::const_iterator it = state.find("a");
+    return it != state.end() && it->second.value == value;
+  }
+};  // namespace sequenced_test
+
+TEST(JZMQTests, SequencedStream) {
+  using namespace sequenced_test;
+  bool ok = true;
+  bool bootstrapped = false;
+  uint64_t n_gaps = 0;
+  uint64_t n_snapshots = 0;
+  n_errors = 0;
+  publisher_ready = false;
+  start_flood = false;
+  stop_publisher = false;
+
+  std::thread publisher_thread(PublisherThread);
+  try {
+    while (!publisher_ready) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ConnectionOptions options;
+    options.receive_hwm = 10;
+    SequencedSubscriber subscriber("inproc://jzmq_test_seq",
+      "inproc://jzmq_test_seq_snapshot", timeout_ms, options);
+    subscriber.initConn();
+    const SequencedState& state = subscriber.state();
+    bootstrapped = subscriber.synced() && state.size() == 3 &&
+      state.at("a").value == "0" && state.at("c").value == "c";
+
+    // Let the queues overflow before reading
+    start_flood = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const std::string last = ToString(num_updates);
+    std::string topic;
+    std::string value;
+    while (ok && state.at("a").value != last) {
+      const int rc = subscriber.receive(topic, value, timeout_ms);
+      ok = (rc == 1 && topic == "a") || rc == SequencedSubscriber::kSnapshot;
+    }
+    n_gaps = subscriber.numGaps();
+    n_snapshots = subscriber.numSnapshots();
+    subscriber.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+  stop_publisher = true;
+  publisher_thread.join();
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(bootstrapped);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_gaps >= 1);
+  EXPECT_TRUE(n_snapshots == n_gaps + 1);
+}
+
+TEST(JZMQTests, SequencedStreamRestart) {
+  using namespace sequenced_test;
+  bool ok = true;
+  bool bootstrapped = false;
+  bool followed = false;
+  uint64_t n_restarts = 0;
+  n_errors = 0;
+  publisher_ready = false;
+  stop_publisher = false;
+
+  // The first publisher gets well ahead of the second one's sequence
+  std::thread first(RestartThread, std::string("first"), 1000);
+  std::thread second;
+  try {
+    while (!publisher_ready) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    SequencedSubscriber subscriber("tcp://localhost:5575",
+      "tcp://localhost:5576", timeout_ms);
+    subscriber.initConn();
+    bootstrapped = subscriber.synced() &&
+      HasValue(subscriber.state(), "first");
+
+    stop_publisher = true;
+    first.join();
+    publisher_ready = false;
+    stop_publisher = false;
+    second = std::thread(RestartThread, std::string("second"), 1);
+
+    std::string topic;
+    std::string value;
+    const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (ok && !HasValue(subscriber.state(), "second") &&
+      std::chrono::steady_clock::now() < deadline) {
+      const int rc = subscriber.receive(topic, value, 100);
+      ok = rc >= 0;
+    }
+    followed = HasValue(subscriber.state(), "second");
+    n_restarts = subscriber.numRestarts();
+    subscriber.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+  stop_publisher = true;
+  if (first.joinable()) {
+    first.join();
+  }
+  if (second.joinable()) {
+    second.join();
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(bootstrapped);
+  EXPECT_TRUE(followed);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_restarts >= 1);
+}
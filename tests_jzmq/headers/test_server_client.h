@@ -120,12 +120,12 @@ namespace ser_cnt_test {
     snprintf(buffer, buffer_len-1, "Hello server");
     int bytes_sent = client.sendData(buffer, buffer_len-1, timeout_ms);
     buffer[0] = '\0';
-    if (bytes_sent == 0) {
+    if (bytes_sent <= 0) {
       return 0;  // No message was sent
     } else {
       // The message was sent to the server so we should get a response
       int bytes_recieved = client.receiveData(buffer, buffer_len-1, timeout_ms);
-      if (bytes_recieved == 0) {
+      if (bytes_recieved <= 0) {
          std::cout << "Could not get server response!" << std::endl;
          n_errors++;
       } else {
@@ -205,3 +205,62 @@ TEST(JZMQTests, SimpleServerClient) {
     EXPECT_TRUE(ser_cnt_test::n_client_pings[i] > 0);
   }
 }
+
+// With TimeoutMode::SocketTimeout the timeouts are ZMQ_RCVTIMEO and 
+// ZMQ_SNDTIMEO instead of a poll: an idle Server's receive and a send from
+// a Client that has no server yet (ZMQ_IMMEDIATE) must both return 0 once
+// the timeout has expired, and a request must still go through afterwards.
+TEST(JZMQTests, SocketTimeoutMode) {
+  const int short_timeout_ms = 50;
+  const int long_timeout_ms = 1000;
+  bool ok = true;
+  bool receive_waited = false;
+  bool send_waited = false;
+
+  try {
+    Clk clk;
+    char buffer[16] = "ping";
+    Server server("inproc://jzmq_test_socket_timeout");
+    server.setTimeoutMode(Connection::SocketTimeout);
+    server.initConn();
+    ok = server.receiveData(buffer, sizeof(buffer), 0) == 0;
+    double t0 = clk.getTime();
+    ok = ok && server.receiveData(buffer, sizeof(buffer), 
+      short_timeout_ms) == 0;
+    receive_waited = (clk.getTime() - t0) >= 0.8 * short_timeout_ms / 1000.0;
+
+    ConnectionOptions options;
+    options.immediate = 1;  // Don't queue the request without a server
+    Client orphan("tcp://localhost:5574", options);
+    orphan.setTimeoutMode(Connection::SocketTimeout);
+    orphan.initConn();
+    ok = ok && orphan.sendData(buffer, 4, 0) == 0;
+    t0 = clk.getTime();
+    ok = ok && orphan.sendData(buffer, 4, short_timeout_ms) == 0;
+    send_waited = (clk.getTime() - t0) >= 0.8 * short_timeout_ms / 1000.0;
+    orphan.killConn();
+
+    // The cached socket timeouts are updated as the timeout changes
+    Client client("inproc://jzmq_test_socket_timeout");
+    client.setTimeoutMode(Connection::SocketTimeout);
+    client.initConn();
+    ok = ok && client.sendData(buffer, 4, long_timeout_ms) == 4;
+    ok = ok && client.receiveData(buffer, sizeof(buffer), 
+      short_timeout_ms) == 0;  // Not answered yet
+    ok = ok && server.receiveData(buffer, sizeof(buffer), 
+      long_timeout_ms) == 4;
+    ok = ok && server.sendData(buffer, 4, long_timeout_ms) == 4;
+    ok = ok && client.receiveData(buffer, sizeof(buffer), 
+      long_timeout_ms) == 4;
+    client.killConn();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(receive_waited);
+  EXPECT_TRUE(send_waited);
+}
@@ -0,0 +1,141 @@
+//
+//  test_server_pool.h
+//
+//  Several Client threads send requests to a ServerPool with a few workers.
+//  Every request must be answered (by some worker) and stop() must drain.
+//  A second pool has a handler that throws: the client must get an empty
+//  reply and the workers must survive it.
+//
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/server_pool.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace server_pool_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_workers = 4;
+  const uint32_t num_clients = 4;
+  const uint32_t num_requests = 50;
+
+  std::atomic<uint64_t> n_errors(0);
+  std::atomic<uint64_t> n_handled(0);
+  std::thread clients[num_clients];
+
+  // Replies with the request value + 1
+  void handler(std::vector<Message>& request, std::vector<Message>& reply) {
+    uint32_t value = 0;
+    if (request.size() == 1 && request[0].size() == sizeof(value)) {
+      memcpy(&value, request[0].data(), sizeof(value));
+    }
+    value++;
+    reply.push_back(Message(reinterpret_cast<char*>(&value), sizeof(value)));
+    n_handled++;
+  }
+
+  // Throws for requests 1 and 2, otherwise replies like handler
+  void throwingHandler(std::vector<Message>& request,
+    std::vector<Message>& reply) {
+    uint32_t value = 0;
+    if (request.size() == 1 && request[0].size() == sizeof(value)) {
+      memcpy(&value, request[0].data(), sizeof(value));
+    }
+    if (value == 1) {
+      throw std::runtime_error("request 1");
+    } else if (value == 2) {
+      throw value;
+    }
+    value++;
+    reply.push_back(Message(reinterpret_cast<char*>(&value), sizeof(value)));
+  }
+
+  void ClientThread(const uint32_t i) {
+    try {
+      Client client("inproc://server_pool_test");
+      client.initConn();
+      for (uint32_t r = 0; r < num_requests; r++) {
+        uint32_t value = i * num_requests + r;
+        client.sendData(reinterpret_cast<char*>(&value), sizeof(value),
+          timeout_ms);
+        uint32_t reply = 0;
+        int bytes_recieved = client.receiveData(
+          reinterpret_cast<char*>(&reply), sizeof(reply), timeout_ms);
+        if (bytes_recieved != sizeof(reply) || reply != value + 1) {
+          n_errors++;
+          break;
+        }
+      }
+      client.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cout << "Exception caught while running test! " << std::endl;
+      std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+      n_errors++;
+    }
+  }
+
+};  // namespace server_pool_test
+
+TEST(JZMQTests, ServerPoolWorkers) {
+  using namespace server_pool_test;
+  uint64_t n_served = 0;
+
+  try {
+    ServerPool pool("inproc://server_pool_test", num_workers, handler);
+    pool.start();  // inproc: bind before the clients connect
+
+    for (uint32_t i = 0; i < num_clients; i++) {
+      clients[i] = std::thread(ClientThread, i);
+    }
+    for (uint32_t i = 0; i < num_clients; i++) {
+      clients[i].join();
+    }
+
+    pool.stop();
+    n_served = pool.numRequestsServed();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    n_errors++;
+  }
+
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_handled == num_clients * num_requests);
+  EXPECT_TRUE(n_served == num_clients * num_requests);
+}
+
+TEST(JZMQTests, ServerPoolHandlerThrows) {
+  using namespace server_pool_test;
+  bool ok = true;
+
+  try {
+    ServerPool pool("inproc://server_pool_test_throw", 1, throwingHandler);
+    pool.start();
+    Client client("inproc://server_pool_test_throw");
+    client.initConn();
+    for (uint32_t value = 1; value <= 3 && ok; value++) {
+      client.sendData(reinterpret_cast<char*>(&value), sizeof(value),
+        timeout_ms);
+      uint32_t reply = 0;
+      const int expected = value < 3 ? 0 : sizeof(reply);
+      ok = client.receiveData(reinterpret_cast<char*>(&reply), sizeof(reply),
+        timeout_ms) == expected && (value < 3 || reply == value + 1);
+    }
+    client.killConn();
+    pool.stop();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+}
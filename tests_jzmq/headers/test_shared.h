@@ -0,0 +1,149 @@
+//
+//  test_shared.h
+//
+//  Several threads publish through one SharedPublisher and make requests
+//  through one SharedClient at the same time.  The Subscriber must get
+//  every thread's messages in the order that thread sent them, and every
+//  request must get its own reply.
+//
+
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/server.h"
+#include "jzmq/shared_connection.h"
+#include "jzmq/subscriber.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace shared_test {
+  const int timeout_ms = 2000;
+  const uint32_t num_threads = 4;
+  const uint32_t num_messages = 2000;  // Per thread
+  const uint32_t num_requests = 500;  // Per thread
+
+  std::atomic<uint64_t> n_errors = 0;
+
+  void PublisherThread(SharedPublisher* publisher, const uint32_t id) {
+    try {
+      for (uint32_t i = 0; i < num_messages; i++) {
+        uint32_t data[2] = {id, i};
+        if (publisher->publish("data", reinterpret_cast<char*>(data),
+          sizeof(data), timeout_ms) <= 0) {
+          n_errors++;
+          break;
+        }
+      }
+    } catch (std::wruntime_error& e) {
+      std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+      n_errors++;
+    }
+  }
+
+  void ClientThread(SharedClient* client, const uint32_t id) {
+    try {
+      Message reply;
+      for (uint32_t i = 0; i < num_requests; i++) {
+        const uint32_t request = id * num_requests + i;
+        if (client->request(reinterpret_cast<const char*>(&request),
+          sizeof(request), reply, timeout_ms) != 1 ||
+          reply.size() != sizeof(request) ||
+          *reinterpret_cast<uint32_t*>(reply.data()) != request + 1) {
+          n_errors++;
+          break;
+        }
+      }
+    } catch (std::wruntime_error& e) {
+      std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+      n_errors++;
+    }
+  }
+
+  void ServerThread(Server* server) {
+    for (uint32_t i = 0; i < num_threads * num_requests; i++) {
+      uint32_t request;
+      if (server->receiveData(reinterpret_cast<char*>(&request),
+        sizeof(request), timeout_ms) != sizeof(request)) {
+        n_errors++;
+        break;
+      }
+      request++;
+      server->sendData(reinterpret_cast<char*>(&request), sizeof(request),
+        timeout_ms);
+    }
+  }
+};  // namespace shared_test
+
+TEST(JZMQTests, SharedPublisherClient) {
+  using namespace shared_test;
+  bool ok = true;
+  n_errors = 0;
+  uint32_t n_received = 0;
+
+  try {
+    ConnectionOptions options;
+    options.send_hwm = 0;
+    options.receive_hwm = 0;
+    SharedPublisher publisher("inproc://jzmq_test_shared_pub", options);
+    publisher.start();
+    Subscriber subscriber("inproc://jzmq_test_shared_pub", options);
+    subscriber.initConn();
+    // Wait until the subscription has reached the publisher
+    std::vector<Message> parts;
+    char marker = 'm';
+    do {
+      publisher.publish("ready", &marker, 1, timeout_ms);
+    } while (subscriber.receiveMultipart(parts, 10) == 0);
+    while (subscriber.receiveMultipart(parts, 10) > 0) { }
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < num_threads; i++) {
+      threads.push_back(std::thread(PublisherThread, &publisher, i));
+    }
+    std::vector<uint32_t> next(num_threads, 0);
+    while (ok && n_received < num_threads * num_messages) {
+      ok = subscriber.receiveMultipart(parts, timeout_ms) == 2 &&
+        parts[1].size() == 2 * sizeof(uint32_t);
+      if (ok) {
+        const uint32_t* data = reinterpret_cast<uint32_t*>(parts[1].data());
+        ok = data[0] < num_threads && data[1] == next[data[0]]++;
+        n_received++;
+      }
+    }
+    for (uint32_t i = 0; i < num_threads; i++) {
+      threads[i].join();
+    }
+    threads.clear();
+    subscriber.killConn();
+    publisher.stop();
+
+    Server server("inproc://jzmq_test_shared_rpc");
+    server.initConn();
+    SharedClient client("inproc://jzmq_test_shared_rpc");
+    client.start();
+    std::thread server_thread(ServerThread, &server);
+    for (uint32_t i = 0; i < num_threads; i++) {
+      threads.push_back(std::thread(ClientThread, &client, i));
+    }
+    for (uint32_t i = 0; i < num_threads; i++) {
+      threads[i].join();
+    }
+    server_thread.join();
+    client.stop();
+    server.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_received == num_threads * num_messages);
+}
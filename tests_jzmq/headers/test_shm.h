@@ -0,0 +1,118 @@
+//
+//  test_shm.h
+//
+//  Publishes 1MB messages on two topics through a shm:// ring that only
+//  holds a few of them, so the ring wraps many times.  The Subscriber only
+//  subscribes to one topic and must get exactly those messages, intact and
+//  in order.  A received message must stay valid after both connections
+//  have been killed (it points into the ring).  A second Publisher can't
+//  take over the ring while the first one is open, and rings too large for
+//  the int return values are rejected.  Once its last topic is
+//  unsubscribed the Subscriber must receive nothing.
+//
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/publisher.h"
+#include "jzmq/subscriber.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+#if !defined(_WIN32)
+
+// Invoke a new namespace to keep test data separate
+namespace shm_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_messages = 40;
+  const uint64_t message_size = 1024 * 1024;
+};  // namespace shm_test
+
+TEST(JZMQTests, ShmTransport) {
+  using namespace shm_test;
+  bool ok = true;
+  uint32_t n_received = 0;
+  bool kept_valid = false;
+  bool threw_on_live_ring = false;
+  bool threw_on_size = false;
+  bool unsubscribed_all = false;
+
+  ConnectionOptions too_large;
+  too_large.shm_ring_mb = 4097;
+  try {
+    Publisher publisher("shm://jzmq_test_shm", too_large);
+  } catch (std::wruntime_error&) {
+    threw_on_size = true;
+  }
+
+  try {
+    ConnectionOptions options;
+    options.shm_ring_mb = 8;
+    Publisher publisher("shm://jzmq_test_shm", options);
+    Subscriber subscriber("shm://jzmq_test_shm");
+    subscriber.subscribe("even");
+    publisher.initConn();
+    subscriber.initConn();
+    Publisher second("shm://jzmq_test_shm", options);
+    try {
+      second.initConn();
+    } catch (std::wruntime_error&) {
+      threw_on_live_ring = true;
+    }
+
+    std::vector<char> data((size_t)message_size);
+    std::vector<Message> parts;
+    Message kept;
+    for (uint32_t i = 0; i < num_messages && ok; i++) {
+      memset(&data[0], (int)i, data.size());
+      const std::string topic = (i % 2 == 0) ? "even" : "odd";
+      ok = publisher.publish(topic, &data[0], message_size, timeout_ms) ==
+        (int)(topic.size() + message_size);
+      if (i % 2 != 0) {
+        continue;
+      }
+      ok = ok && subscriber.receiveMultipart(parts, timeout_ms) == 2;
+      ok = ok && parts[0].size() == 4 && memcmp(parts[0].data(), "even", 4)
+        == 0;
+      ok = ok && parts[1].size() == message_size &&
+        parts[1].data()[0] == (char)i &&
+        parts[1].data()[message_size - 1] == (char)i;
+      n_received++;
+      if (i + 2 >= num_messages) {
+        kept = std::move(parts[1]);
+      }
+    }
+    // Nothing for the odd topic must have been delivered
+    ok = ok && subscriber.receiveMultipart(parts, 0) == 0;
+
+    // Without any subscription nothing is delivered at all
+    subscriber.unsubscribe("even");
+    publisher.publish("even", &data[0], 1, timeout_ms);
+    publisher.publish("odd", &data[0], 1, timeout_ms);
+    ok = ok && subscriber.receiveMultipart(parts, 100) == 0;
+    unsubscribed_all = ok;
+
+    subscriber.killConn();
+    publisher.killConn();
+    const char expected = (char)(num_messages - 2);
+    kept_valid = kept.size() == message_size && kept.data()[0] == expected &&
+      kept.data()[message_size - 1] == expected;
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_received == num_messages / 2);
+  EXPECT_TRUE(kept_valid);
+  EXPECT_TRUE(threw_on_live_ring);
+  EXPECT_TRUE(threw_on_size);
+  EXPECT_TRUE(unsubscribed_all);
+}
+
+#endif  // !defined(_WIN32)
@@ -0,0 +1,137 @@
+//
+//  test_thread.h
+//
+//  thread:// connections talk without ZeroMQ.  A Client sends numbered
+//  requests to a Server thread that replies with the number incremented;
+//  the Client connects first so its first requests queue until the Server
+//  binds.  A Publisher then streams to two Subscriber threads, one of which
+//  only subscribes to one of the two topics.  A Message sent to a single
+//  Subscriber must arrive without being copied.
+//
+
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/publisher.h"
+#include "jzmq/server.h"
+#include "jzmq/subscriber.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace thread_test {
+  const int timeout_ms = 1000;
+  const uint32_t num_requests = 10000;
+  const uint32_t num_messages = 10000;
+
+  std::atomic<uint64_t> n_errors = 0;
+
+  void ServerThread() {
+    try {
+      Server server("thread://jzmq_test_rpc");
+      server.initConn();
+      for (uint32_t i = 0; i < num_requests; i++) {
+        uint32_t value;
+        if (server.receive(value, timeout_ms) <= 0) {
+          n_errors++;
+          break;
+        }
+        value++;
+        server.send(value, timeout_ms);
+      }
+      server.killConn();
+    } catch (std::wruntime_error& e) {
+      std::cout << "Exception caught in ServerThread! " << std::endl;
+      std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+      n_errors++;
+    }
+  }
+
+  // Counts the messages received until an empty one arrives
+  void SubscriberThread(Subscriber* subscriber, std::atomic<uint64_t>* n) {
+    std::vector<Message> parts;
+    while (true) {
+      if (subscriber->receiveMultipart(parts, timeout_ms) != 2) {
+        n_errors++;
+        break;
+      }
+      if (parts[1].size() == 0) {
+        break;
+      }
+      (*n)++;
+    }
+  }
+};  // namespace thread_test
+
+TEST(JZMQTests, ThreadTransport) {
+  using namespace thread_test;
+  bool ok = true;
+  bool zero_copy = false;
+  n_errors = 0;
+  std::atomic<uint64_t> n_all(0);
+  std::atomic<uint64_t> n_even(0);
+
+  try {
+    Client client("thread://jzmq_test_rpc");
+    client.initConn();
+    std::thread server(ServerThread);
+    for (uint32_t i = 0; i < num_requests && ok; i++) {
+      uint32_t reply = 0;
+      ok = client.send(i, timeout_ms) > 0;
+      ok = ok && client.receive(reply, timeout_ms) > 0 && reply == i + 1;
+    }
+    server.join();
+    client.killConn();
+
+    ConnectionOptions options;
+    options.receive_hwm = 0;  // Don't drop anything
+    Publisher publisher("thread://jzmq_test_pub");
+    Subscriber sub_all("thread://jzmq_test_pub", options);
+    Subscriber sub_even("thread://jzmq_test_pub", options);
+    sub_even.subscribe("even");
+    publisher.initConn();
+    sub_all.initConn();
+    sub_even.initConn();
+    std::thread all_thread(SubscriberThread, &sub_all, &n_all);
+    std::thread even_thread(SubscriberThread, &sub_even, &n_even);
+    for (uint32_t i = 0; i < num_messages && ok; i++) {
+      const std::string topic = (i % 2 == 0) ? "even" : "odd";
+      ok = publisher.publish(topic, reinterpret_cast<const char*>(&i),
+        sizeof(i), timeout_ms) > 0;
+    }
+    ok = ok && publisher.publish("even", NULL, 0, timeout_ms) == 4;
+    all_thread.join();
+    even_thread.join();
+    sub_all.killConn();
+    sub_even.killConn();
+
+    // With a single subscriber the frame itself is handed over
+    Subscriber sub_one("thread://jzmq_test_pub");
+    sub_one.initConn();
+    Message msg(1024);
+    const char* sent_data = msg.data();
+    ok = ok && publisher.sendMessage(msg, timeout_ms) == 1024;
+    Message received;
+    ok = ok && sub_one.receiveMessage(received, timeout_ms) == 1;
+    zero_copy = received.data() == sent_data;
+    sub_one.killConn();
+    publisher.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_all == num_messages);
+  EXPECT_TRUE(n_even == num_messages / 2);
+  EXPECT_TRUE(zero_copy);
+}
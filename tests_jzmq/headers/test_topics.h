@@ -0,0 +1,162 @@
+//
+//  test_topics.h
+//
+//  Publishes on three topics and checks that a Subscriber with a
+//  TopicDispatcher only receives the topics it has handlers for, and that
+//  overlapping prefixes are all dispatched.  A second test subscribes at
+//  runtime to a Subscriber that started with the default (catch-all)
+//  subscription, which must narrow the filter to the new topic.
+//
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "jtil/math/math_types.h"
+#include "jzmq/publisher.h"
+#include "jzmq/subscriber.h"
+#include "jzmq/topic_dispatcher.h"
+#include "jtil/clk/clk.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::clk;
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace topics_test {
+  const double test_time_sec = 0.25;
+  const char* payload = "payload";
+
+  uint32_t n_received = 0;  // Messages that made it through the filter
+  uint32_t n_weather = 0;  // Handler for "weather"
+  uint32_t n_weather_nyc = 0;  // Handler for "weather.nyc"
+  uint32_t n_errors = 0;
+
+  void onWeather(std::vector<Message>& frames) {
+    if (frames.size() != 2 || frames[1].size() != strlen(payload)) {
+      n_errors++;
+    }
+    n_weather++;
+  }
+
+  void onWeatherNYC(std::vector<Message>& frames) {
+    std::string topic(frames[0].data(), (size_t)frames[0].size());
+    if (topic != "weather.nyc") {
+      n_errors++;
+    }
+    n_weather_nyc++;
+  }
+
+};  // namespace topics_test
+
+TEST(JZMQTests, TopicDispatcher) {
+  using namespace topics_test;
+  bool ok = true;
+
+  try {
+    Publisher publisher("inproc://topics_test");
+    publisher.initConn();
+    Subscriber subscriber("inproc://topics_test");
+    TopicDispatcher dispatcher(subscriber);
+    dispatcher.addHandler("weather", onWeather);
+    dispatcher.addHandler("weather.nyc", onWeatherNYC);
+    subscriber.initConn();
+    ok = ok && subscriber.topics().size() == 2;
+
+    // Keep publishing until the subscriptions have propagated and a few
+    // messages of each topic got through
+    Clk clk;
+    double t0 = clk.getTime();
+    while ((clk.getTime() - t0) < test_time_sec) {
+      publisher.publish("weather.nyc", payload, strlen(payload), 0);
+      publisher.publish("weather.sfo", payload, strlen(payload), 0);
+      publisher.publish("sports", payload, strlen(payload), 0);
+      int rc = dispatcher.dispatch(1);
+      if (rc > 0) {
+        n_received += rc;
+      }
+    }
+
+    // Removing a handler unsubscribes it
+    dispatcher.removeHandler("weather.nyc");
+    ok = ok && subscriber.topics().size() == 1;
+
+    subscriber.killConn();
+    publisher.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_errors == 0);
+  EXPECT_TRUE(n_weather_nyc > 0);
+  // "weather" sees both weather topics and "sports" is filtered by ZeroMQ,
+  // so every message received was handled by "weather"
+  EXPECT_TRUE(n_weather > n_weather_nyc);
+  EXPECT_TRUE(n_weather == n_received);
+}
+
+TEST(JZMQTests, RuntimeSubscribe) {
+  using namespace topics_test;
+  bool ok = true;
+  uint32_t n_default = 0;  // Messages received with the default subscription
+  uint32_t n_a = 0;
+  uint32_t n_b = 0;
+
+  try {
+    Publisher publisher("inproc://topics_test_runtime");
+    publisher.initConn();
+    Subscriber subscriber("inproc://topics_test_runtime");
+    subscriber.initConn();
+    ok = ok && subscriber.topics().size() == 0;
+
+    std::vector<Message> frames;
+    Clk clk;
+    double t0 = clk.getTime();
+    while ((clk.getTime() - t0) < test_time_sec) {
+      publisher.publish("b", payload, strlen(payload), 0);
+      if (subscriber.receiveMultipart(frames, 1) > 0) {
+        n_default++;
+      }
+    }
+
+    subscriber.subscribe("a");
+    ok = ok && subscriber.topics().size() == 1;
+    // Let the new filter reach the publisher and drain the old messages
+    t0 = clk.getTime();
+    while ((clk.getTime() - t0) < test_time_sec) {
+      publisher.publish("a", payload, strlen(payload), 0);
+      publisher.publish("b", payload, strlen(payload), 0);
+      subscriber.receiveMultipart(frames, 1);
+    }
+    while (subscriber.receiveMultipart(frames, 10) > 0) { }
+
+    for (uint32_t i = 0; i < 10; i++) {
+      publisher.publish("b", payload, strlen(payload), 0);
+      publisher.publish("a", payload, strlen(payload), 0);
+    }
+    while (subscriber.receiveMultipart(frames, 100) > 0) {
+      std::string topic(frames[0].data(), (size_t)frames[0].size());
+      if (topic == "a") {
+        n_a++;
+      } else {
+        n_b++;
+      }
+    }
+
+    subscriber.killConn();
+    publisher.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(n_default > 0);
+  EXPECT_TRUE(n_a == 10);
+  EXPECT_TRUE(n_b == 0);
+}
@@ -0,0 +1,106 @@
+//
+//  test_typed.h
+//
+//  Sends a struct with Connection::send<T>/receive<T> between a Client and
+//  Server, then over a TypedPublisher/TypedSubscriber pair.  A subscriber
+//  expecting another schema of the same size must reject the message.
+//
+
+#include <string>
+#include "jtil/math/math_types.h"
+#include "jzmq/client.h"
+#include "jzmq/server.h"
+#include "jzmq/typed_channel.h"
+#include "jtil/clk/clk.h"
+#include "jtil/exceptions/wruntime_error.h"
+#include "jtil/string_util/string_util.h"
+
+using namespace jtil::clk;
+using namespace jtil::string_util;
+using namespace jzmq;
+
+// Invoke a new namespace to keep test data separate
+namespace typed_test {
+  const int timeout_ms = 1000;
+  const double test_time_sec = 1.0;
+
+  struct Pose {
+    float x, y, z;
+    uint32_t id;
+  };
+
+  // Same layout, different schema
+  struct Heading {
+    float x, y, z;
+    uint32_t id;
+  };
+
+  bool equal(const Pose& a, const Pose& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.id == b.id;
+  }
+};  // namespace typed_test
+
+JZMQ_MESSAGE_SCHEMA(typed_test::Pose, 1)
+JZMQ_MESSAGE_SCHEMA(typed_test::Heading, 1)
+
+TEST(JZMQTests, TypedMessages) {
+  using namespace typed_test;
+  bool ok = true;
+  bool threw_on_mismatch = false;
+  const Pose sent = {1.0f, 2.0f, 3.0f, 42};
+
+  try {
+    Server server("inproc://typed_test_rep");
+    Client client("inproc://typed_test_rep");
+    server.initConn();
+    client.initConn();
+    Pose request = {0, 0, 0, 0};
+    ok = client.send(sent, timeout_ms) > 0;
+    ok = ok && server.receive(request, timeout_ms) == 1;
+    ok = ok && equal(request, sent);
+    ok = ok && server.send(request, timeout_ms) > 0;
+    Pose reply = {0, 0, 0, 0};
+    ok = ok && client.receive(reply, timeout_ms) == 1;
+    ok = ok && equal(reply, sent);
+    client.killConn();
+    server.killConn();
+
+    TypedPublisher<Pose> publisher("inproc://typed_test_pub");
+    TypedSubscriber<Pose> subscriber("inproc://typed_test_pub");
+    TypedSubscriber<Heading> wrong_subscriber("inproc://typed_test_pub");
+    publisher.initConn();
+    subscriber.subscribe("pose");
+    subscriber.initConn();
+    wrong_subscriber.initConn();
+
+    // Publish until the subscriptions have propagated
+    Pose received = {0, 0, 0, 0};
+    std::string topic;
+    Clk clk;
+    double t0 = clk.getTime();
+    int rc = 0;
+    while (rc == 0 && (clk.getTime() - t0) < test_time_sec) {
+      publisher.publish("pose", sent, 0);
+      rc = subscriber.receive(received, 1, &topic);
+    }
+    ok = ok && rc == 1 && topic == "pose" && equal(received, sent);
+
+    Heading heading;
+    try {
+      wrong_subscriber.receive(heading, timeout_ms);
+    } catch (std::wruntime_error&) {
+      threw_on_mismatch = true;
+    }
+
+    wrong_subscriber.killConn();
+    subscriber.killConn();
+    publisher.killConn();
+  } catch (std::wruntime_error& e) {
+    std::cout << "Exception caught while running test! " << std::endl;
+    std::cout << "  " << ToNarrowString(e.errorMsg()) << std::endl;
+    ok = false;
+  }
+
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(threw_on_mismatch);
+}
@@ -10,6 +10,24 @@
 
 #include "test_server_client.h"
 #include "test_publisher_subscriber.h"
+#include "test_message.h"
+#include "test_poller.h"
+#include "test_async.h"
+#include "test_server_pool.h"
+#include "test_topics.h"
+#include "test_context.h"
+#include "test_last_value.h"
+#include "test_typed.h"
+#include "test_codec.h"
+#include "test_buffer_pool.h"
+#include "test_metrics.h"
+#include "test_shm.h"
+#include "test_thread.h"
+#include "test_shared.h"
+#include "test_client_pool.h"
+#include "test_hedged.h"
+#include "test_sequenced.h"
+#include "test_batch.h"
 
 #include "jtil/debug_util/debug_util.h"  // Must come last in .cpp with main
 
@@ -25,6 +43,7 @@ int main(int argc, char* argv[]) {
   // jtil::debug::SetBreakPointOnAlocation(574);
 #endif
   int ret_val = RUN_TESTS(argc, argv);
+  jzmq::Connection::shutdownContext();  // Stops the I/O threads before exit
 #ifdef _WIN32
   system("PAUSE");
 #endif